@@ -0,0 +1,139 @@
+#ifndef DAVOS_KERNEL_ADDRESS_SPACE_H_INCLUDED
+#define DAVOS_KERNEL_ADDRESS_SPACE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+#include <kpp/array.hpp>
+
+#include <kernel/PageTree.h>
+#include <kernel/paging.h>
+#include <kernel/SpinLock.h>
+
+/**
+ * @brief A virtual address space: a page tree with its own PML4 and PCID.
+ *
+ * The upper (kernel) half is the same in every address space: the kernel's address space
+ * allocates a PDPT for each of its 256 upper-half PML4 entries up front, and every other address
+ * space points its upper-half PML4 entries at those same PDPTs. Kernel mappings made after an
+ * address space is created are therefore visible in it, without any page table being copied.
+ * Address spaces other than the kernel's only map pages in the lower half.
+ */
+class AddressSpace
+{
+public:
+    /**
+     * @brief Construct the kernel's address space, with an empty lower half and every upper-half
+     * PDPT allocated. There must be only one, using PCID 0.
+     */
+    AddressSpace();
+
+    /**
+     * @brief Construct an address space with an empty lower half, sharing the upper half of the
+     * kernel's address space.
+     */
+    explicit AddressSpace(AddressSpace &kernel_space);
+
+    /**
+     * @brief Free the lower-half page tables and the PML4 (but not the frames they map). The
+     * address space must not be active on any processor.
+     */
+    ~AddressSpace();
+
+    AddressSpace(const AddressSpace &) = delete;
+    AddressSpace &operator=(const AddressSpace &) = delete;
+
+    /**
+     * @brief Load the address space on the current processor. The TLB entries tagged with its
+     * PCID are kept unless they may be stale.
+     */
+    void activate();
+
+    /**
+     * @brief Check if the address space is loaded on the current processor.
+     */
+    auto is_active() const -> bool;
+
+    /**
+     * @brief Get the address space loaded on the current processor.
+     */
+    static auto active() -> AddressSpace *;
+
+    /**
+     * @brief Map a range of pages, as PageTree::map_range.
+     */
+    void map_range(uintptr_t virtual_base, uintptr_t physical_base, size_t length, PageFlags flags);
+
+    /**
+     * @brief Unmap a range of pages, as PageTree::unmap_range.
+     */
+    auto unmap_range(uintptr_t virtual_base, size_t length, UnmappedPageVisitor on_unmapped) -> size_t;
+
+    /**
+     * @brief Change the permissions of a range of pages, as PageTree::protect_range.
+     */
+    auto protect_range(uintptr_t virtual_base, size_t length, PageFlags flags) -> size_t;
+
+    /**
+     * @brief Map the pages that `source` maps in a range to the same frames in this address
+     * space, as copy-on-write pages (see PageTree::share_copy_on_write). The first write to
+     * such a page in either address space gives the writer its own copy of the frame.
+     *
+     * @return the number of pages that were shared
+     */
+    auto share_copy_on_write(AddressSpace &source, uintptr_t virtual_base, size_t length) -> size_t;
+
+    /**
+     * @brief Get the translation of a virtual address, as PageTree::get_translation. Recent
+     * translations of mapped pages are cached, so that looking up the same pages again doesn't
+     * walk the page tree.
+     */
+    auto get_translation(uintptr_t virtual_address) -> PageTranslation;
+
+    /**
+     * @brief Physical address of the PML4.
+     */
+    auto root() const -> uintptr_t { return root_; }
+
+    auto pcid() const -> uint16_t { return pcid_; }
+
+private:
+    /**
+     * @brief Check that a range is in the lower half (the only part a non-kernel address space can
+     * change), and record that the TLB entries tagged with the PCID may be stale on every
+     * processor other than the current one (invalidations only apply to the active PCID of
+     * the processor that issues them).
+     */
+    void prepare_change(uintptr_t virtual_base, size_t length);
+
+    /**
+     * @brief Drop the cached translations of the pages in a range, after the range was changed.
+     */
+    void invalidate_translations(uintptr_t virtual_base, size_t length);
+
+    /**
+     * @brief The translation of a 4 KiB page, in a direct-mapped cache indexed by page number.
+     */
+    struct CachedTranslation
+    {
+        // base address of the page, or 1 (not a page address) if the entry is empty
+        uintptr_t page = 1;
+        PageTranslation translation {};
+    };
+
+    static constexpr size_t translation_cache_size = 64;
+
+    uintptr_t root_ = 0;
+    PageTree page_tree_;
+    uint16_t pcid_ = 0;
+    bool is_kernel_space_ = false;
+    // bit i is set if the TLB of processor i may hold stale entries tagged with the PCID
+    uint32_t stale_tlbs_ = ~uint32_t {0};
+    kpp::Array<CachedTranslation, translation_cache_size> translation_cache_ {};
+    // incremented whenever translations are invalidated, so that a translation walked before a
+    // change isn't cached after it
+    uint64_t translation_cache_generation_ = 0;
+    SpinLock translation_cache_lock_;
+};
+
+#endif
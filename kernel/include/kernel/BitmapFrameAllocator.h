@@ -0,0 +1,125 @@
+#ifndef DAVOS_KERNEL_BITMAP_FRAME_ALLOCATOR_H_INCLUDED
+#define DAVOS_KERNEL_BITMAP_FRAME_ALLOCATOR_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+#include <kernel/FrameInfo.h>
+
+/**
+ * @brief A frame allocator that tracks free frames with a hierarchical bitmap.
+ *
+ * Every frame has one bit in a leaf word (set if the frame is free). Two summary bitmaps have
+ * one bit per leaf word: one set if the leaf has any free frame, the other set if all of its
+ * frames are free. Single frames are found by scanning the first summary for a non-empty leaf
+ * and taking its lowest set bit with `__builtin_ctzll`. Blocks of up to 64 frames are found by
+ * folding a leaf word onto itself until only the bits that start a long enough run are left,
+ * and larger blocks by doing the same with the summary of full leaves.
+ *
+ * Blocks are naturally aligned, as with BuddyFrameAllocator, so both allocators can be used
+ * interchangeably. Unlike BuddyFrameAllocator, free blocks aren't recorded in the frame metadata
+ * (only the first frame of an allocated block is), and freed blocks don't need to be coalesced.
+ */
+class BitmapFrameAllocator
+{
+public:
+    /**
+     * @brief The largest supported block is 2^max_order frames (1 GiB).
+     */
+    static constexpr uint8_t max_order = 18;
+    static constexpr uint8_t num_orders = max_order + 1;
+
+    /**
+     * @brief Get the number of 64-bit words of storage needed for the bitmaps of an allocator
+     * managing the physical range [begin, end).
+     */
+    static auto storage_words(uintptr_t begin, uintptr_t end) -> size_t;
+
+    /**
+     * @brief Construct an allocator with no free frames, managing the physical range [begin, end).
+     *
+     * @param frame_infos metadata of every frame below `end`, indexed by PFN
+     * @param zone identifier recorded in the metadata of the blocks allocated by this allocator
+     * @param storage at least storage_words(begin, end) words for the bitmaps
+     */
+    BitmapFrameAllocator(uintptr_t begin, uintptr_t end, FrameInfo *frame_infos, uint8_t zone, uint64_t *storage);
+
+    /**
+     * @brief Allocate a block of 2^order contiguous frames, aligned to its size.
+     *
+     * @return the physical address of the block, or 0 if there is no such free block
+     */
+    auto allocate(uint8_t order) -> uintptr_t;
+
+    /**
+     * @brief Return a block of 2^order frames to the allocator.
+     */
+    auto deallocate(uintptr_t block, uint8_t order) -> void;
+
+    /**
+     * @brief Return every frame in the physical range [begin, end) to the allocator, a word
+     * (64 frames) at a time.
+     */
+    auto deallocate_range(uintptr_t begin, uintptr_t end) -> void;
+
+    /**
+     * @brief Check if the given frame is free and owned by this allocator.
+     */
+    auto owns_free_block(uintptr_t block) const -> bool;
+
+    /**
+     * @brief Get the order of the free block starting at the given frame. Free frames aren't
+     * grouped into blocks, so this is always 0.
+     */
+    auto free_block_order(uintptr_t) const -> uint8_t { return 0; }
+
+    /**
+     * @brief Mark a free frame owned by this allocator as allocated without going through
+     * allocate().
+     *
+     * @return the order of the removed block (always 0)
+     */
+    auto take_free_block(uintptr_t block) -> uint8_t;
+
+    /**
+     * @brief Total number of free frames.
+     */
+    auto free_frames() const -> size_t { return free_frames_; }
+
+    /**
+     * @brief Number of free blocks of exactly the given order, i.e. the number of blocks a
+     * buddy allocator with the same free frames would have. This scans the bitmaps.
+     */
+    auto free_blocks(uint8_t order) const -> size_t;
+
+    /**
+     * @brief One-past-the-end physical address of the managed memory.
+     */
+    auto end() const -> uintptr_t { return end_; }
+
+private:
+    auto frame_index(uintptr_t frame) const -> size_t;
+    auto find_free_frames(uint8_t order, size_t &first_frame) -> bool;
+    auto find_free_leaves(uint8_t order_in_leaves, size_t &first_leaf) const -> bool;
+    auto set_frames(size_t first_frame, size_t num_frames, bool free) -> void;
+    auto update_leaf(size_t leaf, uint64_t value) -> void;
+    auto has_free_frame(size_t first_frame, size_t num_frames) const -> bool;
+    auto aligned_free_blocks(uint8_t order) const -> size_t;
+
+    // physical address of bit 0, aligned to the largest block size
+    uintptr_t base_ = 0;
+    uintptr_t begin_ = 0;
+    uintptr_t end_ = 0;
+    size_t free_frames_ = 0;
+    uint64_t *leaves_ = nullptr;
+    uint64_t *nonempty_leaves_ = nullptr;
+    uint64_t *full_leaves_ = nullptr;
+    size_t num_leaves_ = 0;
+    size_t num_summaries_ = 0;
+    // every summary word before this one is empty
+    size_t first_nonempty_summary_ = 0;
+    FrameInfo *frame_infos_ = nullptr;
+    uint8_t zone_ = 0;
+};
+
+#endif
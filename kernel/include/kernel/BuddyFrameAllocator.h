@@ -0,0 +1,118 @@
+#ifndef DAVOS_KERNEL_BUDDY_FRAME_ALLOCATOR_H_INCLUDED
+#define DAVOS_KERNEL_BUDDY_FRAME_ALLOCATOR_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+#include <kpp/array.hpp>
+
+#include <kernel/FrameInfo.h>
+
+/**
+ * @brief A binary buddy allocator for physical frames.
+ *
+ * Memory is handed out in naturally-aligned blocks of 2^order contiguous frames.
+ * Each order has a doubly-linked free list threaded through the free blocks themselves
+ * (accessed through the HHDM). Whether a block is free, and at which order, is recorded in
+ * the frame metadata of its first frame, so that the buddy of a freed block can be found and
+ * coalesced in O(1).
+ */
+class BuddyFrameAllocator
+{
+public:
+    /**
+     * @brief The largest supported block is 2^max_order frames (1 GiB).
+     */
+    static constexpr uint8_t max_order = 18;
+    static constexpr uint8_t num_orders = max_order + 1;
+
+    /**
+     * @brief Construct an allocator with no free frames, managing physical addresses below `end`.
+     *
+     * Several allocators can share the same metadata array as long as they have different zone
+     * identifiers: a free block is only merged with buddies that belong to the same allocator.
+     *
+     * @param end one-past-the-end physical address of the managed memory
+     * @param frame_infos zero-initialized metadata of every frame below `end`, indexed by PFN
+     * @param zone identifier recorded in the metadata of the blocks owned by this allocator
+     */
+    BuddyFrameAllocator(uintptr_t end, FrameInfo *frame_infos, uint8_t zone = 0);
+
+    /**
+     * @brief Allocate a block of 2^order contiguous frames, aligned to its size.
+     *
+     * @return the physical address of the block, or 0 if no block is large enough
+     */
+    auto allocate(uint8_t order) -> uintptr_t;
+
+    /**
+     * @brief Return a block of 2^order frames to the allocator, coalescing it with its buddy
+     * as long as the buddy is also free.
+     */
+    auto deallocate(uintptr_t block, uint8_t order) -> void;
+
+    /**
+     * @brief Return every frame in the physical range [begin, end) to the allocator.
+     *
+     * The range is split into the largest naturally-aligned blocks that fit, so the work done
+     * is proportional to the number of blocks (at most ~2 * max_order plus one per 1 GiB),
+     * not the number of frames.
+     */
+    auto deallocate_range(uintptr_t begin, uintptr_t end) -> void;
+
+    /**
+     * @brief Check if the given address is the first frame of a free block owned by this
+     * allocator (of any order).
+     */
+    auto owns_free_block(uintptr_t block) const -> bool;
+
+    /**
+     * @brief Get the order of the free block starting at the given frame.
+     */
+    auto free_block_order(uintptr_t block) const -> uint8_t { return info(block).order; }
+
+    /**
+     * @brief Remove a free block owned by this allocator from the free lists without allocating
+     * it through allocate(), e.g. to keep it from being handed out while its neighbours are
+     * being migrated.
+     *
+     * @return the order of the removed block
+     */
+    auto take_free_block(uintptr_t block) -> uint8_t;
+
+    /**
+     * @brief Total number of free frames across all orders.
+     */
+    auto free_frames() const -> size_t { return free_frames_; }
+
+    /**
+     * @brief Number of free blocks of exactly the given order.
+     */
+    auto free_blocks(uint8_t order) const -> size_t { return free_blocks_[order]; }
+
+    /**
+     * @brief One-past-the-end physical address of the managed memory.
+     */
+    auto end() const -> uintptr_t { return end_; }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next = nullptr;
+        FreeBlock *prev = nullptr;
+    };
+
+    auto push(uintptr_t block, uint8_t order) -> void;
+    auto remove(uintptr_t block, uint8_t order) -> void;
+    auto is_free(uintptr_t block, uint8_t order) const -> bool;
+    auto info(uintptr_t block) const -> FrameInfo &;
+
+    uintptr_t end_ = 0;
+    size_t free_frames_ = 0;
+    kpp::Array<FreeBlock *, num_orders> free_lists_ {};
+    kpp::Array<size_t, num_orders> free_blocks_ {};
+    FrameInfo *frame_infos_ = nullptr;
+    uint8_t zone_ = 0;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef DAVOS_KERNEL_FRAME_INFO_H_INCLUDED
+#define DAVOS_KERNEL_FRAME_INFO_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief State flags of a physical frame.
+ */
+enum class FrameFlags : uint16_t
+{
+    None = 0,
+    Free = 1 << 0,    // the frame is the first frame of a free block in the buddy allocator
+    Movable = 1 << 1, // the frame is only referenced by the mapping at `owner`, and can be moved
+    Slab = 1 << 2,    // the frame belongs to a slab of a SlabCache, whose header is at `owner`
+};
+
+inline FrameFlags operator|(FrameFlags a, FrameFlags b)
+{
+    return static_cast<FrameFlags>(static_cast<uint16_t>(a) | static_cast<uint16_t>(b));
+}
+
+inline FrameFlags operator&(FrameFlags a, FrameFlags b)
+{
+    return static_cast<FrameFlags>(static_cast<uint16_t>(a) & static_cast<uint16_t>(b));
+}
+
+inline FrameFlags operator~(FrameFlags a)
+{
+    return static_cast<FrameFlags>(~static_cast<uint16_t>(a));
+}
+
+/**
+ * @brief Metadata for one physical frame, indexed by physical frame number (PFN).
+ *
+ * The metadata array is allocated once when the frame allocator is initialized and covers
+ * every frame the allocator manages. Entries are 16 bytes, so four of them share a cache line.
+ *
+ * For a block of 2^order frames, only the entry of the first frame of the block is meaningful.
+ */
+struct FrameInfo
+{
+    // number of owners of the frame: the frame is freed when this drops to 0
+    std::atomic<uint32_t> ref_count;
+    FrameFlags flags;
+    // log2 of the number of frames in the (free or allocated) block starting at this frame
+    uint8_t order;
+    // identifies the pool (memory zone of a NUMA node) that owns the block
+    uint8_t zone;
+    // owner-specific data, e.g. the virtual address a movable frame is mapped at, the number of
+    // present entries of a page table, or the slab a frame belongs to
+    uint64_t owner;
+
+    auto has_flags(FrameFlags mask) const -> bool
+    {
+        return (flags & mask) == mask;
+    }
+};
+
+static_assert(sizeof(FrameInfo) == 16, "frame metadata should stay compact");
+
+#endif
@@ -16,6 +16,18 @@ public:
      */
     void enableAPIC();
 
+    /**
+     * @brief Enable the local APIC of an application processor, once enableAPIC has run on the
+     * bootstrap processor. Every processor sees its own local APIC at the same address.
+     */
+    void enableApplicationProcessorAPIC();
+
+    /**
+     * @brief Send a fixed interrupt with the given vector to the processor with the given APIC ID,
+     * waiting for the previous one sent by this processor to be delivered first.
+     */
+    void sendInterprocessorInterrupt(uint32_t apicId, uint8_t vector);
+
     /**
      * @brief Send the End of Interrupt (EOI) signal to the local APIC. This needs to be called
      * after handling an interrupt to inform the local APIC that the interrupt has been processed
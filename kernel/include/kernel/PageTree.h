@@ -25,11 +25,91 @@ public:
     /**
      * @brief Map a virtual memory page to a physical frame in the page tree.
      *
+     * If the page is inside a 2 MiB or 1 GiB page, the large page is split into smaller pages
+     * first, so that the rest of it stays mapped.
+     *
      * @param page base address of the page to map
      * @param frame base address of the frame to map
      */
     void map_page_to_frame(uint64_t page, uint64_t frame, PageFlags flags);
 
+    /**
+     * @brief Map a range of virtual pages to a range of physical frames of the same length,
+     * using 1 GiB pages (if the processor supports them) and 2 MiB pages wherever both the
+     * virtual and physical addresses are aligned to their size and the range is long enough.
+     *
+     * The tree is walked once for the whole range rather than once per page. The TLB entries of
+     * pages that were already mapped are invalidated as in unmap_range.
+     *
+     * @param virtual_base base address of the first page to map
+     * @param physical_base base address of the first frame to map
+     * @param length multiple of the page size: the number of bytes to map
+     */
+    void map_range(uint64_t virtual_base, uint64_t physical_base, uint64_t length, PageFlags flags);
+
+    /**
+     * @brief Remove the mappings of every page in a range, splitting large pages that are only
+     * partly inside it, and free the page tables that are left empty.
+     *
+     * The TLB entries of the range are invalidated one page at a time with invlpg, or all at once
+     * by reloading CR3 if the range spans more than tlb_flush_threshold pages, and then on the
+     * other processors (see smp_invalidate_tlb). Frames and tables are only released once they
+     * can't be reached through any TLB anymore.
+     *
+     * @param virtual_base base address of the first page to unmap
+     * @param length multiple of the page size: the number of bytes to unmap
+     * @param on_unmapped called with each unmapped frame (may be nullptr)
+     * @return the number of pages (of any size) that were unmapped
+     */
+    auto unmap_range(uint64_t virtual_base, uint64_t length, UnmappedPageVisitor on_unmapped) -> size_t;
+
+    /**
+     * @brief Replace the permissions (Write, User, ExecuteDisable and CopyOnWrite) of every mapped
+     * page in a range with those in `flags`, splitting large pages that are only partly inside it.
+     * TLB entries are invalidated as in unmap_range.
+     *
+     * @return the number of pages (of any size) whose permissions changed
+     */
+    auto protect_range(uint64_t virtual_base, uint64_t length, PageFlags flags) -> size_t;
+
+    /**
+     * @brief Map the pages that `source` maps in a range to the same frames in this tree, as
+     * copy-on-write pages: writable pages lose their write permission in both trees and are
+     * marked CopyOnWrite, and the reference count of every shared frame is incremented. Large
+     * pages of `source` in the range are split first. The range must not be mapped in this tree.
+     *
+     * The TLB entries of `source` are invalidated as in protect_range.
+     *
+     * @return the number of pages that were shared
+     */
+    auto share_copy_on_write(PageTree &source, uint64_t virtual_base, uint64_t length) -> size_t;
+
+    /**
+     * @brief Above this number of pages, invalidating pages one at a time costs more than
+     * flushing the whole TLB and refilling it.
+     */
+    static constexpr uint64_t tlb_flush_threshold = 32;
+
+    /**
+     * @brief Create a table for every empty root entry of the upper (kernel) half, so that the
+     * upper half can be shared with other page trees through share_upper_half. These tables are
+     * never freed, even once they are empty.
+     */
+    void allocate_upper_half();
+
+    /**
+     * @brief Point the upper-half root entries of this tree at the tables of `other`, whose upper
+     * half must have been allocated with allocate_upper_half. Mappings made in the upper half of
+     * either tree are then visible in both.
+     */
+    void share_upper_half(PageTree &other);
+
+    /**
+     * @brief Free every table of the lower half of the tree (but not the frames they map), and
+     * clear the lower-half root entries.
+     */
+    void free_lower_half();
+
     /**
      * @brief Get information about the physical translation for a given virtual address.
      * 
@@ -38,9 +118,75 @@ public:
      */
     auto get_translation(uint64_t virtual_address) -> PageTranslation;
 
+    /**
+     * @brief Get the number of frames used by the tables of every page tree (other than their
+     * roots), which are freed as soon as unmapping leaves them empty.
+     */
+    static auto stats() -> PageTableStats;
+
 private:
+    /**
+     * @brief Implementation of map_range for the entries of a node at the given depth that
+     * intersect [first, last], mapping `first` to `physical_base`. Tables are only walked once
+     * for the whole range, and page tables are filled a run of entries at a time.
+     *
+     * @return the number of present pages that were replaced
+     */
+    auto map_entries(PageTreeNode *node, int depth, uint64_t first, uint64_t last, uint64_t physical_base, PageFlags flags, bool invalidate_pages) -> size_t;
+
+    /**
+     * @brief Get the table pointed to by an entry of the node at the given depth, creating it if
+     * the entry is empty and splitting the large page it maps if there is one.
+     */
+    auto get_or_create_child(PageTreeNode *node, int index, int depth, PageFlags flags) -> PageTreeNode *;
+
+    /**
+     * @brief Replace the large page mapped by an entry of the node at the given depth with a
+     * table of smaller pages mapping the same memory with the same flags.
+     */
+    void split_large_page(PageTreeNode *node, int index, int depth);
+
+    /**
+     * @brief First pass of unmap_range over the entries of a node at the given depth that
+     * intersect [first, last]: clear the present bit of the pages (keeping their addresses), and
+     * detach the tables that are left without present entries the same way.
+     *
+     * @return the number of pages that were cleared
+     */
+    auto clear_range(PageTreeNode *node, int depth, uint64_t first, uint64_t last, bool invalidate_pages) -> size_t;
+
+    /**
+     * @brief Second pass of unmap_range, once the TLB is invalidated: release the pages and
+     * tables cleared by clear_range, and zero their entries.
+     */
+    void release_range(PageTreeNode *node, int depth, uint64_t first, uint64_t last, UnmappedPageVisitor on_unmapped);
+
+    /**
+     * @brief Implementation of protect_range for the entries of a node at the given depth that
+     * intersect [first, last].
+     */
+    auto protect(PageTreeNode *node, int depth, uint64_t first, uint64_t last, PageFlags flags, bool invalidate_pages) -> size_t;
+
+    /**
+     * @brief Implementation of share_copy_on_write for the entries of the `source` and
+     * `destination` nodes at the given depth that intersect [first, last].
+     *
+     * @return the number of pages of `source` that lost their write permission
+     */
+    auto share_entries(PageTreeNode *source, PageTreeNode *destination, int depth, uint64_t first, uint64_t last, bool invalidate_pages, size_t &num_shared) -> size_t;
+
+    /**
+     * @brief Free the frame of a table at the given depth and the frames of all of the tables
+     * below it (but not the frames they map).
+     */
+    void free_table(uintptr_t table, int depth);
+
     PageTreeNode *root_ = nullptr;
+    // the shallowest depth at which entries can map a page instead of a table
+    int largest_page_depth_ = 2;
+    // the upper-half tables are shared with other trees, so they must stay in the root
+    bool upper_half_shared_ = false;
 
 };
 
-#endif
\ No newline at end of file
+#endif
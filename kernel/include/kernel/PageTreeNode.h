@@ -45,8 +45,32 @@ public:
      */
     auto get_child_flags(int index) -> PageFlags;
 
+    /**
+     * @brief Get the raw value of a specific entry (address and all flags)
+     *
+     * @param index 0-511: the index of the child
+     */
+    auto get_entry(int index) -> uint64_t;
+
+    /**
+     * @brief Set the raw value of a specific entry (address and all flags)
+     *
+     * @param index 0-511: the index of the child
+     */
+    void set_entry(int index, uint64_t entry);
+
+    // bits 12 to 51 of an entry hold the physical address of the child
+    static constexpr uint64_t address_mask = 0x000f'ffff'ffff'f000;
+
+    // bits 0 to 11 and 63 of an entry hold the flags read and written by the *_child_flags
+    // functions
+    static constexpr uint64_t flags_mask = 0x8000'0000'0000'0fff;
+
+    static constexpr int num_entries = 512;
+
 private:
-    uint64_t entries_[512] = {};
+
+    uint64_t entries_[num_entries] = {};
 };
 
 #endif
@@ -28,22 +28,20 @@ struct RootSDT {
     /**
      * @brief Find a system descriptor table with a given 4-byte signature.
      *
-     * The address returned is the physical address of the table.
+     * The address returned is the physical address of the table. The tables are read through the
+     * HHDM, so this doesn't rely on physical memory being identity-mapped.
      */
     template<SystemDescriptorTable SDT>
     SDT* findSDTWithSignature(const char* signature, int acpiRevisionNumber) const
     {
         const auto numTables = numPointersToOtherSDTs(acpiRevisionNumber);
         for (std::size_t i = 0; i < numTables; ++i) {
-            if (bytesPerPointer(acpiRevisionNumber) == 4) {
-                auto sdt = reinterpret_cast<SDT*>(reinterpret_cast<const uint32_t*>(&pointersToOtherSDTs)[i]);
-                if (!kpp::strncmp(sdt->header.signature, signature, 4))
-                    return sdt;
-            } else {
-                auto sdt = reinterpret_cast<SDT*>(reinterpret_cast<const uint64_t*>(&pointersToOtherSDTs)[i]);
-                if (!kpp::strncmp(sdt->header.signature, signature, 4))
-                    return sdt;
-            }
+            const auto physicalSdt = bytesPerPointer(acpiRevisionNumber) == 4
+                ? uintptr_t {reinterpret_cast<const uint32_t*>(&pointersToOtherSDTs)[i]}
+                : uintptr_t {reinterpret_cast<const uint64_t*>(&pointersToOtherSDTs)[i]};
+            auto sdt = reinterpret_cast<SDT*>(kernel_physical_to_virtual(physicalSdt));
+            if (!kpp::strncmp(sdt->header.signature, signature, 4))
+                return reinterpret_cast<SDT*>(physicalSdt);
         }
         return nullptr;
     }
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <kernel/ACPISDTHeader.h>
+
+/**
+ * @brief The System Resource Affinity Table (SRAT) is a table in the ACPI specification that
+ *       associates processors and memory ranges with proximity domains (NUMA nodes).
+ */
+struct SRAT {
+    ACPISDTHeader header;
+    uint32_t reserved1;
+    uint64_t reserved2;
+    void* affinityStructures;
+} __attribute__((packed));
+
+/**
+ * @brief Associates a processor (by local APIC ID) with a proximity domain. Follows the
+ *       2-byte type and length header of a static resource affinity structure.
+ */
+struct SRATProcessorAffinity {
+    uint8_t proximityDomainLow;
+    uint8_t apicId;
+    uint32_t flags;
+    uint8_t localSapicEid;
+    uint8_t proximityDomainHigh[3];
+    uint32_t clockDomain;
+
+    uint32_t proximityDomain() const
+    {
+        return proximityDomainLow
+            | (proximityDomainHigh[0] << 8)
+            | (proximityDomainHigh[1] << 16)
+            | (proximityDomainHigh[2] << 24);
+    }
+} __attribute__((packed));
+
+/**
+ * @brief Associates a range of physical memory with a proximity domain. Follows the 2-byte type
+ *       and length header of a static resource affinity structure.
+ */
+struct SRATMemoryAffinity {
+    uint32_t proximityDomain;
+    uint16_t reserved1;
+    uint32_t baseAddressLow;
+    uint32_t baseAddressHigh;
+    uint32_t lengthLow;
+    uint32_t lengthHigh;
+    uint32_t reserved2;
+    uint32_t flags;
+    uint64_t reserved3;
+
+    uint64_t baseAddress() const { return (static_cast<uint64_t>(baseAddressHigh) << 32) | baseAddressLow; }
+    uint64_t length() const { return (static_cast<uint64_t>(lengthHigh) << 32) | lengthLow; }
+} __attribute__((packed));
+
+/**
+ * @brief Associates a processor (by x2APIC ID) with a proximity domain. Follows the 2-byte type
+ *       and length header of a static resource affinity structure.
+ */
+struct SRATX2APICAffinity {
+    uint16_t reserved1;
+    uint32_t proximityDomain;
+    uint32_t x2apicId;
+    uint32_t flags;
+    uint32_t clockDomain;
+    uint32_t reserved2;
+} __attribute__((packed));
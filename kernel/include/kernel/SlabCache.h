@@ -0,0 +1,220 @@
+#ifndef DAVOS_KERNEL_SLAB_CACHE_H_INCLUDED
+#define DAVOS_KERNEL_SLAB_CACHE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#include <kernel/SpinLock.h>
+
+/**
+ * @brief Slab cache counters.
+ */
+struct SlabCacheStats
+{
+    size_t slabs = 0;           // slabs currently allocated, including empty ones
+    size_t empty_slabs = 0;     // slabs without any object in use
+    size_t objects = 0;         // objects in all slabs, in use or not
+    size_t objects_in_use = 0;  // objects handed out and not yet freed
+    uint64_t allocations = 0;   // calls to allocate that returned an object
+    uint64_t frees = 0;         // calls to deallocate
+};
+
+/**
+ * @brief A cache of objects of one size, carved out of slabs of contiguous frames (see Bonwick,
+ * "The Slab Allocator: An Object-Caching Kernel Memory Allocator").
+ *
+ * A slab is a block of 2^order frames, reached through the HHDM and aligned to its size, that
+ * starts with a header followed by as many objects as fit. The free objects of a slab are linked
+ * through a word of each object, so allocating and freeing are a few pointer operations. Slabs are
+ * kept on partial, full and empty lists. Every frame of a slab is marked with FrameFlags::Slab in
+ * its metadata, so that the cache of any object can be found without a header. Empty slabs are kept
+ * (with their objects still constructed) until reap is called, so that a cache whose usage goes up
+ * and down doesn't keep freeing and allocating frames.
+ *
+ * Objects are constructed once, when their slab is created, and destroyed when the slab is
+ * freed: an object must be given back in its constructed state, and comes out of allocate the
+ * way it was freed. With a constructor, the free-list link is stored after the object rather
+ * than in it, so that it doesn't clobber the constructed state.
+ */
+class SlabCache
+{
+public:
+    using ObjectFunction = void (*)(void *object);
+
+    /**
+     * @brief Slabs are at most 2^max_slab_order frames.
+     */
+    static constexpr uint8_t max_slab_order = 3;
+
+    /**
+     * @brief The order of a slab is the smallest that holds at least this many objects (up to
+     * max_slab_order).
+     */
+    static constexpr size_t min_objects_per_slab = 8;
+
+    /**
+     * @param name identifies the cache in statistics and panics
+     * @param object_size size in bytes of an object
+     * @param alignment power of two, at most the frame size: the alignment of every object
+     * @param constructor called on every object when its slab is created (may be nullptr)
+     * @param destructor called on every object when its slab is freed (may be nullptr)
+     */
+    SlabCache(const char *name, size_t object_size, size_t alignment = alignof(void *),
+        ObjectFunction constructor = nullptr, ObjectFunction destructor = nullptr);
+
+    /**
+     * @brief Free every slab. No object may still be in use.
+     */
+    ~SlabCache();
+
+    SlabCache(const SlabCache &) = delete;
+    SlabCache &operator=(const SlabCache &) = delete;
+
+    /**
+     * @brief Allocate an object, creating a slab if every slab is full.
+     *
+     * @return the object, or nullptr if there isn't enough memory for a new slab
+     */
+    auto allocate() -> void *;
+
+    /**
+     * @brief Give back an object allocated from this cache.
+     */
+    auto deallocate(void *object) -> void;
+
+    /**
+     * @brief Allocate up to `count` objects at once, taking the cache's lock only once.
+     *
+     * @return the number of objects stored in `objects`, less than `count` only if there isn't
+     * enough memory for a new slab
+     */
+    auto allocate_batch(void **objects, size_t count) -> size_t;
+
+    /**
+     * @brief Give back `count` objects allocated from this cache at once, taking the cache's lock
+     * only once.
+     */
+    auto deallocate_batch(void *const *objects, size_t count) -> void;
+
+    /**
+     * @brief Free every empty slab.
+     *
+     * @return the number of slabs that were freed
+     */
+    auto reap() -> size_t;
+
+    auto stats() -> SlabCacheStats;
+
+    /**
+     * @brief Get the cache an object was allocated from.
+     *
+     * @param object a pointer into memory reached through the HHDM
+     * @return the cache, or nullptr if the object isn't in a slab
+     */
+    static auto cache_of(const void *object) -> SlabCache *;
+
+    auto name() const -> const char * { return name_; }
+
+    auto object_size() const -> size_t { return object_size_; }
+
+    /**
+     * @brief Log2 of the number of frames of a slab.
+     */
+    auto slab_order() const -> uint8_t { return slab_order_; }
+
+    /**
+     * @brief Number of objects in a slab.
+     */
+    auto objects_per_slab() const -> size_t { return objects_per_slab_; }
+
+private:
+    struct FreeObject
+    {
+        FreeObject *next;
+    };
+
+    struct Slab
+    {
+        Slab *next = nullptr;
+        Slab *prev = nullptr;
+        SlabCache *cache = nullptr;
+        FreeObject *free_objects = nullptr;
+        size_t objects_in_use = 0;
+    };
+
+    /**
+     * @brief A doubly-linked list of slabs.
+     */
+    struct SlabList
+    {
+        Slab *head = nullptr;
+        size_t length = 0;
+
+        auto push(Slab *slab) -> void;
+        auto remove(Slab *slab) -> void;
+    };
+
+    auto allocate_locked() -> void *;
+    auto deallocate_locked(void *object) -> void;
+    auto create_slab() -> Slab *;
+    auto free_slab(Slab *slab) -> void;
+    auto slab_of(void *object) const -> Slab *;
+    auto link_of(void *object) const -> FreeObject *;
+    auto object_of(FreeObject *link) const -> void *;
+
+    const char *name_ = nullptr;
+    size_t object_size_ = 0;
+    // distance between consecutive objects of a slab
+    size_t object_stride_ = 0;
+    // offset of the free-list link in an object's slot
+    size_t link_offset_ = 0;
+    // offset of the first object in a slab
+    size_t first_object_offset_ = 0;
+    size_t objects_per_slab_ = 0;
+    uint8_t slab_order_ = 0;
+    ObjectFunction constructor_ = nullptr;
+    ObjectFunction destructor_ = nullptr;
+
+    SpinLock lock_;
+    SlabList partial_slabs_;
+    SlabList full_slabs_;
+    SlabList empty_slabs_;
+    size_t objects_in_use_ = 0;
+    uint64_t allocations_ = 0;
+    uint64_t frees_ = 0;
+};
+
+/**
+ * @brief A slab cache of objects of type T, which are default-constructed once when their slab is
+ * created. Trivial types are neither constructed nor destroyed, and have their free-list link
+ * stored in the object.
+ */
+template <typename T>
+class ObjectCache
+{
+public:
+    explicit ObjectCache(const char *name)
+        : cache_ {name, sizeof(T), alignof(T), is_trivial ? nullptr : construct, is_trivial ? nullptr : destroy}
+    {
+    }
+
+    auto allocate() -> T * { return static_cast<T *>(cache_.allocate()); }
+
+    auto deallocate(T *object) -> void { cache_.deallocate(object); }
+
+    auto cache() -> SlabCache & { return cache_; }
+
+private:
+    static constexpr bool is_trivial = std::is_trivially_default_constructible_v<T>
+        && std::is_trivially_destructible_v<T>;
+
+    static void construct(void *object) { new(object) T; }
+
+    static void destroy(void *object) { static_cast<T *>(object)->~T(); }
+
+    SlabCache cache_;
+};
+
+#endif
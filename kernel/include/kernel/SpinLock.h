@@ -0,0 +1,63 @@
+#ifndef DAVOS_KERNEL_SPIN_LOCK_H_INCLUDED
+#define DAVOS_KERNEL_SPIN_LOCK_H_INCLUDED
+
+#include <atomic>
+
+#include <kernel/processor.hpp>
+#include <kernel/smp.h>
+
+/**
+ * @brief A test-and-test-and-set lock for data shared between processors.
+ */
+class SpinLock
+{
+public:
+    void lock() noexcept
+    {
+        while (locked_.exchange(true, std::memory_order_acquire)) {
+            // spin on a plain load so that waiting processors don't keep stealing the cache line;
+            // the holder may be waiting for this processor to invalidate its TLB meanwhile
+            while (locked_.load(std::memory_order_relaxed)) {
+                smp_handle_tlb_shootdown();
+                asm volatile("pause");
+            }
+        }
+    }
+
+    void unlock() noexcept
+    {
+        locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked_ {false};
+};
+
+/**
+ * @brief Holds a spin lock with interrupts disabled for the lifetime of the guard, so that an
+ * interrupt handler on the same processor can never spin on a lock its own processor holds.
+ */
+class SpinLockGuard
+{
+public:
+    explicit SpinLockGuard(SpinLock &lock) noexcept
+        : lock_ {lock}
+    {
+        lock_.lock();
+    }
+
+    ~SpinLockGuard()
+    {
+        lock_.unlock();
+    }
+
+    SpinLockGuard(const SpinLockGuard &) = delete;
+    SpinLockGuard &operator=(const SpinLockGuard &) = delete;
+
+private:
+    // declared first so that interrupts are disabled before the lock is taken
+    processor::InterruptGuard interrupt_guard_ {};
+    SpinLock &lock_;
+};
+
+#endif
@@ -1,51 +1,145 @@
-#ifndef DAVOS_KERNEL_BUDDY_ALLOCATOR_H_INCLUDED
-#define DAVOS_KERNEL_BUDDY_ALLOCATOR_H_INCLUDED
+#ifndef DAVOS_KERNEL_VIRTUAL_MEMORY_ALLOCATOR_H_INCLUDED
+#define DAVOS_KERNEL_VIRTUAL_MEMORY_ALLOCATOR_H_INCLUDED
 
-#include <stdint.h>
+#include <cstddef>
+#include <cstdint>
 
+#include <kpp/array.hpp>
+
+/**
+ * @brief A binary buddy allocator for a range of virtual address space.
+ *
+ * Address space is handed out in blocks of 2^order pages, aligned to their size. The allocator
+ * never touches the memory it manages (which would back it with frames): the free lists are
+ * threaded through an array of BlockInfo with one entry per page, in which only the entry of the
+ * first page of a block is meaningful. Placing that array in lazily-backed memory keeps its cost
+ * proportional to the part of the range that is actually used, since untouched entries read as 0.
+ *
+ * Blocks of the largest order are only carved out of the range when the free lists run dry, so
+ * that a range of terabytes isn't split into free blocks up front.
+ */
 class VirtualMemoryAllocator
 {
 public:
     /**
-     * @brief Construct a new Buddy Allocator with available memory space
-     * starting at the given address and with the given size.
-     * 
-     * @param start_address 
-     * @param size 
+     * @brief The largest block is 2^max_order pages (1 GiB).
+     */
+    static constexpr uint8_t max_order = 18;
+    static constexpr uint8_t num_orders = max_order + 1;
+
+    enum class BlockState : uint8_t
+    {
+        None = 0,  // not the first page of a free or allocated block
+        Free,
+        Allocated,
+    };
+
+    struct BlockInfo
+    {
+        // indices of the neighbouring free blocks of the same order, or no_block; an allocated
+        // block of the largest order keeps the number of such blocks allocated with it in `next`
+        uint32_t next;
+        uint32_t prev;
+        uint8_t order;
+        BlockState state;
+    };
+
+    /**
+     * @brief At most this many pages of a range are managed, so that pages can be indexed with
+     * 32 bits (16 TiB).
+     */
+    static constexpr uint64_t max_pages = UINT32_MAX - 1;
+
+    /**
+     * @brief Get the number of bytes of BlockInfo needed to manage a range of the given size.
+     */
+    static auto metadata_size(uint64_t size) -> uint64_t;
+
+    /**
+     * @brief Construct an allocator for the pages in the range starting at the given address and
+     * with the given size.
+     *
+     * @param block_infos zero-initialized array of metadata_size(size) bytes
      */
-    VirtualMemoryAllocator(void *start_address, uint64_t size);
+    VirtualMemoryAllocator(void *start_address, uint64_t size, BlockInfo *block_infos);
 
     /**
-     * @brief Allocate a contiguous block of memory at least as big as the given size.
-     * 
-     * @param size 
-     * @return void* 
+     * @brief Allocate a block of address space at least as big as the given size, aligned to its
+     * size (a power of two number of pages).
+     *
+     * Sizes above the largest order get a run of contiguous blocks of the largest order instead,
+     * carved out of the part of the range that was never split, or made of free blocks of the
+     * largest order that lie next to each other.
+     *
+     * @return the base address of the block, or nullptr if no block is large enough
      */
     auto allocate(uint64_t size) -> void *;
 
     /**
-     * @brief Deallocate a block of memory. 
-     * 
-     * @param ptr 
+     * @brief Deallocate a block returned by allocate, coalescing it with its buddy as long as the
+     * buddy is also free.
      */
     auto deallocate(void *ptr) -> void;
 
+    /**
+     * @brief Get the size of the block (or run of blocks) allocated at the given address.
+     */
+    auto allocation_size(void *ptr) const -> uint64_t;
+
+    /**
+     * @brief Check if an address is in the range managed by the allocator.
+     */
+    auto contains(void *ptr) const -> bool;
+
+    /**
+     * @brief Check if an address is inside a block (or run of blocks) that is allocated.
+     */
+    auto is_allocated(void *ptr) const -> bool;
+
+    /**
+     * @brief Number of pages that aren't allocated.
+     */
+    auto free_pages() const -> uint64_t { return free_pages_; }
+
 private:
-    struct FreeBlock
-    {
-        FreeBlock *next = nullptr;
-        void *address = nullptr;
-        uint8_t order = 0;
-    };
+    static constexpr uint32_t no_block = UINT32_MAX;
 
-    struct FreeBlockList 
-    {
-        FreeBlock *head = nullptr;
-        uint64_t *used_bitmap = nullptr;
-    };
+    auto address(uint32_t block) const -> uintptr_t;
+    auto allocated_block(void *ptr) const -> uint32_t;
+    auto push(uint32_t block, uint8_t order) -> void;
+    auto remove(uint32_t block, uint8_t order) -> void;
+
+    /**
+     * @brief Allocate `num_blocks` contiguous blocks of the largest order from the unclaimed pages.
+     */
+    auto allocate_run(uint64_t num_blocks) -> void *;
+
+    /**
+     * @brief Check if the `num_blocks` blocks of the largest order starting at the given page are
+     * all free, either in the free lists or unclaimed.
+     */
+    auto is_free_run(uint64_t block, uint64_t num_blocks) const -> bool;
+
+    /**
+     * @brief Free the blocks of the largest order in the pages [block, block + pages). They join
+     * the unclaimed pages if they border them, and the free lists otherwise.
+     */
+    auto deallocate_run(uint64_t block, uint64_t pages) -> void;
+
+    /**
+     * @brief Add the pages [first, end) to the free lists, as the largest aligned blocks that fit.
+     */
+    auto deallocate_range(uint64_t first, uint64_t end) -> void;
 
-    constexpr static uint8_t max_order = 11;
-    FreeBlockList free_block_lists[max_order] = {};
+    uintptr_t begin_ = 0;
+    uint64_t num_pages_ = 0;
+    // pages [unclaimed_first_, unclaimed_first_ + unclaimed_pages_) are free but not yet in the
+    // free lists, and are claimed a block of the largest order at a time
+    uint64_t unclaimed_first_ = 0;
+    uint64_t unclaimed_pages_ = 0;
+    uint64_t free_pages_ = 0;
+    kpp::Array<uint32_t, num_orders> free_lists_ {};
+    BlockInfo *block_infos_ = nullptr;
 };
 
-#endif
\ No newline at end of file
+#endif
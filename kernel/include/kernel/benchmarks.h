@@ -0,0 +1,37 @@
+#ifndef DAVOS_KERNEL_BENCHMARKS_H_INCLUDED
+#define DAVOS_KERNEL_BENCHMARKS_H_INCLUDED
+
+void run_all_benchmarks();
+
+/**
+ * @brief Run the same workloads with the buddy and bitmap frame allocators on a block of free
+ * memory, and print the average number of cycles per operation of each.
+ */
+void benchmark_frame_allocators();
+
+/**
+ * @brief Run the same workloads with the free list and buddy virtual memory allocators on a
+ * block of memory, and print the average number of cycles per operation of each.
+ */
+void benchmark_virtual_allocators();
+
+/**
+ * @brief Allocate and free small objects with the free list allocator and with a slab cache, and
+ * print the average number of cycles per operation of each.
+ */
+void benchmark_slab_cache();
+
+/**
+ * @brief Allocate and free small objects on 1, 2, 4, ... processors at once, both from a single
+ * slab cache and with kmalloc (whose processor caches should keep the cost per processor flat),
+ * and print the cycles per allocation and free of each.
+ */
+void benchmark_kmalloc_scaling();
+
+/**
+ * @brief Map and unmap 1 GiB of memory in a scratch page tree, one page at a time and as a
+ * range (with 4 KiB and large pages), and print the throughput of each in pages per second.
+ */
+void benchmark_page_mapping();
+
+#endif
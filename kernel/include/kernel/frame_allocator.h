@@ -1,23 +1,123 @@
 #ifndef DAVOS_KERNEL_FRAME_ALLOCATOR_H_INCLUDED
 #define DAVOS_KERNEL_FRAME_ALLOCATOR_H_INCLUDED
 
+#include <cstddef>
 #include <cstdint>
 
+#include <kpp/array.hpp>
+
+#include <kernel/FrameInfo.h>
+
 struct PhysicalFrame;
 
+/**
+ * @brief Ranges of physical memory that can be requested separately, for devices that can only
+ * address part of physical memory.
+ */
+enum class MemoryZone : uint8_t
+{
+    DMA,    // below 16 MiB (ISA DMA)
+    DMA32,  // below 4 GiB (devices with 32-bit addressing, e.g. IOAPIC-era hardware)
+    Normal, // all other memory
+};
+
+constexpr uint8_t num_memory_zones = 3;
+
+/**
+ * @brief The largest block that can be allocated is 2^max_frame_order frames (1 GiB).
+ */
+constexpr uint8_t max_frame_order = 18;
+
+/**
+ * @brief What a reserved range of physical memory is used for.
+ */
+enum class ReservationType : uint8_t
+{
+    Firmware,        // reserved or bad memory reported by the memory map
+    AcpiReclaimable, // ACPI tables: reclaimable once they have been parsed
+    AcpiNvs,         // ACPI non-volatile storage
+    Framebuffer,
+    Mmio,            // memory-mapped device registers
+    Bootloader,      // bootloader data: reclaimable once the kernel's page tables are loaded
+    Kernel,          // the kernel image and modules
+    FrameMetadata,   // the frame allocator's own metadata
+};
+
+/**
+ * @brief A range of physical memory [begin, end) that the frame allocator never hands out.
+ */
+struct ReservedRange
+{
+    uintptr_t begin;
+    uintptr_t end;
+    ReservationType type;
+};
+
 auto frame_allocator_init() -> void;
 
 /**
  * @brief Get a new physical frame. Returns the physical address of the new frame.
+ * The frame starts with a reference count of 1. Panics if there is no free frame left.
  */
 auto allocate_frame() -> void *;
 
 /**
- * @brief Frees a previously allocated physical frame. Do not deallocate the same frame twice
- * (the function does not check for this).
+ * @brief Like allocate_frame, but returns nullptr if there is no free frame left.
+ */
+auto try_allocate_frame() -> void *;
+
+/**
+ * @brief Get a new physical frame filled with zeros. Returns the physical address of the frame.
+ * Frames are taken from a pool that is zeroed ahead of time when the kernel is idle, and are
+ * only zeroed on the spot if the pool is empty. Free the frame with deallocate_frame.
+ * Panics if there is no free frame left.
+ */
+auto allocate_zeroed_frame() -> void *;
+
+/**
+ * @brief Like allocate_zeroed_frame, but returns nullptr if there is no free frame left.
+ */
+auto try_allocate_zeroed_frame() -> void *;
+
+/**
+ * @brief Zero up to `max_frames` free frames and add them to the zeroed frame pool, stopping
+ * early if the pool is full or free memory is low. Meant to be called when the kernel is idle.
+ *
+ * @return the number of frames that were zeroed
+ */
+auto refill_zeroed_frames(std::size_t max_frames) -> std::size_t;
+
+/**
+ * @brief Get the number of frames in the zeroed frame pool.
+ */
+auto available_zeroed_frames() -> std::size_t;
+
+/**
+ * @brief Frees a previously allocated physical frame, regardless of its reference count.
+ * Panics if the frame is already free. Frames that may be shared should be released with
+ * update_frame_ref_count instead.
  */
 auto deallocate_frame(void *frame_to_deallocate) -> void;
 
+/**
+ * @brief Get a block of 2^order physically contiguous frames, aligned to the size of the block.
+ * Returns the physical address of the first frame, or nullptr if no free block is large enough.
+ * The reference count of the block is kept in the metadata of its first frame, starting at 1.
+ *
+ * Memory on the current processor's NUMA node is preferred over memory on other nodes.
+ *
+ * @param order 0-18: the log2 of the number of frames in the block
+ * @param highest_zone the highest zone the block may come from, e.g. MemoryZone::DMA32 for a
+ * block entirely below 4 GiB
+ */
+auto allocate_frames(uint8_t order, MemoryZone highest_zone = MemoryZone::Normal) -> void *;
+
+/**
+ * @brief Frees a block previously allocated with allocate_frames. The order must be the same
+ * as the one used to allocate the block.
+ */
+auto deallocate_frames(void *block, uint8_t order) -> void;
+
 // TODO: these functions don't belong here
 /**
  * @brief Get a pointer pointing to the corresponding virtual address of a kernel physical address.
@@ -32,10 +132,42 @@ auto kernel_physical_to_virtual(uintptr_t physical_address) -> uintptr_t;
 /**
  * @brief Reclaim bootloader-reclaimable memory allocated by Limine.
  * (This is safe to do once we've set up our own page tables, since Limine
- * uses bootloader-reclaimable memory for the Limine page tables.
+ * uses bootloader-reclaimable memory for the Limine page tables, and once the application
+ * processors have left the stacks and page tables Limine started them on.)
  */
 auto free_limine_bootloader_memory() -> void;
 
+/**
+ * @brief Record a range of physical memory that isn't part of usable memory (e.g. MMIO
+ * registers), so that it is never handed out, even if an overlapping range is released.
+ * Panics if the range overlaps usable memory.
+ */
+auto reserve_frames(uintptr_t begin, uintptr_t end, ReservationType type) -> void;
+
+/**
+ * @brief Give every reserved range of the given type to the allocator, except for the parts
+ * that overlap ranges that are still reserved. Only AcpiReclaimable and Bootloader memory
+ * can be released.
+ *
+ * @return the number of frames in the released ranges
+ */
+auto release_reserved_frames(ReservationType type) -> std::size_t;
+
+/**
+ * @brief Check if the frame at the given physical address is in a reserved range.
+ */
+auto is_frame_reserved(uintptr_t frame) -> bool;
+
+/**
+ * @brief Get the number of ranges in the reserved range registry.
+ */
+auto reserved_range_count() -> std::size_t;
+
+/**
+ * @brief Get the reserved range at the given index (0 to reserved_range_count() - 1).
+ */
+auto reserved_range(std::size_t index) -> ReservedRange;
+
 /**
  * @brief Print the base, limit, and mapping type of each of the initial Limine memory map
  */
@@ -44,8 +176,157 @@ auto print_memory_map() -> void;
 auto available_frames() -> std::size_t;
 
 /**
- * @brief Update the ref count for the given frame by change.
+ * @brief Get the number of free frames in the given zone of the given NUMA node, not counting
+ * frames cached by processors.
+ */
+auto available_zone_frames(uint8_t node, MemoryZone zone) -> std::size_t;
+
+/**
+ * @brief Get the zone containing the frame at the given physical address.
+ */
+auto frame_zone(uintptr_t frame) -> MemoryZone;
+
+/**
+ * @brief Get the number of free blocks of exactly 2^order contiguous frames.
+ */
+auto available_blocks(uint8_t order) -> std::size_t;
+
+/**
+ * @brief Number of buckets in the allocation latency histograms.
+ */
+constexpr std::size_t allocation_latency_buckets = 16;
+
+/**
+ * @brief Get the (exclusive) upper bound in time-stamp counter cycles of the allocations counted
+ * in the given latency histogram bucket. Each bucket covers twice the range of the previous one,
+ * and the last bucket also counts every slower allocation.
+ */
+constexpr auto allocation_latency_bucket_bound(std::size_t bucket) -> uint64_t
+{
+    return uint64_t {32} << bucket;
+}
+
+/**
+ * @brief A histogram of allocation latencies, in time-stamp counter cycles.
+ */
+using AllocationLatencyHistogram = kpp::Array<uint64_t, allocation_latency_buckets>;
+
+/**
+ * @brief Counters for a processor's cache of free frames, for tuning the cache size.
+ */
+struct FrameCacheStats
+{
+    uint64_t allocations = 0; // single-frame allocations on this processor
+    uint64_t frees = 0;       // single-frame frees on this processor
+    uint64_t refills = 0;     // batches moved from the global allocator into the cache
+    uint64_t drains = 0;      // batches moved from the cache back to the global allocator
+    std::size_t cached_frames = 0;
+    // latencies of the allocations (of any order) made on this processor
+    AllocationLatencyHistogram allocation_latency {};
+};
+
+/**
+ * @brief Get the frame cache counters of the processor with the given index.
+ */
+auto frame_cache_stats(uint32_t cpu_index) -> FrameCacheStats;
+
+/**
+ * @brief Return all frames cached by the current processor to the global allocator, so that
+ * they can be coalesced into larger blocks.
+ */
+auto drain_frame_cache() -> void;
+
+/**
+ * @brief Copies the contents of `old_frame`, mapped at `virtual_page`, to `new_frame` and points
+ * the mapping at `new_frame` instead. Returns false if the page can't be migrated.
+ */
+using FrameMigrationHandler = bool (*)(uintptr_t virtual_page, uintptr_t old_frame, uintptr_t new_frame);
+
+/**
+ * @brief Set the function used to migrate movable frames during compaction.
+ */
+auto set_frame_migration_handler(FrameMigrationHandler handler) -> void;
+
+/**
+ * @brief Mark an allocated frame as movable: it is only referenced through the mapping at
+ * `virtual_page`, so compaction may move it elsewhere and remap the page.
+ */
+auto set_frame_movable(uintptr_t frame, uintptr_t virtual_page) -> void;
+
+/**
+ * @brief Try to create a free block of 2^order contiguous frames in a zone no higher than
+ * `highest_zone` by migrating movable frames. Called automatically when a multi-frame
+ * allocation fails.
+ *
+ * Compaction assumes the frames it migrates aren't concurrently accessed through their mapping
+ * or freed by other processors.
+ *
+ * @return whether a free block of the requested order is now available
+ */
+auto compact_frames(uint8_t order, MemoryZone highest_zone = MemoryZone::Normal) -> bool;
+
+/**
+ * @brief Get the external fragmentation index for allocations of 2^order frames, in thousandths.
+ *
+ * Returns -1000 if a free block of that order is available. Otherwise, values near 0 mean an
+ * allocation would fail for lack of free memory, and values near 1000 mean it would fail
+ * because the free memory is fragmented into small blocks.
+ */
+auto fragmentation_index(uint8_t order) -> int;
+
+/**
+ * @brief Counters for compaction, for tuning when it is triggered.
+ */
+struct CompactionStats
+{
+    uint64_t runs = 0;              // calls to compact_frames
+    uint64_t successes = 0;         // runs that made a free block of the requested order available
+    uint64_t migrated_frames = 0;   // movable frames copied to a new frame
+    uint64_t failed_migrations = 0; // movable frames the migration handler refused to move
+};
+
+auto compaction_stats() -> CompactionStats;
+
+/**
+ * @brief A snapshot of the frame allocator's counters, for spotting leaks and fragmentation.
+ *
+ * Rates can be computed by taking two snapshots and dividing the difference of a counter by the
+ * difference of `uptime_cycles` (see processor::timestampCounterFrequency).
+ */
+struct FrameAllocatorStats
+{
+    uint64_t uptime_cycles = 0;        // time-stamp counter cycles since the allocator was initialized
+    std::size_t managed_frames = 0;    // frames given to the allocator so far, free or not
+    std::size_t free_frames = 0;       // same as available_frames()
+    std::size_t used_frames = 0;       // frames in allocated blocks, not counting the zeroed frame pool
+    std::size_t peak_used_frames = 0;  // highest value of used_frames so far
+    uint64_t allocations = 0;          // blocks of any order handed out
+    uint64_t frees = 0;                // blocks of any order returned
+    uint64_t failed_allocations = 0;   // allocate_frames calls that returned nullptr
+    uint64_t cache_hits = 0;           // single-frame allocations served by a processor's cache
+    uint64_t cache_misses = 0;         // single-frame allocations that had to refill the cache
+    kpp::Array<std::size_t, max_frame_order + 1> free_blocks {}; // free blocks of each order
+    AllocationLatencyHistogram allocation_latency {};           // summed over all processors
+};
+
+auto frame_allocator_stats() -> FrameAllocatorStats;
+
+/**
+ * @brief Get the metadata of the frame at the given physical address.
+ */
+auto frame_info(uintptr_t frame) -> FrameInfo &;
+
+/**
+ * @brief Get the number of references to the frame (or block) at the given physical address.
+ */
+auto frame_ref_count(uintptr_t frame) -> uint32_t;
+
+/**
+ * @brief Atomically update the reference count of the frame (or block) at the given physical
+ * address by `change`, freeing it when the count drops to 0.
+ *
+ * @return the new reference count
  */
-auto update_frame_ref_count(uintptr_t frame, int change) -> void;
+auto update_frame_ref_count(uintptr_t frame, int change) -> uint32_t;
 
 #endif
@@ -11,4 +11,9 @@
  */
 void idt_init();
 
+/**
+ * @brief Load the (already initialized) IDT into the IDTR of the current processor.
+ */
+void idt_load();
+
 #endif
\ No newline at end of file
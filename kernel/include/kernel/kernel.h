@@ -16,6 +16,12 @@ void kernel_init();
 [[ noreturn ]]
 void kernel_panic(const char *fmt, ...);
 
+/**
+ * @brief Do a small, bounded amount of deferred background work (e.g. zeroing free frames).
+ * Called whenever the kernel has nothing better to do.
+ */
+void kernel_idle();
+
 /**
  * @brief Hang the kernel indefinitely.
  */
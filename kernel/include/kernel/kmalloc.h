@@ -0,0 +1,82 @@
+#ifndef DAVOS_KERNEL_KMALLOC_H_INCLUDED
+#define DAVOS_KERNEL_KMALLOC_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Sizes of the smallest and largest size classes. Size classes are powers of two.
+ */
+constexpr size_t kmalloc_min_size = 8;
+constexpr size_t kmalloc_max_small_size = 4096;
+constexpr size_t kmalloc_num_size_classes = 10;
+
+/**
+ * @brief Memory used by kmalloc.
+ */
+struct KmallocStats
+{
+    size_t small_objects = 0;  // objects of the size-class caches in use, not counting cached ones
+    size_t small_bytes = 0;    // bytes of the size classes of those objects
+    size_t cached_objects = 0; // objects held by the per-processor caches
+    uint64_t refills = 0;      // batches moved from the size-class caches to a processor's cache
+    uint64_t drains = 0;       // batches moved back
+    size_t slab_frames = 0;    // frames of the size-class slabs, including empty ones
+    size_t large_blocks = 0;   // blocks of frames in use for allocations above the largest class
+    size_t large_frames = 0;   // frames of those blocks
+};
+
+/**
+ * @brief Create the size-class caches. Must be called after the frame allocator is initialized,
+ * and before anything is allocated with kmalloc or new.
+ */
+auto kmalloc_init() -> void;
+
+/**
+ * @brief Allocate kernel memory reached through the HHDM.
+ *
+ * Sizes up to kmalloc_max_small_size are rounded up to a power of two and served from the slab
+ * cache of that size class, without any per-object header; larger sizes get a block of frames of
+ * their own. Every processor keeps a small stack of free objects of each size class (like the
+ * thread caches of glibc's malloc), which is refilled from and drained to the slab cache in
+ * batches, so that most allocations and frees don't take a lock or touch shared cache lines.
+ *
+ * Objects of 16 bytes or more are aligned to 16 bytes, and blocks of frames to their size.
+ *
+ * @return the memory, or nullptr if there isn't enough
+ */
+auto kmalloc(size_t size) -> void *;
+
+/**
+ * @brief Allocate kernel memory aligned to the given power of two (at most 2^max_frame_order
+ * frames).
+ *
+ * @return the memory, or nullptr if there isn't enough
+ */
+auto kmalloc_aligned(size_t size, size_t alignment) -> void *;
+
+/**
+ * @brief Free memory allocated with kmalloc or kmalloc_aligned. Freeing nullptr does nothing.
+ */
+auto kfree(void *ptr) -> void;
+
+/**
+ * @brief Get the number of bytes usable at memory allocated with kmalloc or kmalloc_aligned.
+ */
+auto kmalloc_usable_size(const void *ptr) -> size_t;
+
+/**
+ * @brief Give the objects cached by the current processor back to the size-class caches.
+ */
+auto kmalloc_drain_cpu_cache() -> void;
+
+/**
+ * @brief Free the empty slabs of every size class, after draining the current processor's cache.
+ *
+ * @return the number of frames that were freed
+ */
+auto kmalloc_reap() -> size_t;
+
+auto kmalloc_stats() -> KmallocStats;
+
+#endif
@@ -16,5 +16,6 @@ extern struct limine_framebuffer_response *framebuffers_info;
 extern struct limine_kernel_address_response *kernel_address;
 extern struct limine_hhdm_response *hhdm_address;
 extern struct limine_rsdp_response *rsdp_address;
+extern struct limine_smp_response *smp_info;
 
 }
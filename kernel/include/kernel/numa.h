@@ -0,0 +1,53 @@
+#ifndef DAVOS_KERNEL_NUMA_H_INCLUDED
+#define DAVOS_KERNEL_NUMA_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The maximum number of NUMA nodes the kernel distinguishes. Proximity domains beyond
+ * this limit are folded into node 0.
+ */
+constexpr uint8_t max_numa_nodes = 4;
+
+/**
+ * @brief A range of physical memory [begin, end) attached to a NUMA node.
+ */
+struct NumaMemoryRange
+{
+    uintptr_t begin;
+    uintptr_t end;
+    uint8_t node;
+};
+
+/**
+ * @brief Discover the NUMA topology from the ACPI System Resource Affinity Table (SRAT).
+ * Without an SRAT, all memory and processors belong to node 0.
+ *
+ * Must be called on the bootstrap processor before the frame allocator is initialized.
+ */
+auto numa_init() -> void;
+
+/**
+ * @brief Get the number of NUMA nodes (at least 1).
+ */
+auto numa_node_count() -> uint8_t;
+
+/**
+ * @brief Get the largest range of memory containing the given physical address that belongs to
+ * a single node. Memory not described by the SRAT belongs to node 0.
+ */
+auto numa_memory_range_containing(uintptr_t physical_address) -> NumaMemoryRange;
+
+/**
+ * @brief Record the node of the processor executing this code, looked up by its APIC ID.
+ * Called once by every processor after its processor-local storage is set up.
+ */
+auto numa_register_current_cpu() -> void;
+
+/**
+ * @brief Get the node of the processor executing this code.
+ */
+auto numa_current_node() -> uint8_t;
+
+#endif
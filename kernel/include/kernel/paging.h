@@ -18,8 +18,11 @@ enum class PageFlags : uint64_t
     Present = 1ULL,
     Write = 1ULL << 1,        // allow writes
     User = 1ULL << 2,         // allow user-mode access
-    WriteThrough = 1ULL << 3, // use write-through caching policy
+    WriteCombining = 1ULL << 3, // buffer writes and burst them to memory (PWT, see processor::initializePageAttributeTable)
     CacheDisable = 1ULL << 4,
+    HugePage = 1ULL << 7,     // (directory entries only) map a 2 MiB or 1 GiB page instead of a table
+    Global = 1ULL << 8,       // (pages only) keep the TLB entry when CR3 is loaded
+    CopyOnWrite = 1ULL << 9,  // (ignored by the processor) copy the frame on the first write
     ExecuteDisable = 1ULL << 63, // disable instruction fetches
 };
 
@@ -28,6 +31,16 @@ inline PageFlags operator|(PageFlags a, PageFlags b)
     return static_cast<PageFlags>(static_cast<uint64_t>(a) | static_cast<uint64_t>(b));
 }
 
+inline PageFlags operator&(PageFlags a, PageFlags b)
+{
+    return static_cast<PageFlags>(static_cast<uint64_t>(a) & static_cast<uint64_t>(b));
+}
+
+inline PageFlags operator~(PageFlags a)
+{
+    return static_cast<PageFlags>(~static_cast<uint64_t>(a));
+}
+
 struct MemoryRegion {
     uintptr_t base {};
     size_t size {};
@@ -39,28 +52,46 @@ struct PageRange {
 };
 
 /**
- * @brief 
- * 
+ * @brief The physical frame and flags of the 4 KiB page containing a virtual address.
  */
 struct PageTranslation {
     uintptr_t physical_address {};
     PageFlags flags {};
+    // size of the page (4 KiB, 2 MiB or 1 GiB) the address is mapped by, or 0 if it isn't mapped
+    size_t page_size {};
 };
 
+/**
+ * @brief Called with the physical address and size of each page removed by an unmap operation,
+ * once the page can no longer be reached through the TLB (so its frame can be reused).
+ */
+using UnmappedPageVisitor = void (*)(uintptr_t frame, size_t page_size);
+
 constexpr uint16_t paging_num_free_memory_regions = 16;
 
 /**
  * @brief Allocate space for the new page table, and re-map essential mappings
- * mapped by Limine. Then free the old page table by reclaiming bootloader reclaimable
- * memory.
+ * mapped by Limine. The old page table is freed later, when bootloader reclaimable memory
+ * is reclaimed (see free_limine_bootloader_memory).
  */
 void paging_init();
 
+/**
+ * @brief Switch an application processor to the kernel's page table, with the same paging
+ * features (global pages, PAT, PCIDs) as the bootstrap processor. Called once by every
+ * application processor after its processor-local storage is set up.
+ */
+auto paging_init_application_processor() -> void;
+
 /**
  * @brief Add a virtual to physical mapping to the tree.
  * Physical base should point to a contiguous region in physical memory of length
  * `length` whose frames have already been allocated.
  *
+ * The region is mapped with 1 GiB and 2 MiB pages wherever the virtual and physical
+ * addresses are both aligned to the page size. Regions in the kernel (upper) half are mapped
+ * with global pages if the processor supports them.
+ *
  * @param virtual_base
  * @param physical_base
  * @param length
@@ -75,9 +106,144 @@ void paging_add_mapping(uintptr_t virtual_base,
  * @brief Allocate (not-necessarily contiguous) physical memory
  * for the specified contiguous virtual address region and map it in the page tree.
  *
- * If the virtual address region is already mapped, it is overwritten.
+ * If the virtual address region is already mapped, it is overwritten. The frames are movable,
+ * and can be released with paging_unmap_range(..., paging_release_unmapped_frames).
+ *
+ * @param zeroed whether the frames must be zeroed
+ * @return false (with nothing mapped) if there weren't enough frames
+ */
+auto paging_allocate_and_map(uintptr_t virtual_base, size_t length, PageFlags flags, bool zeroed = false) -> bool;
+
+/**
+ * @brief An UnmappedPageVisitor that drops the reference of the mapping to every frame of the
+ * page, freeing the frames that aren't referenced anymore.
+ */
+auto paging_release_unmapped_frames(uintptr_t frame, size_t page_size) -> void;
+
+/**
+ * @brief Register a region of the kernel's address space whose pages are backed lazily: each
+ * page is mapped to a new zeroed frame with the given flags the first time it is accessed (see
+ * paging_handle_page_fault), so that reserving a large region costs nothing until it is used.
+ * Regions in the upper half are backed from any address space; regions in the lower half only
+ * while the kernel's address space is active.
+ *
+ * @return false if the region overlaps another lazy region or too many are registered
+ */
+auto paging_add_lazy_region(uintptr_t virtual_base, size_t length, PageFlags flags) -> bool;
+
+/**
+ * @brief Unregister the lazy region starting at the given address. Pages that were already
+ * backed stay mapped.
+ */
+auto paging_remove_lazy_region(uintptr_t virtual_base) -> void;
+
+/**
+ * @brief Called on a fault on a missing upper-half page outside of the lazy regions. Returns
+ * true if the page was backed (with paging_back_lazy_page), false if the fault is an error.
+ */
+using LazyPageHandler = bool (*)(uintptr_t page);
+
+/**
+ * @brief Set the function that decides which upper-half pages outside of the lazy regions are
+ * backed on first access, e.g. the pages of live allocations of a virtual memory allocator.
+ */
+auto paging_set_lazy_page_handler(LazyPageHandler handler) -> void;
+
+/**
+ * @brief Back a missing page of the kernel's address space with a new zeroed frame, as if it was
+ * in a lazy region with the given flags. Does nothing if the page is already mapped.
+ */
+auto paging_back_lazy_page(uintptr_t page, PageFlags flags) -> void;
+
+/**
+ * @brief Bits of the error code pushed by the processor on a page fault.
+ */
+namespace PageFaultError
+{
+constexpr uint64_t Present = 1 << 0;          // the page was present (a protection violation)
+constexpr uint64_t Write = 1 << 1;            // the access was a write
+constexpr uint64_t User = 1 << 2;             // the access was made in user mode
+constexpr uint64_t ReservedBit = 1 << 3;      // a paging-structure entry has a reserved bit set
+constexpr uint64_t InstructionFetch = 1 << 4; // the access was an instruction fetch
+constexpr uint64_t ProtectionKey = 1 << 5;    // the access violated a protection key
+}
+
+/**
+ * @brief Resolve a page fault on the given address (the contents of CR2).
+ *
+ * @return true if the faulting access can be retried, false if the fault is an error
+ */
+auto paging_handle_page_fault(uintptr_t address, uint64_t error_code) -> bool;
+
+/**
+ * @brief Page fault counters.
+ */
+struct PageFaultStats
+{
+    uint64_t faults = 0;           // calls to paging_handle_page_fault
+    uint64_t lazy_mappings = 0;    // pages of lazy regions backed on first access
+    uint64_t spurious = 0;         // faults on pages that were already mapped (e.g. by another processor)
+    uint64_t cow_copies = 0;       // writes to copy-on-write pages that copied the shared frame
+    uint64_t cow_reuses = 0;       // writes to copy-on-write pages whose frame was no longer shared
+    uint64_t unresolved = 0;       // faults that weren't resolved
+};
+
+auto paging_page_fault_stats() -> PageFaultStats;
+
+/**
+ * @brief Memory used by the page tables of every address space (not counting their PML4s).
+ */
+struct PageTableStats
+{
+    size_t table_frames = 0;           // frames currently holding page tables
+    size_t peak_table_frames = 0;      // highest value of table_frames so far
+    uint64_t reclaimed_tables = 0;     // tables freed because an unmap left them empty
+};
+
+auto paging_page_table_stats() -> PageTableStats;
+
+/**
+ * @brief Remove the mappings of the pages containing a virtual memory region, and free the page
+ * tables that are left empty.
+ *
+ * @param on_unmapped called with each unmapped frame (may be nullptr)
+ * @return the number of pages (of any size) that were unmapped
  */
-auto paging_allocate_and_map(uintptr_t virtual_base, size_t length, PageFlags flags) -> void;
+auto paging_unmap_range(uintptr_t virtual_base, size_t length, UnmappedPageVisitor on_unmapped = nullptr) -> size_t;
+
+/**
+ * @brief Change the permissions (Write, User, ExecuteDisable and CopyOnWrite) of the mapped pages
+ * containing a virtual memory region to those in `flags`.
+ *
+ * @return the number of pages (of any size) whose permissions changed
+ */
+auto paging_protect_range(uintptr_t virtual_base, size_t length, PageFlags flags) -> size_t;
+
+/**
+ * @brief Load the page tree rooted at the given physical address into CR3.
+ *
+ * If PCIDs are enabled, the TLB entries of the page tree are tagged with `pcid`, and loading
+ * it keeps the entries of other PCIDs. The entries previously tagged with `pcid` are kept as
+ * well unless `flush` is set, which must be the case if they may be stale (e.g. if `pcid` was
+ * used for another page tree, or if the page tree was changed while it wasn't loaded).
+ * Global (kernel) entries are always kept.
+ *
+ * @param pcid 0 to 4095 (ignored if PCIDs aren't enabled)
+ */
+auto paging_load_page_table(uintptr_t root, uint16_t pcid, bool flush) -> void;
+
+class AddressSpace;
+
+/**
+ * @brief Get the kernel's address space, whose page tree the other paging_* functions change.
+ * Other address spaces are created from it (see AddressSpace).
+ */
+auto paging_kernel_address_space() -> AddressSpace &;
+
+/**
+ * @brief Check if TLB entries are tagged with PCIDs (see paging_load_page_table).
+ */
+auto paging_pcids_enabled() -> bool;
 
 /**
  * @brief Get the virtual memory regions that are free to be managed (e.g. by an allocator)
@@ -95,6 +261,13 @@ auto paging_get_initial_free_regions() -> kpp::Array<MemoryRegion, paging_num_fr
  */
 auto paging_get_translation(uintptr_t virtual_address) -> PageTranslation;
 
+/**
+ * @brief Get the physical address of the 4 KiB frame a virtual address is mapped to, or 0 if it
+ * isn't mapped. Addresses in the HHDM map and the kernel image are translated arithmetically,
+ * without looking at the page tables.
+ */
+auto paging_get_frame(uintptr_t virtual_address) -> uintptr_t;
+
 
 /**
  * @brief Get the first and last pages for the smallest range containing a contiguous
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <kernel/LocalApic.hpp>
 
@@ -8,6 +9,11 @@
  */
 namespace processor {
 inline LocalAPIC localAPIC;
+
+/**
+ * @brief The maximum number of processors supported by the kernel's per-processor data.
+ */
+constexpr std::size_t maxCPUs = 16;
 }; // namespace processor
 
 
@@ -121,6 +127,50 @@ bool hasLocalAPIC();
  */
 bool hasPAT();
 
+/**
+ * @brief Program the page attribute table (the IA32_PAT MSR) of the current processor with the
+ * kernel's memory types, indexed by the PAT, PCD and PWT bits of a page's entry
+ * (PAT * 4 + PCD * 2 + PWT): write-back, write-combining, uncached-minus, uncached, write-back,
+ * write-through, uncached-minus, uncached.
+ *
+ * This is the power-on layout except for entries 1 (write-through) and 5 (write-protect), so that
+ * write-combining can be selected with the PWT bit alone, in pages of any size.
+ */
+void initializePageAttributeTable();
+
+/**
+ * @brief Read the page attribute table (the IA32_PAT MSR) of the current processor.
+ */
+uint64_t pageAttributeTable();
+
+/**
+ * @brief Check if this processor supports 1 GiB pages.
+ */
+bool has1GiBPages();
+
+/**
+ * @brief Check if this processor supports global pages.
+ */
+bool hasGlobalPages();
+
+/**
+ * @brief Check if this processor supports process-context identifiers (PCIDs).
+ */
+bool hasPCID();
+
+/**
+ * @brief Enable global pages (CR4.PGE): the TLB entries of pages mapped with the global flag are
+ * kept when CR3 is loaded.
+ */
+void enableGlobalPages();
+
+/**
+ * @brief Enable PCIDs (CR4.PCIDE): TLB entries are tagged with the PCID in the low 12 bits of
+ * CR3, so that loading CR3 can keep the entries of other (and, optionally, the new) address
+ * spaces. The PCID in CR3 must be 0 when this is called.
+ */
+void enablePCID();
+
 /**
  * @brief Get the memory-mapped physical base address of the local APIC.
  * 
@@ -135,6 +185,102 @@ uintptr_t localAPICBaseAddress();
  */
 void hardwareEnableLocalAPICAndSetBaseAddress(uintptr_t physicalBaseAddress);
 
+/**
+ * @brief Read the processor's time-stamp counter (the number of cycles since reset).
+ */
+uint64_t readTimestampCounter();
+
+/**
+ * @brief Get the number of time-stamp counter cycles per second. The frequency is measured
+ * against the PIT the first time this is called, which takes about 10 ms.
+ */
+uint64_t timestampCounterFrequency();
+
+/**
+ * @brief Invalidate the TLB entries of the current processor for the page containing the given
+ * virtual address.
+ */
+inline void invalidatePage(uintptr_t virtualAddress)
+{
+    asm volatile("invlpg (%0)" : : "r"(virtualAddress) : "memory");
+}
+
+/**
+ * @brief Invalidate every (non-global) TLB entry of the current processor by reloading CR3.
+ */
+inline void flushTLB()
+{
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) : : "memory");
+}
+
+/**
+ * @brief Invalidate every TLB entry of the current processor, including global entries and the
+ * entries of every PCID, by toggling CR4.PGE.
+ */
+inline void flushGlobalTLB()
+{
+    uint64_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    // CR4.PGE
+    const uint64_t toggled = cr4 ^ (1 << 7);
+    asm volatile("mov %0, %%cr4; mov %1, %%cr4" : : "r"(toggled), "r"(cr4) : "memory");
+}
+
+/**
+ * @brief Hint to the processor that it is spinning on a memory location (e.g. a lock).
+ */
+inline void pause()
+{
+    asm volatile("pause" : : : "memory");
+}
+
+/**
+ * @brief Get the initial local APIC ID of the processor executing this code (through CPUID).
+ */
+uint32_t currentAPICId();
+
+/**
+ * @brief Point the GS base of the current processor at its processor-local storage, so that
+ * currentCPUIndex() can be read without touching shared memory.
+ *
+ * This must be called after the GDT is loaded, since reloading GS resets its base.
+ *
+ * @param cpuIndex 0 to maxCPUs - 1: the kernel's index for the current processor
+ */
+void initializeCPULocalStorage(uint32_t cpuIndex);
+
+/**
+ * @brief Get the kernel's index (0 to maxCPUs - 1) for the processor executing this code.
+ */
+uint32_t currentCPUIndex();
+
+/**
+ * @brief Disables interrupts on the current processor for the lifetime of the guard,
+ * restoring the previous interrupt flag when destroyed.
+ */
+class InterruptGuard {
+public:
+    InterruptGuard()
+    {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+        m_interruptsWereEnabled = flags & (1 << 9);
+    }
+
+    ~InterruptGuard()
+    {
+        if (m_interruptsWereEnabled)
+            asm volatile("sti" : : : "memory");
+    }
+
+    InterruptGuard(const InterruptGuard&) = delete;
+    InterruptGuard& operator=(const InterruptGuard&) = delete;
+
+private:
+    bool m_interruptsWereEnabled = false;
+};
+
 /**
  * @brief Send a byte value to the specified I/O port.
  *
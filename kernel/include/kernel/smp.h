@@ -0,0 +1,60 @@
+#ifndef DAVOS_KERNEL_SMP_H_INCLUDED
+#define DAVOS_KERNEL_SMP_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Work run on several processors at once by smp_run. The argument is the same on every
+ * processor; the processor's index is available through processor::currentCPUIndex().
+ */
+using SmpWork = void (*)(void *argument);
+
+/**
+ * @brief Interrupt vector of the IPIs that ask the other processors to invalidate TLB entries.
+ */
+constexpr uint8_t tlb_shootdown_vector = 0xf0;
+
+/**
+ * @brief Start the application processors that Limine brought up, and wait for all of them to
+ * be running on the kernel's page table and their own stacks.
+ *
+ * Application processors get the indexes 1 to processor::maxCPUs - 1 (processors beyond that
+ * are halted). Once started, they enable their local APIC and interrupts, and wait for work
+ * given to smp_run. Their TLBs are kept coherent with smp_invalidate_tlb.
+ *
+ * Must be called on the bootstrap processor after kmalloc and the bootstrap processor's local
+ * APIC are initialized, and before bootloader memory is reclaimed.
+ */
+auto smp_init() -> void;
+
+/**
+ * @brief Get the number of processors running the kernel, including the bootstrap processor.
+ */
+auto smp_cpu_count() -> uint32_t;
+
+/**
+ * @brief Run `work` on the processors with indexes 0 to `cpus` - 1 at the same time, and return
+ * once it has returned on all of them. Must be called on the bootstrap processor (index 0).
+ *
+ * @param cpus 1 to smp_cpu_count()
+ */
+auto smp_run(SmpWork work, void *argument, uint32_t cpus) -> void;
+
+/**
+ * @brief Invalidate the TLB entries of the pages in [first, last] (canonical addresses) on every
+ * other online processor, and wait until they are all invalidated. Called by the page tree
+ * after it changed or removed mappings, and before it frees what they pointed to.
+ *
+ * The other processors are interrupted with an IPI, or notice the request while they spin with
+ * interrupts disabled (in SpinLock::lock, or while waiting for work).
+ */
+auto smp_invalidate_tlb(uintptr_t first, uintptr_t last) -> void;
+
+/**
+ * @brief Invalidate the TLB entries that smp_invalidate_tlb requested of the current processor,
+ * if any.
+ */
+auto smp_handle_tlb_shootdown() -> void;
+
+#endif
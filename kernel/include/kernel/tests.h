@@ -13,6 +13,50 @@ void test_stack_overflow();
 
 void test_paging();
 
+void test_huge_pages();
+
+void test_global_pages();
+
+void test_write_combining();
+
+void test_unmap_and_protect();
+
+void test_translation_cache();
+
+void test_page_table_reclaim();
+
+void test_address_spaces();
+
+void test_lazy_regions();
+
+void test_copy_on_write();
+
+void test_frame_allocator();
+
+void test_frame_ref_count();
+
+void test_zeroed_frames();
+
+void test_memory_zones();
+
+void test_compaction();
+
+void test_reserved_ranges();
+
+void test_frame_allocator_stats();
+
 void test_free_list_allocator();
 
+void test_virtual_memory_allocator();
+
+void test_vmalloc();
+
+void test_slab_cache();
+
+void test_kmalloc();
+
+void test_kmalloc_cpu_cache();
+
+void test_smp();
+
 #endif
\ No newline at end of file
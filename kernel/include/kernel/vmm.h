@@ -6,10 +6,27 @@
 auto vmm_init() -> void;
 
 /**
- * @brief Allocate a contiguous region of virtual address space.
+ * @brief How the memory returned by vmalloc is backed by frames.
  */
-auto vmalloc(size_t size) -> void *;
+enum class VmallocMode
+{
+    Lazy,  // each page is backed by a zeroed frame the first time it is accessed
+    Eager, // every page is backed by a zeroed frame before vmalloc returns
+};
 
+/**
+ * @brief Allocate a contiguous region of virtual memory, which is writable and reads as zero.
+ *
+ * Lazy memory only costs a frame for each page that is touched, at the price of a page fault;
+ * eager memory never faults.
+ *
+ * @return the (page-aligned) start of the region
+ */
+auto vmalloc(size_t size, VmallocMode mode = VmallocMode::Lazy) -> void *;
+
+/**
+ * @brief Free a region returned by vmalloc, unmapping its pages and freeing their frames.
+ */
 auto vfree(void *ptr) -> void;
 
 #endif
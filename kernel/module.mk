@@ -3,25 +3,34 @@ SUBMODULES := lib/kpp
 
 INCLUDE_DIRS += $(DIR)/include
 OBJS += $(addprefix $(DIR)/, \
+	src/AddressSpace.o \
 	src/APICManager.o \
+	src/benchmarks.o \
+	src/BitmapFrameAllocator.o \
+	src/BuddyFrameAllocator.o \
 	src/Frame.o \
 	src/frame_allocator.o \
 	src/gdt.o \
 	src/idt.o \
 	src/IDTStructure.o \
 	src/kernel.o \
+	src/kmalloc.o \
 	src/limine_features.o \
 	src/load_ptbr.o \
 	src/LocalAPIC.o \
 	src/main.o \
+	src/numa.o \
 	src/paging.o \
 	src/PageTree.o \
 	src/PageTreeNode.o \
 	src/processor.o \
 	src/reload_segment_registers.o \
+	src/SlabCache.o \
+	src/smp.o \
 	src/TableDescriptor.o \
 	src/Terminal.o \
 	src/tests.o \
+	src/VirtualMemoryAllocator.o \
 	src/vmm.o \
 )
 
@@ -10,23 +10,19 @@
 
 void APICManager::initialize()
 {
-    // TODO: Need to fix frame_allocator so that we can reserve the frames containing the APIC tables.
-
     // Use the RSDP to find the RSDT to find the MADT
     rsdp = reinterpret_cast<RootSystemDescriptionPointer*>(limine::rsdp_address->address);
     if (!rsdp)
         kernel_panic("Could not find RSDP. Maybe ACPI is not supported?\n");
     const auto acpiRevision = rsdp->acpiRevision;
     const auto physicalRsdt = rsdp->rootSDTPhysicalAddress();
-    // TODO: make this into a helper, paging_add_kernel_mapping
+    // The ACPI tables are reserved by the frame allocator until release_reserved_frames is called
+    // for ACPI memory, and the HHDM covers every memory map entry, so they can be read through it.
     const auto rsdt = reinterpret_cast<RootSDT *>(kernel_physical_to_virtual(physicalRsdt));
-    // TODO why don't we need to map this?
-    /*paging_add_mapping(reinterpret_cast<uintptr_t>(rsdt), physicalRsdt, kernelConstants::pageSize, PageFlags::None);*/
     const auto physicalMadt = rsdt->findSDTWithSignature<MADT>("APIC", acpiRevision);
     if (!physicalMadt)
         kernel_panic("MADT not found\n");
     const auto madt = reinterpret_cast<MADT *>(kernel_physical_to_virtual(physicalMadt));
-    /*paging_add_mapping(reinterpret_cast<uintptr_t>(madt), reinterpret_cast<uintptr_t>(physicalMadt), kernelConstants::pageSize, PageFlags::None);*/
 
     // Parse the MADT, a table of contiguous entries of different types, each storing information about an APIC
     auto apicStructures = reinterpret_cast<uint8_t*>(&madt->apicStructures);
@@ -49,6 +45,7 @@ void APICManager::initialize()
             // The registers of the IO APIC are memory-mapped, so we need to map the physical address to a virtual address.
             // We also need to make sure that the cache policy for the page is "strong uncacheable" (i.e. cache disabled)
             // for writing to the registers to work correctly (see Intel SDM Vol. 3A 10.4.1)
+            reserve_frames(ioApicInfo->ioApicAddress, ioApicInfo->ioApicAddress + kernelConstants::pageSize, ReservationType::Mmio);
             paging_add_mapping(reinterpret_cast<uintptr_t>(kernel_physical_to_virtual(ioApicInfo->ioApicAddress)), ioApicInfo->ioApicAddress, kernelConstants::pageSize, PageFlags::Write | PageFlags::CacheDisable);
             if (m_numIoApics >= m_ioApics.size())
                 kernel_panic("Too many IO APICs\n");
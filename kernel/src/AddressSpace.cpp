@@ -0,0 +1,189 @@
+#include <kpp/array.hpp>
+
+#include <kernel/AddressSpace.h>
+#include <kernel/frame_allocator.h>
+#include <kernel/kernel.h>
+#include <kernel/processor.hpp>
+#include <kernel/SpinLock.h>
+
+namespace
+{
+
+// start of the upper (kernel) half of the address space
+constexpr uintptr_t upper_half_base = 0xffff'8000'0000'0000;
+
+constexpr uint16_t kernel_pcid = 0;
+// used by every address space once the others are taken, so it is flushed on every switch
+constexpr uint16_t shared_pcid = 4095;
+constexpr size_t num_pcids = 4096;
+
+// bit i is set if PCID i is in use (the kernel's and the shared PCID always are)
+kpp::Array<uint64_t, num_pcids / 64> used_pcids {{1, 0}};
+SpinLock pcid_lock;
+
+// the address space loaded on each processor
+kpp::Array<AddressSpace *, processor::maxCPUs> active_spaces {};
+
+static_assert(processor::maxCPUs <= 32, "stale TLBs are tracked in a 32-bit mask");
+
+auto allocate_pcid() -> uint16_t
+{
+    SpinLockGuard guard {pcid_lock};
+    used_pcids[shared_pcid / 64] |= uint64_t {1} << (shared_pcid % 64);
+    for (size_t word = 0; word < used_pcids.size(); ++word) {
+        if (used_pcids[word] != ~uint64_t {0}) {
+            const auto bit = __builtin_ctzll(~used_pcids[word]);
+            used_pcids[word] |= uint64_t {1} << bit;
+            return static_cast<uint16_t>(word * 64 + bit);
+        }
+    }
+    return shared_pcid;
+}
+
+void free_pcid(uint16_t pcid)
+{
+    if (pcid == kernel_pcid || pcid == shared_pcid)
+        return;
+    SpinLockGuard guard {pcid_lock};
+    used_pcids[pcid / 64] &= ~(uint64_t {1} << (pcid % 64));
+}
+
+auto create_root() -> uintptr_t
+{
+    return reinterpret_cast<uintptr_t>(allocate_zeroed_frame());
+}
+
+} // anonymous namespace
+
+AddressSpace::AddressSpace()
+    : root_ {create_root()},
+      page_tree_ {kernel_physical_to_virtual(reinterpret_cast<void *>(root_))},
+      pcid_ {kernel_pcid},
+      is_kernel_space_ {true}
+{
+    page_tree_.allocate_upper_half();
+}
+
+AddressSpace::AddressSpace(AddressSpace &kernel_space)
+    : root_ {create_root()},
+      page_tree_ {kernel_physical_to_virtual(reinterpret_cast<void *>(root_))},
+      pcid_ {allocate_pcid()}
+{
+    page_tree_.share_upper_half(kernel_space.page_tree_);
+}
+
+AddressSpace::~AddressSpace()
+{
+    for (auto space : active_spaces) {
+        if (space == this)
+            kernel_panic("destroyed an active address space\n");
+    }
+    page_tree_.free_lower_half();
+    deallocate_frame(reinterpret_cast<void *>(root_));
+    free_pcid(pcid_);
+}
+
+void AddressSpace::activate()
+{
+    processor::InterruptGuard guard {};
+    const auto cpu = processor::currentCPUIndex();
+    const auto cpu_bit = uint32_t {1} << cpu;
+    const auto flush = (stale_tlbs_ & cpu_bit) || pcid_ == shared_pcid;
+    paging_load_page_table(root_, pcid_, flush);
+    stale_tlbs_ &= ~cpu_bit;
+    active_spaces[cpu] = this;
+}
+
+auto AddressSpace::is_active() const -> bool
+{
+    return active_spaces[processor::currentCPUIndex()] == this;
+}
+
+auto AddressSpace::active() -> AddressSpace *
+{
+    return active_spaces[processor::currentCPUIndex()];
+}
+
+void AddressSpace::map_range(uintptr_t virtual_base, uintptr_t physical_base, size_t length, PageFlags flags)
+{
+    prepare_change(virtual_base, length);
+    page_tree_.map_range(virtual_base, physical_base, length, flags);
+    invalidate_translations(virtual_base, length);
+}
+
+auto AddressSpace::unmap_range(uintptr_t virtual_base, size_t length, UnmappedPageVisitor on_unmapped) -> size_t
+{
+    prepare_change(virtual_base, length);
+    const auto num_pages = page_tree_.unmap_range(virtual_base, length, on_unmapped);
+    invalidate_translations(virtual_base, length);
+    return num_pages;
+}
+
+auto AddressSpace::protect_range(uintptr_t virtual_base, size_t length, PageFlags flags) -> size_t
+{
+    prepare_change(virtual_base, length);
+    const auto num_pages = page_tree_.protect_range(virtual_base, length, flags);
+    invalidate_translations(virtual_base, length);
+    return num_pages;
+}
+
+auto AddressSpace::share_copy_on_write(AddressSpace &source, uintptr_t virtual_base, size_t length) -> size_t
+{
+    source.prepare_change(virtual_base, length);
+    prepare_change(virtual_base, length);
+    const auto num_pages = page_tree_.share_copy_on_write(source.page_tree_, virtual_base, length);
+    // the shared pages lost their write permission in the source as well
+    source.invalidate_translations(virtual_base, length);
+    invalidate_translations(virtual_base, length);
+    return num_pages;
+}
+
+auto AddressSpace::get_translation(uintptr_t virtual_address) -> PageTranslation
+{
+    const auto page = virtual_address & ~uintptr_t {0xfff};
+    auto &entry = translation_cache_[(page >> 12) % translation_cache_size];
+    auto generation = uint64_t {0};
+    {
+        SpinLockGuard guard {translation_cache_lock_};
+        if (entry.page == page)
+            return entry.translation;
+        generation = translation_cache_generation_;
+    }
+
+    const auto translation = page_tree_.get_translation(virtual_address);
+    // the kernel half is changed through the kernel's address space, which can't invalidate the
+    // caches of the others
+    if (translation.page_size != 0 && (is_kernel_space_ || page < upper_half_base)) {
+        SpinLockGuard guard {translation_cache_lock_};
+        if (generation == translation_cache_generation_)
+            entry = CachedTranslation {page, translation};
+    }
+    return translation;
+}
+
+void AddressSpace::invalidate_translations(uintptr_t virtual_base, size_t length)
+{
+    SpinLockGuard guard {translation_cache_lock_};
+    ++translation_cache_generation_;
+    if (length >= translation_cache_size * 0x1000) {
+        for (auto &entry : translation_cache_)
+            entry = CachedTranslation {};
+        return;
+    }
+    const auto first_page = virtual_base & ~uintptr_t {0xfff};
+    const auto num_pages = (virtual_base + length - first_page + 0xfff) >> 12;
+    for (size_t i = 0; i < num_pages; ++i) {
+        auto &entry = translation_cache_[((first_page >> 12) + i) % translation_cache_size];
+        if (entry.page - first_page < num_pages << 12)
+            entry = CachedTranslation {};
+    }
+}
+
+void AddressSpace::prepare_change(uintptr_t virtual_base, size_t length)
+{
+    if (!is_kernel_space_ && (virtual_base >= upper_half_base || length > upper_half_base - virtual_base))
+        kernel_panic("address space change at %x (length %x) reaches the kernel half\n", virtual_base, length);
+    // the current processor's entries are invalidated by the page tree if the space is active
+    // here; otherwise they may be left stale as well
+    stale_tlbs_ = is_active() ? ~(uint32_t {1} << processor::currentCPUIndex()) : ~uint32_t {0};
+}
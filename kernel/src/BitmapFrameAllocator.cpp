@@ -0,0 +1,302 @@
+#include <kpp/cstring.hpp>
+
+#include <kernel/BitmapFrameAllocator.h>
+#include <kernel/constants.h>
+#include <kernel/kernel.h>
+
+namespace
+{
+
+constexpr size_t bits_per_word = 64;
+// a leaf word holds the bits of a block of this order
+constexpr uint8_t leaf_order = 6;
+
+/**
+ * @brief Size in bytes of a block of the given order.
+ */
+constexpr auto block_size(uint8_t order) -> uintptr_t
+{
+    return kernelConstants::frameSize << order;
+}
+
+constexpr auto ceil_div(size_t dividend, size_t divisor) -> size_t
+{
+    return (dividend + divisor - 1) / divisor;
+}
+
+/**
+ * @brief Get a word with the bits at multiples of 2^order set, i.e. the bits that may start an
+ * aligned run of 2^order bits (order < 6).
+ */
+constexpr auto aligned_bits(uint8_t order) -> uint64_t
+{
+    return ~uint64_t {0} / ((uint64_t {1} << (1u << order)) - 1);
+}
+
+/**
+ * @brief Get a word whose bit i is set if bits i to i + 2^order - 1 of `word` are all set
+ * (order < 6).
+ */
+constexpr auto runs_of(uint64_t word, uint8_t order) -> uint64_t
+{
+    for (unsigned shift = 1; shift < (1u << order); shift <<= 1)
+        word &= word >> shift;
+    return word;
+}
+
+/**
+ * @brief Get a mask of `count` bits starting at bit `first` (first + count <= 64).
+ */
+constexpr auto bit_mask(size_t first, size_t count) -> uint64_t
+{
+    return (count == bits_per_word ? ~uint64_t {0} : (uint64_t {1} << count) - 1) << first;
+}
+
+/**
+ * @brief Count the set bits of a word. (The kernel isn't linked with libgcc, which
+ * __builtin_popcountll calls on processors without the POPCNT instruction.)
+ */
+constexpr auto count_bits(uint64_t word) -> size_t
+{
+    word = word - ((word >> 1) & 0x5555'5555'5555'5555);
+    word = (word & 0x3333'3333'3333'3333) + ((word >> 2) & 0x3333'3333'3333'3333);
+    word = (word + (word >> 4)) & 0x0f0f'0f0f'0f0f'0f0f;
+    return (word * 0x0101'0101'0101'0101) >> 56;
+}
+
+static_assert(count_bits(~uint64_t {0}) == 64 && count_bits(0b1011) == 3);
+static_assert(aligned_bits(0) == ~uint64_t {0});
+static_assert(aligned_bits(2) == 0x1111'1111'1111'1111);
+static_assert(runs_of(0b0111'0110, 1) == 0b0011'0010);
+
+} // anonymous namespace
+
+auto BitmapFrameAllocator::storage_words(uintptr_t begin, uintptr_t end) -> size_t
+{
+    if (begin >= end)
+        return 0;
+    const auto base = begin / block_size(max_order) * block_size(max_order);
+    const auto num_leaves = ceil_div(ceil_div(end - base, kernelConstants::frameSize), bits_per_word);
+    return num_leaves + 2 * ceil_div(num_leaves, bits_per_word);
+}
+
+BitmapFrameAllocator::BitmapFrameAllocator(uintptr_t begin, uintptr_t end, FrameInfo *frame_infos, uint8_t zone, uint64_t *storage)
+    : base_ {begin / block_size(max_order) * block_size(max_order)},
+      begin_ {begin},
+      end_ {begin < end ? end : begin},
+      frame_infos_ {frame_infos},
+      zone_ {zone}
+{
+    const auto words = storage_words(begin_, end_);
+    if (words == 0)
+        return;
+    kpp::memset(storage, 0, words * sizeof(uint64_t));
+    num_leaves_ = ceil_div(ceil_div(end_ - base_, kernelConstants::frameSize), bits_per_word);
+    num_summaries_ = ceil_div(num_leaves_, bits_per_word);
+    leaves_ = storage;
+    nonempty_leaves_ = leaves_ + num_leaves_;
+    full_leaves_ = nonempty_leaves_ + num_summaries_;
+}
+
+auto BitmapFrameAllocator::allocate(uint8_t order) -> uintptr_t
+{
+    if (order > max_order)
+        return 0;
+    auto first_frame = size_t {0};
+    if (!find_free_frames(order, first_frame))
+        return 0;
+    set_frames(first_frame, size_t {1} << order, false);
+
+    const auto block = base_ + first_frame * kernelConstants::frameSize;
+    auto &block_info = frame_infos_[block / kernelConstants::frameSize];
+    block_info.order = order;
+    block_info.zone = zone_;
+    return block;
+}
+
+auto BitmapFrameAllocator::deallocate(uintptr_t block, uint8_t order) -> void
+{
+    if (order > max_order || block % block_size(order) != 0 || block < begin_ || block + block_size(order) > end_)
+        kernel_panic("invalid deallocation of frame block %x (order %d)\n", block, order);
+    const auto first_frame = frame_index(block);
+    if (has_free_frame(first_frame, size_t {1} << order))
+        kernel_panic("double free of frame block %x (order %d)\n", block, order);
+    set_frames(first_frame, size_t {1} << order, true);
+}
+
+auto BitmapFrameAllocator::deallocate_range(uintptr_t begin, uintptr_t end) -> void
+{
+    // only whole frames inside the range can be freed
+    begin = ceil_div(begin, kernelConstants::frameSize) * kernelConstants::frameSize;
+    end = end / kernelConstants::frameSize * kernelConstants::frameSize;
+    if (begin < begin_ || end > end_)
+        kernel_panic("frame range %x-%x is outside of the allocator's range\n", begin, end);
+    if (begin < end)
+        set_frames(frame_index(begin), (end - begin) / kernelConstants::frameSize, true);
+}
+
+auto BitmapFrameAllocator::owns_free_block(uintptr_t block) const -> bool
+{
+    return begin_ <= block && block < end_ && has_free_frame(frame_index(block), 1);
+}
+
+auto BitmapFrameAllocator::take_free_block(uintptr_t block) -> uint8_t
+{
+    if (!owns_free_block(block))
+        kernel_panic("frame block %x is not free\n", block);
+    set_frames(frame_index(block), 1, false);
+    frame_infos_[block / kernelConstants::frameSize].order = 0;
+    return 0;
+}
+
+auto BitmapFrameAllocator::free_blocks(uint8_t order) const -> size_t
+{
+    if (order > max_order)
+        return 0;
+    // every free aligned block of the next order would have been coalesced from two of these
+    const auto blocks = aligned_free_blocks(order);
+    return order == max_order ? blocks : blocks - 2 * aligned_free_blocks(order + 1);
+}
+
+auto BitmapFrameAllocator::frame_index(uintptr_t frame) const -> size_t
+{
+    return (frame - base_) / kernelConstants::frameSize;
+}
+
+/**
+ * @brief Find an aligned run of 2^order free frames, returning the index of its first frame.
+ */
+auto BitmapFrameAllocator::find_free_frames(uint8_t order, size_t &first_frame) -> bool
+{
+    if (order >= leaf_order) {
+        auto first_leaf = size_t {0};
+        if (!find_free_leaves(order - leaf_order, first_leaf))
+            return false;
+        first_frame = first_leaf * bits_per_word;
+        return true;
+    }
+
+    while (first_nonempty_summary_ < num_summaries_ && nonempty_leaves_[first_nonempty_summary_] == 0)
+        ++first_nonempty_summary_;
+    for (auto summary = first_nonempty_summary_; summary < num_summaries_; ++summary) {
+        for (auto leaves = nonempty_leaves_[summary]; leaves != 0; leaves &= leaves - 1) {
+            const auto leaf = summary * bits_per_word + __builtin_ctzll(leaves);
+            const auto starts = runs_of(leaves_[leaf], order) & aligned_bits(order);
+            if (starts != 0) {
+                first_frame = leaf * bits_per_word + __builtin_ctzll(starts);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Find an aligned run of 2^order_in_leaves full leaves, returning the index of the first
+ * one.
+ */
+auto BitmapFrameAllocator::find_free_leaves(uint8_t order_in_leaves, size_t &first_leaf) const -> bool
+{
+    if (order_in_leaves < leaf_order) {
+        for (size_t summary = 0; summary < num_summaries_; ++summary) {
+            const auto starts = runs_of(full_leaves_[summary], order_in_leaves) & aligned_bits(order_in_leaves);
+            if (starts != 0) {
+                first_leaf = summary * bits_per_word + __builtin_ctzll(starts);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // runs of whole summary words
+    const auto group = size_t {1} << (order_in_leaves - leaf_order);
+    for (size_t summary = 0; summary + group <= num_summaries_; summary += group) {
+        auto all_full = true;
+        for (size_t i = 0; i < group && all_full; ++i)
+            all_full = full_leaves_[summary + i] == ~uint64_t {0};
+        if (all_full) {
+            first_leaf = summary * bits_per_word;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Mark the given frames as free or allocated, a leaf word at a time.
+ */
+auto BitmapFrameAllocator::set_frames(size_t first_frame, size_t num_frames, bool free) -> void
+{
+    while (num_frames > 0) {
+        const auto leaf = first_frame / bits_per_word;
+        const auto first_bit = first_frame % bits_per_word;
+        const auto count = num_frames < bits_per_word - first_bit ? num_frames : bits_per_word - first_bit;
+        const auto mask = bit_mask(first_bit, count);
+        update_leaf(leaf, free ? leaves_[leaf] | mask : leaves_[leaf] & ~mask);
+        first_frame += count;
+        num_frames -= count;
+    }
+}
+
+/**
+ * @brief Set the value of a leaf word, updating the summaries and the free frame count.
+ */
+auto BitmapFrameAllocator::update_leaf(size_t leaf, uint64_t value) -> void
+{
+    const auto old_value = leaves_[leaf];
+    free_frames_ += count_bits(value & ~old_value);
+    free_frames_ -= count_bits(old_value & ~value);
+    leaves_[leaf] = value;
+
+    const auto summary = leaf / bits_per_word;
+    const auto summary_bit = uint64_t {1} << (leaf % bits_per_word);
+    if (value != 0) {
+        nonempty_leaves_[summary] |= summary_bit;
+        if (summary < first_nonempty_summary_)
+            first_nonempty_summary_ = summary;
+    } else {
+        nonempty_leaves_[summary] &= ~summary_bit;
+    }
+    if (value == ~uint64_t {0})
+        full_leaves_[summary] |= summary_bit;
+    else
+        full_leaves_[summary] &= ~summary_bit;
+}
+
+auto BitmapFrameAllocator::has_free_frame(size_t first_frame, size_t num_frames) const -> bool
+{
+    while (num_frames > 0) {
+        const auto leaf = first_frame / bits_per_word;
+        const auto first_bit = first_frame % bits_per_word;
+        const auto count = num_frames < bits_per_word - first_bit ? num_frames : bits_per_word - first_bit;
+        if (leaves_[leaf] & bit_mask(first_bit, count))
+            return true;
+        first_frame += count;
+        num_frames -= count;
+    }
+    return false;
+}
+
+/**
+ * @brief Count the aligned blocks of 2^order frames that are entirely free.
+ */
+auto BitmapFrameAllocator::aligned_free_blocks(uint8_t order) const -> size_t
+{
+    auto blocks = size_t {0};
+    if (order < leaf_order) {
+        for (size_t leaf = 0; leaf < num_leaves_; ++leaf)
+            blocks += count_bits(runs_of(leaves_[leaf], order) & aligned_bits(order));
+    } else if (order < 2 * leaf_order) {
+        for (size_t summary = 0; summary < num_summaries_; ++summary)
+            blocks += count_bits(runs_of(full_leaves_[summary], order - leaf_order) & aligned_bits(order - leaf_order));
+    } else {
+        const auto group = size_t {1} << (order - 2 * leaf_order);
+        for (size_t summary = 0; summary + group <= num_summaries_; summary += group) {
+            auto all_full = true;
+            for (size_t i = 0; i < group && all_full; ++i)
+                all_full = full_leaves_[summary + i] == ~uint64_t {0};
+            blocks += all_full;
+        }
+    }
+    return blocks;
+}
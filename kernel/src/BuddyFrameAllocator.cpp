@@ -0,0 +1,149 @@
+#include <kernel/BuddyFrameAllocator.h>
+#include <kernel/constants.h>
+#include <kernel/frame_allocator.h>
+#include <kernel/kernel.h>
+#include <kernel/limine_features.h>
+
+namespace
+{
+
+/**
+ * @brief Size in bytes of a block of the given order.
+ */
+constexpr auto block_size(uint8_t order) -> uintptr_t
+{
+    return kernelConstants::frameSize << order;
+}
+
+auto physical_to_virtual_offset() -> uintptr_t
+{
+    return limine::hhdm_address->offset;
+}
+
+} // anonymous namespace
+
+BuddyFrameAllocator::BuddyFrameAllocator(uintptr_t end, FrameInfo *frame_infos, uint8_t zone)
+    : end_ {end},
+      frame_infos_ {frame_infos},
+      zone_ {zone}
+{
+}
+
+auto BuddyFrameAllocator::allocate(uint8_t order) -> uintptr_t
+{
+    if (order > max_order)
+        return 0;
+
+    // find the smallest free block that is large enough
+    auto current_order = order;
+    while (current_order <= max_order && !free_lists_[current_order])
+        ++current_order;
+    if (current_order > max_order)
+        return 0;
+
+    const auto block = reinterpret_cast<uintptr_t>(free_lists_[current_order]) - physical_to_virtual_offset();
+    remove(block, current_order);
+
+    // split the block in halves until it is the requested size, freeing the upper halves
+    while (current_order > order) {
+        --current_order;
+        push(block + block_size(current_order), current_order);
+    }
+    return block;
+}
+
+auto BuddyFrameAllocator::deallocate(uintptr_t block, uint8_t order) -> void
+{
+    if (order > max_order || block % block_size(order) != 0 || block + block_size(order) > end_)
+        kernel_panic("invalid deallocation of frame block %x (order %d)\n", block, order);
+    if (is_free(block, order))
+        kernel_panic("double free of frame block %x (order %d)\n", block, order);
+
+    // merge with the buddy for as long as the buddy is entirely free
+    while (order < max_order) {
+        const auto buddy = block ^ block_size(order);
+        if (buddy + block_size(order) > end_ || !is_free(buddy, order))
+            break;
+        remove(buddy, order);
+        block = block < buddy ? block : buddy;
+        ++order;
+    }
+    push(block, order);
+}
+
+auto BuddyFrameAllocator::deallocate_range(uintptr_t begin, uintptr_t end) -> void
+{
+    // only whole frames inside the range can be freed
+    begin = (begin + kernelConstants::frameSize - 1) / kernelConstants::frameSize * kernelConstants::frameSize;
+    end = end / kernelConstants::frameSize * kernelConstants::frameSize;
+
+    while (begin < end) {
+        // the largest block that starts at `begin` and doesn't extend past `end`
+        auto order = max_order;
+        while (order > 0 && (begin % block_size(order) != 0 || begin + block_size(order) > end))
+            --order;
+        deallocate(begin, order);
+        begin += block_size(order);
+    }
+}
+
+auto BuddyFrameAllocator::owns_free_block(uintptr_t block) const -> bool
+{
+    if (block >= end_)
+        return false;
+    const auto &block_info = info(block);
+    return block_info.has_flags(FrameFlags::Free) && block_info.zone == zone_;
+}
+
+auto BuddyFrameAllocator::take_free_block(uintptr_t block) -> uint8_t
+{
+    if (!owns_free_block(block))
+        kernel_panic("frame block %x is not free\n", block);
+    const auto order = info(block).order;
+    remove(block, order);
+    return order;
+}
+
+auto BuddyFrameAllocator::push(uintptr_t block, uint8_t order) -> void
+{
+    auto free_block = reinterpret_cast<FreeBlock *>(kernel_physical_to_virtual(block));
+    free_block->prev = nullptr;
+    free_block->next = free_lists_[order];
+    if (free_lists_[order])
+        free_lists_[order]->prev = free_block;
+    free_lists_[order] = free_block;
+
+    auto &block_info = info(block);
+    block_info.flags = block_info.flags | FrameFlags::Free;
+    block_info.order = order;
+    block_info.zone = zone_;
+    free_blocks_[order] += 1;
+    free_frames_ += size_t {1} << order;
+}
+
+auto BuddyFrameAllocator::remove(uintptr_t block, uint8_t order) -> void
+{
+    auto free_block = reinterpret_cast<FreeBlock *>(kernel_physical_to_virtual(block));
+    if (free_block->prev)
+        free_block->prev->next = free_block->next;
+    else
+        free_lists_[order] = free_block->next;
+    if (free_block->next)
+        free_block->next->prev = free_block->prev;
+
+    auto &block_info = info(block);
+    block_info.flags = block_info.flags & ~FrameFlags::Free;
+    free_blocks_[order] -= 1;
+    free_frames_ -= size_t {1} << order;
+}
+
+auto BuddyFrameAllocator::is_free(uintptr_t block, uint8_t order) const -> bool
+{
+    const auto &block_info = info(block);
+    return block_info.has_flags(FrameFlags::Free) && block_info.order == order && block_info.zone == zone_;
+}
+
+auto BuddyFrameAllocator::info(uintptr_t block) const -> FrameInfo &
+{
+    return frame_infos_[block / kernelConstants::frameSize];
+}
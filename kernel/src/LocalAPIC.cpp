@@ -10,6 +10,10 @@ namespace {
     constexpr uint32_t LAPIC_SPURIOUS_REGISTER = 0xF0;
     constexpr uint32_t LAPIC_EOI_REGISTER = 0xB0;
     constexpr uint32_t LAPIC_TASK_PRIORITY = 0x80;
+    constexpr uint32_t LAPIC_ICR_LOW = 0x300;
+    constexpr uint32_t LAPIC_ICR_HIGH = 0x310;
+    constexpr uint32_t LAPIC_ICR_DELIVERY_PENDING = 1 << 12;
+    constexpr uint32_t LAPIC_ICR_ASSERT = 1 << 14;
 }
 
 void LocalAPIC::enableAPIC()
@@ -20,6 +24,7 @@ void LocalAPIC::enableAPIC()
     kernel_assert(processor::hasPAT(), "Processor does not support PAT");
 
     // Map the Local APIC into the kernel's virtual address space with appropriate flags
+    reserve_frames(physicalAPICAddress, physicalAPICAddress + kernelConstants::pageSize, ReservationType::Mmio);
     paging_add_mapping(virtualAPICAddress, physicalAPICAddress, kernelConstants::pageSize,
                        PageFlags::Write | PageFlags::CacheDisable);
 
@@ -48,6 +53,23 @@ void LocalAPIC::enableAPIC()
     write(LAPIC_TASK_PRIORITY, 0);
 }
 
+void LocalAPIC::enableApplicationProcessorAPIC()
+{
+    // the mapping and the PIC were set up by the bootstrap processor
+    processor::hardwareEnableLocalAPICAndSetBaseAddress(processor::localAPICBaseAddress());
+    write(LAPIC_SPURIOUS_REGISTER, 0x1FF);
+    write(LAPIC_TASK_PRIORITY, 0);
+}
+
+void LocalAPIC::sendInterprocessorInterrupt(uint32_t apicId, uint8_t vector)
+{
+    while (read(LAPIC_ICR_LOW) & LAPIC_ICR_DELIVERY_PENDING)
+        asm volatile("pause");
+    // The interrupt is issued when the low register is written to, so the destination goes first
+    write(LAPIC_ICR_HIGH, apicId << 24);
+    write(LAPIC_ICR_LOW, LAPIC_ICR_ASSERT | vector);
+}
+
 void LocalAPIC::sendEndOfInterrupt()
 {
     // Send an End of Interrupt (EOI) signal to the local APIC.
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <new>
 #include <stdint.h>
 
@@ -6,95 +7,553 @@
 #include <kernel/limine_features.h>
 #include <kernel/macros.h>
 #include <kernel/frame_allocator.h>
+#include <kernel/processor.hpp>
+#include <kernel/smp.h>
+
+/**
+ * @brief Depth of the page tables (the last level of the tree).
+ */
+constexpr int max_depth = 3;
 
 /**
  * @brief Get the page tree table index for the given depth from the virtual address.
  */
-uint16_t get_table_index(uint64_t virtual_address, uint8_t depth)
+static auto get_table_index(uint64_t virtual_address, int depth) -> uint16_t
 {
-    uint8_t index_start = 0;
-    // table index is located in different parts of the virtual address depending on the depth
-    switch (depth)
-    {
-    case 0:
-        index_start = 39;
-        break;
-    case 1:
-        index_start = 30;
-        break;
-    case 2:
-        index_start = 21;
-        break;
-    case 3:
-        index_start = 12;
-        break;
-    default:
-        kernel_panic("unrecognized page tree depth\n");
-        break;
-    }
-    uint16_t table_index = (virtual_address >> index_start) & 0x1ff; // mask lowest 9 bits
-    return table_index;
+    // 9 bits of index per level, above the 12 bits of the page offset
+    return (virtual_address >> (12 + 9 * (max_depth - depth))) & 0x1ff;
+}
+
+/**
+ * @brief Index of the first root entry of the upper (kernel) half of the address space.
+ */
+constexpr int first_upper_half_entry = PageTreeNode::num_entries / 2;
+
+/**
+ * @brief Size in bytes of the memory mapped by an entry at the given depth.
+ */
+static constexpr auto entry_size(int depth) -> uint64_t
+{
+    return uint64_t {0x1000} << (9 * (max_depth - depth));
+}
+
+static auto has_flags(PageFlags flags, PageFlags mask) -> bool
+{
+    return (flags & mask) == mask;
+}
+
+/**
+ * @brief Get the flags of an entry pointing to a table: permissions are checked at every level,
+ * so the table entries must allow anything that the pages mapped below them allow.
+ */
+static auto table_flags(PageFlags flags) -> PageFlags
+{
+    return flags & (PageFlags::Write | PageFlags::User);
+}
+
+static auto node_at(uintptr_t physical_address) -> PageTreeNode *
+{
+    return reinterpret_cast<PageTreeNode *>(kernel_physical_to_virtual(physical_address));
+}
+
+/**
+ * @brief Sign-extend bit 47 of an address built from table indices.
+ */
+static auto canonical(uint64_t address) -> uint64_t
+{
+    return address & (uint64_t {1} << 47) ? address | 0xffff'0000'0000'0000 : address;
+}
+
+static struct {
+    std::atomic<size_t> table_frames {0};
+    std::atomic<size_t> peak_table_frames {0};
+    std::atomic<uint64_t> reclaimed_tables {0};
+} table_counters;
+
+/**
+ * @brief Number of present entries of a table. It is kept in the metadata of the table's frame,
+ * so that tables left empty by an unmap are found without scanning their 512 entries.
+ */
+static auto live_entries(PageTreeNode *node) -> uint64_t &
+{
+    // tables are only reached through the HHDM
+    return frame_info(reinterpret_cast<uintptr_t>(node) - limine::hhdm_address->offset).owner;
+}
+
+/**
+ * @brief Account for a newly allocated table with the given number of present entries.
+ */
+static void track_table(uintptr_t table, uint64_t num_live_entries)
+{
+    frame_info(table).owner = num_live_entries;
+    const auto table_frames = table_counters.table_frames.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto peak = table_counters.peak_table_frames.load(std::memory_order_relaxed);
+    while (table_frames > peak
+        && !table_counters.peak_table_frames.compare_exchange_weak(peak, table_frames, std::memory_order_relaxed))
+        ;
+}
+
+static void release_table(uintptr_t table)
+{
+    table_counters.table_frames.fetch_sub(1, std::memory_order_relaxed);
+    deallocate_frame(reinterpret_cast<void *>(table));
+}
+
+static void clear_present(PageTreeNode *node, int index)
+{
+    node->set_entry(index, node->get_entry(index) & ~static_cast<uint64_t>(PageFlags::Present));
+}
+
+/**
+ * @brief Invalidate every TLB entry that may map an address in [first, last]. Only pages in the
+ * upper (kernel) half are global, and their entries are kept when CR3 is reloaded.
+ */
+static void flush_tlb(uint64_t first, uint64_t last)
+{
+    if ((first | last) >> 63)
+        processor::flushGlobalTLB();
+    else
+        processor::flushTLB();
+}
+
+/**
+ * @brief Check if more pages may change in the range [first, last] than are worth invalidating
+ * one at a time.
+ */
+static auto should_flush_tlb(uint64_t first, uint64_t last) -> bool
+{
+    return (last - first) / entry_size(max_depth) >= PageTree::tlb_flush_threshold;
 }
 
 PageTree::PageTree(void *virtual_address)
 {
     // placement new: construct the PageTreeNode at virtual_address
     root_ = new(virtual_address) PageTreeNode;
+    live_entries(root_) = 0;
+    if (processor::has1GiBPages())
+        largest_page_depth_ = static_cast<int>(Depth::DirectoryPointer);
+    else
+        largest_page_depth_ = static_cast<int>(Depth::Directory);
 }
 
 void PageTree::map_page_to_frame(uint64_t page, uint64_t frame, PageFlags flags)
 {
-    PageTreeNode *curr = root_;
-    const int max_depth = 3;
-    // traverse the tree until curr is in the last level (page table level)
-    for (int depth = 0; depth < max_depth; ++depth)
-    {
-        auto child_index = get_table_index(page, depth);
-        auto child_address = curr->get_child_address(child_index);
-        auto next = reinterpret_cast<PageTreeNode *>(kernel_physical_to_virtual(child_address));
-        // allocate a new node for the next level if unallocated
-        if (!child_address)
-        {
-            auto new_node_frame = allocate_frame();
-            auto new_node_frame_virtual = kernel_physical_to_virtual(new_node_frame);
-            // construct the new page tree node at the given address
-            new(new_node_frame_virtual) PageTreeNode;
-            // use the physical frame address here: the page table uses physical addresses
-            curr->set_child_address(child_index, reinterpret_cast<uintptr_t>(new_node_frame));
-            curr->set_child_flags(child_index, flags);
-            next = reinterpret_cast<PageTreeNode *>(new_node_frame_virtual);
+    map_range(page, frame, entry_size(max_depth), flags);
+}
+
+void PageTree::map_range(uint64_t virtual_base, uint64_t physical_base, uint64_t length, PageFlags flags)
+{
+    if (length == 0)
+        return;
+    const auto first = virtual_base;
+    const auto last = virtual_base + (length - 1);
+    const auto flush = should_flush_tlb(first, last);
+    const auto num_replaced = map_entries(root_, 0, first, last, physical_base, flags, !flush);
+    if (num_replaced == 0)
+        return;
+    if (flush)
+        flush_tlb(first, last);
+    smp_invalidate_tlb(canonical(first), canonical(last));
+}
+
+auto PageTree::unmap_range(uint64_t virtual_base, uint64_t length, UnmappedPageVisitor on_unmapped) -> size_t
+{
+    if (length == 0)
+        return 0;
+    const auto first = virtual_base;
+    const auto last = virtual_base + (length - 1);
+    const auto flush = should_flush_tlb(first, last);
+
+    // nothing is freed until the TLB (and the paging-structure caches) can't reach it anymore,
+    // since the processor may still access pages and walk tables through stale entries
+    const auto num_pages = clear_range(root_, 0, first, last, !flush);
+    if (num_pages == 0)
+        return 0;
+    if (flush)
+        flush_tlb(first, last);
+    else
+        // invlpg invalidates every paging-structure cache entry, including the ones of tables
+        // detached after the pages above them were invalidated
+        processor::invalidatePage(canonical(first));
+    smp_invalidate_tlb(canonical(first), canonical(last));
+    release_range(root_, 0, first, last, on_unmapped);
+    return num_pages;
+}
+
+auto PageTree::clear_range(PageTreeNode *node, int depth, uint64_t first, uint64_t last, bool invalidate_pages) -> size_t
+{
+    size_t num_pages = 0;
+    const auto size = entry_size(depth);
+    for (auto address = first;;) {
+        const auto entry_first = address & ~(size - 1);
+        const auto entry_last = entry_first + (size - 1);
+        const auto piece_last = last < entry_last ? last : entry_last;
+        const auto index = get_table_index(address, depth);
+        const auto flags = node->get_child_flags(index);
+
+        if (has_flags(flags, PageFlags::Present)) {
+            const auto is_page = depth == max_depth || has_flags(flags, PageFlags::HugePage);
+            if (is_page && address == entry_first && piece_last == entry_last) {
+                // keep the address so that the frame can be released in the second pass
+                clear_present(node, index);
+                --live_entries(node);
+                if (invalidate_pages)
+                    processor::invalidatePage(canonical(entry_first));
+                ++num_pages;
+            } else {
+                // the range covers only part of this large page or table
+                if (is_page)
+                    split_large_page(node, index, depth);
+                auto child = node_at(node->get_child_address(index));
+                num_pages += clear_range(child, depth + 1, address, piece_last, invalidate_pages);
+                const auto is_shared = depth == 0 && index >= first_upper_half_entry && upper_half_shared_;
+                if (live_entries(child) == 0 && !is_shared) {
+                    clear_present(node, index);
+                    --live_entries(node);
+                }
+            }
         }
-        // append child flags, don't clear and set them since other pages deeper in the tree
-        // may depend on previously set flags
-        curr->set_child_flags(child_index, flags);
-        // move to the next depth
-        curr = next;
+        if (piece_last == last)
+            return num_pages;
+        address = piece_last + 1;
     }
+}
+
+void PageTree::release_range(PageTreeNode *node, int depth, uint64_t first, uint64_t last, UnmappedPageVisitor on_unmapped)
+{
+    const auto size = entry_size(depth);
+    for (auto address = first;;) {
+        const auto entry_last = (address & ~(size - 1)) + (size - 1);
+        const auto piece_last = last < entry_last ? last : entry_last;
+        const auto index = get_table_index(address, depth);
+        const auto flags = node->get_child_flags(index);
+        const auto child_address = node->get_child_address(index);
+        const auto is_page = depth == max_depth || has_flags(flags, PageFlags::HugePage);
+
+        if (has_flags(flags, PageFlags::Present)) {
+            // a table that still maps other pages may hold cleared entries
+            if (!is_page)
+                release_range(node_at(child_address), depth + 1, address, piece_last, on_unmapped);
+        } else if (child_address != 0) {
+            // cleared by clear_range
+            node->set_entry(index, 0);
+            if (is_page) {
+                if (on_unmapped != nullptr)
+                    on_unmapped(child_address & ~(size - 1), size);
+            } else {
+                release_range(node_at(child_address), depth + 1, address, piece_last, on_unmapped);
+                release_table(child_address);
+                table_counters.reclaimed_tables.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (piece_last == last)
+            return;
+        address = piece_last + 1;
+    }
+}
 
-    // set the address and flags of the physical frame in the page table
-    auto child_index = get_table_index(page, max_depth);
-    curr->set_child_address(child_index, frame);
-    curr->set_child_flags(child_index, flags);
+auto PageTree::protect_range(uint64_t virtual_base, uint64_t length, PageFlags flags) -> size_t
+{
+    if (length == 0)
+        return 0;
+    const auto first = virtual_base;
+    const auto last = virtual_base + (length - 1);
+    const auto flush = should_flush_tlb(first, last);
+    const auto num_pages = protect(root_, 0, first, last, flags, !flush);
+    if (num_pages == 0)
+        return 0;
+    if (flush)
+        flush_tlb(first, last);
+    smp_invalidate_tlb(canonical(first), canonical(last));
+    return num_pages;
+}
+
+auto PageTree::protect(PageTreeNode *node, int depth, uint64_t first, uint64_t last, PageFlags flags, bool invalidate_pages) -> size_t
+{
+    const auto permissions = static_cast<uint64_t>(PageFlags::Write | PageFlags::User | PageFlags::ExecuteDisable
+        | PageFlags::CopyOnWrite);
+    size_t num_pages = 0;
+    const auto size = entry_size(depth);
+    for (auto address = first;;) {
+        const auto entry_first = address & ~(size - 1);
+        const auto entry_last = entry_first + (size - 1);
+        const auto piece_last = last < entry_last ? last : entry_last;
+        const auto index = get_table_index(address, depth);
+        const auto entry_flags = node->get_child_flags(index);
+
+        if (has_flags(entry_flags, PageFlags::Present)) {
+            const auto is_page = depth == max_depth || has_flags(entry_flags, PageFlags::HugePage);
+            if (is_page && address == entry_first && piece_last == entry_last) {
+                const auto entry = node->get_entry(index);
+                const auto new_entry = (entry & ~permissions) | (static_cast<uint64_t>(flags) & permissions);
+                if (new_entry != entry) {
+                    node->set_entry(index, new_entry);
+                    if (invalidate_pages)
+                        processor::invalidatePage(canonical(entry_first));
+                    ++num_pages;
+                }
+            } else {
+                if (is_page)
+                    split_large_page(node, index, depth);
+                node->add_child_flags(index, table_flags(flags));
+                num_pages += protect(node_at(node->get_child_address(index)), depth + 1, address, piece_last, flags, invalidate_pages);
+            }
+        }
+        if (piece_last == last)
+            return num_pages;
+        address = piece_last + 1;
+    }
+}
+
+auto PageTree::map_entries(PageTreeNode *node, int depth, uint64_t first, uint64_t last, uint64_t physical_base, PageFlags flags, bool invalidate_pages) -> size_t
+{
+    size_t num_replaced = 0;
+    if (depth == max_depth) {
+        // the common case of 4 KiB pages: fill consecutive entries of the page table
+        const auto attributes = static_cast<uint64_t>(flags | PageFlags::Present);
+        const auto last_index = get_table_index(last, depth);
+        auto page = first;
+        auto frame = physical_base;
+        auto num_added = uint64_t {0};
+        for (auto index = get_table_index(first, depth); index <= last_index; ++index) {
+            const auto old_entry = node->get_entry(index);
+            node->set_entry(index, (frame & PageTreeNode::address_mask) | attributes);
+            if (old_entry & static_cast<uint64_t>(PageFlags::Present)) {
+                if (invalidate_pages)
+                    processor::invalidatePage(canonical(page));
+                ++num_replaced;
+            } else {
+                ++num_added;
+            }
+            page += entry_size(depth);
+            frame += entry_size(depth);
+        }
+        live_entries(node) += num_added;
+        return num_replaced;
+    }
+
+    const auto size = entry_size(depth);
+    for (auto address = first;;) {
+        const auto entry_first = address & ~(size - 1);
+        const auto entry_last = entry_first + (size - 1);
+        const auto piece_last = last < entry_last ? last : entry_last;
+        const auto index = get_table_index(address, depth);
+        const auto frame = physical_base + (address - first);
+
+        if (depth >= largest_page_depth_ && address == entry_first && piece_last == entry_last && frame % size == 0) {
+            // the piece is a whole aligned large page
+            const auto old_flags = node->get_child_flags(index);
+            const auto old_address = node->get_child_address(index);
+            node->set_child_address(index, frame);
+            node->set_child_flags(index, flags | PageFlags::HugePage);
+            if (has_flags(old_flags, PageFlags::Present)) {
+                if (!has_flags(old_flags, PageFlags::HugePage)) {
+                    // a large page replaced a table of smaller pages, which may still be cached
+                    flush_tlb(entry_first, entry_last);
+                    smp_invalidate_tlb(canonical(entry_first), canonical(entry_last));
+                    free_table(old_address, depth + 1);
+                } else if (invalidate_pages) {
+                    processor::invalidatePage(canonical(entry_first));
+                }
+                ++num_replaced;
+            } else {
+                ++live_entries(node);
+            }
+        } else {
+            auto child = get_or_create_child(node, index, depth, flags);
+            num_replaced += map_entries(child, depth + 1, address, piece_last, frame, flags, invalidate_pages);
+        }
+        if (piece_last == last)
+            return num_replaced;
+        address = piece_last + 1;
+    }
+}
+
+auto PageTree::get_or_create_child(PageTreeNode *node, int index, int depth, PageFlags flags) -> PageTreeNode *
+{
+    const auto entry_flags = node->get_child_flags(index);
+    if (!has_flags(entry_flags, PageFlags::Present)) {
+        // a zeroed frame is already a valid node with no children, so it doesn't need to be
+        // constructed (which would zero it again on this path)
+        auto new_node_frame = allocate_zeroed_frame();
+        track_table(reinterpret_cast<uintptr_t>(new_node_frame), 0);
+        // use the physical frame address here: the page table uses physical addresses
+        node->set_child_address(index, reinterpret_cast<uintptr_t>(new_node_frame));
+        node->set_child_flags(index, table_flags(flags));
+        ++live_entries(node);
+        return reinterpret_cast<PageTreeNode *>(kernel_physical_to_virtual(new_node_frame));
+    }
+    if (has_flags(entry_flags, PageFlags::HugePage))
+        split_large_page(node, index, depth);
+    // append child flags, don't clear and set them since other pages deeper in the tree
+    // may depend on previously set flags
+    node->add_child_flags(index, table_flags(flags));
+    return node_at(node->get_child_address(index));
+}
+
+void PageTree::split_large_page(PageTreeNode *node, int index, int depth)
+{
+    const auto entry = node->get_entry(index);
+    const auto page_size = entry_size(depth);
+    const auto base = entry & PageTreeNode::address_mask & ~(page_size - 1);
+    // every flag carries over, except that bit 7 means PAT rather than HugePage in page tables
+    auto child_attributes = entry & ~PageTreeNode::address_mask;
+    if (depth + 1 == max_depth)
+        child_attributes &= ~static_cast<uint64_t>(PageFlags::HugePage);
+
+    auto table_frame = reinterpret_cast<uintptr_t>(allocate_frame());
+    track_table(table_frame, PageTreeNode::num_entries);
+    auto table = node_at(table_frame);
+    for (int i = 0; i < PageTreeNode::num_entries; ++i)
+        table->set_entry(i, (base + i * entry_size(depth + 1)) | child_attributes);
+
+    // the new table maps the same memory, so no TLB entries need to be invalidated
+    node->set_child_address(index, table_frame);
+    node->set_child_flags(index, table_flags(static_cast<PageFlags>(entry & PageTreeNode::flags_mask)));
+}
+
+void PageTree::free_table(uintptr_t table, int depth)
+{
+    if (depth < max_depth) {
+        auto node = node_at(table);
+        for (int i = 0; i < PageTreeNode::num_entries; ++i) {
+            const auto flags = node->get_child_flags(i);
+            if (has_flags(flags, PageFlags::Present) && !has_flags(flags, PageFlags::HugePage))
+                free_table(node->get_child_address(i), depth + 1);
+        }
+    }
+    release_table(table);
+}
+
+auto PageTree::share_copy_on_write(PageTree &source, uint64_t virtual_base, uint64_t length) -> size_t
+{
+    if (length == 0)
+        return 0;
+    const auto first = virtual_base;
+    const auto last = virtual_base + (length - 1);
+    const auto flush = should_flush_tlb(first, last);
+    size_t num_shared = 0;
+    const auto num_protected = share_entries(source.root_, root_, 0, first, last, !flush, num_shared);
+    if (num_protected > 0) {
+        if (flush)
+            flush_tlb(first, last);
+        smp_invalidate_tlb(canonical(first), canonical(last));
+    }
+    return num_shared;
+}
+
+auto PageTree::share_entries(PageTreeNode *source, PageTreeNode *destination, int depth, uint64_t first, uint64_t last, bool invalidate_pages, size_t &num_shared) -> size_t
+{
+    const auto write = static_cast<uint64_t>(PageFlags::Write);
+    const auto copy_on_write = static_cast<uint64_t>(PageFlags::CopyOnWrite);
+    size_t num_protected = 0;
+    const auto size = entry_size(depth);
+    for (auto address = first;;) {
+        const auto entry_first = address & ~(size - 1);
+        const auto piece_last = last < entry_first + (size - 1) ? last : entry_first + (size - 1);
+        const auto index = get_table_index(address, depth);
+        const auto flags = source->get_child_flags(index);
+
+        if (has_flags(flags, PageFlags::Present)) {
+            // frames are reference counted one at a time, so only 4 KiB pages are shared
+            if (depth < max_depth && has_flags(flags, PageFlags::HugePage))
+                split_large_page(source, index, depth);
+
+            if (depth == max_depth) {
+                auto entry = source->get_entry(index);
+                if (entry & write) {
+                    entry = (entry & ~write) | copy_on_write;
+                    source->set_entry(index, entry);
+                    if (invalidate_pages)
+                        processor::invalidatePage(canonical(entry_first));
+                    ++num_protected;
+                }
+                if (has_flags(destination->get_child_flags(index), PageFlags::Present))
+                    kernel_panic("copy-on-write page %x is already mapped\n", canonical(entry_first));
+                destination->set_entry(index, entry);
+                ++live_entries(destination);
+                update_frame_ref_count(entry & PageTreeNode::address_mask, 1);
+                ++num_shared;
+            } else {
+                auto child = get_or_create_child(destination, index, depth, flags);
+                num_protected += share_entries(node_at(source->get_child_address(index)), child, depth + 1,
+                    address, piece_last, invalidate_pages, num_shared);
+            }
+        }
+        if (piece_last == last)
+            return num_protected;
+        address = piece_last + 1;
+    }
+}
+
+void PageTree::allocate_upper_half()
+{
+    for (auto index = first_upper_half_entry; index < PageTreeNode::num_entries; ++index) {
+        if (!has_flags(root_->get_child_flags(index), PageFlags::Present)) {
+            const auto table = reinterpret_cast<uintptr_t>(allocate_zeroed_frame());
+            track_table(table, 0);
+            root_->set_child_address(index, table);
+            root_->set_child_flags(index, PageFlags::Write);
+            ++live_entries(root_);
+        }
+    }
+    upper_half_shared_ = true;
+}
+
+void PageTree::share_upper_half(PageTree &other)
+{
+    for (auto index = first_upper_half_entry; index < PageTreeNode::num_entries; ++index) {
+        if (!has_flags(other.root_->get_child_flags(index), PageFlags::Present))
+            kernel_panic("shared upper half of a page tree is not allocated\n");
+        if (!has_flags(root_->get_child_flags(index), PageFlags::Present))
+            ++live_entries(root_);
+        root_->set_entry(index, other.root_->get_entry(index));
+    }
+    upper_half_shared_ = true;
+}
+
+void PageTree::free_lower_half()
+{
+    for (int index = 0; index < first_upper_half_entry; ++index) {
+        if (has_flags(root_->get_child_flags(index), PageFlags::Present)) {
+            free_table(root_->get_child_address(index), 1);
+            --live_entries(root_);
+        }
+        root_->set_entry(index, 0);
+    }
 }
 
 auto PageTree::get_translation(uint64_t virtual_address) -> PageTranslation
 {
     PageTreeNode *curr = root_;
-    const int max_depth = 3;
-    for (int depth = 0; depth < max_depth; ++depth)
+    for (int depth = 0; depth <= max_depth; ++depth)
     {
         auto child_index = get_table_index(virtual_address, depth);
+        auto flags = curr->get_child_flags(child_index);
+        if (!has_flags(flags, PageFlags::Present))
+        {
+            return PageTranslation {0, PageFlags::None, 0};
+        }
         auto child_address = curr->get_child_address(child_index);
-        auto next = reinterpret_cast<PageTreeNode *>(kernel_physical_to_virtual(child_address));
-        if (!child_address)
+        if (depth == max_depth || has_flags(flags, PageFlags::HugePage))
         {
-            return PageTranslation {0, PageFlags::None};
+            // report the 4 KiB frame containing the address, even inside a large page
+            const auto page_size = entry_size(depth);
+            const auto frame_address = (child_address & ~(page_size - 1))
+                + (virtual_address & (page_size - 1) & ~uint64_t {0xfff});
+            const auto page_flags = depth == max_depth ? flags : flags & ~PageFlags::HugePage;
+            return PageTranslation {frame_address, page_flags, page_size};
         }
-        curr = next;
+        curr = node_at(child_address);
     }
+    return PageTranslation {0, PageFlags::None, 0};
+}
 
-    auto child_index = get_table_index(virtual_address, max_depth);
-    auto frame_address = curr->get_child_address(child_index);
-    auto flags = curr->get_child_flags(child_index);
-    return PageTranslation {frame_address, flags};
-}
\ No newline at end of file
+auto PageTree::stats() -> PageTableStats
+{
+    return PageTableStats {
+        .table_frames = table_counters.table_frames.load(std::memory_order_relaxed),
+        .peak_table_frames = table_counters.peak_table_frames.load(std::memory_order_relaxed),
+        .reclaimed_tables = table_counters.reclaimed_tables.load(std::memory_order_relaxed),
+    };
+}
@@ -6,16 +6,14 @@
 uintptr_t PageTreeNode::get_child_address(int index)
 {
     uint64_t entry = entries_[index];
-    // 32 bits starting at bit 12
-    uintptr_t child_address = (entry & (0xffffffff << 12));
+    uintptr_t child_address = entry & address_mask;
     return child_address;
 }
 
 void PageTreeNode::set_child_address(int index, uintptr_t address)
 {
-    uint64_t &entry = entries_[index];
-    entry &= (~0xffffffff) << 12;
-    entry |= address;
+    // the flags are reset as well: callers set them after the address
+    entries_[index] = address & address_mask;
 }
 
 void PageTreeNode::add_child_flags(int index, PageFlags flags)
@@ -29,12 +27,22 @@ void PageTreeNode::set_child_flags(int index, PageFlags flags)
 {
     uint64_t &entry = entries_[index];
     // clear flags
-    entry &= ~(0xff);
+    entry &= ~flags_mask;
     add_child_flags(index, flags);
 }
 
 auto PageTreeNode::get_child_flags(int index) -> PageFlags
 {
     uint64_t entry = entries_[index];
-    return static_cast<PageFlags>(entry & 0xff);
+    return static_cast<PageFlags>(entry & flags_mask);
+}
+
+auto PageTreeNode::get_entry(int index) -> uint64_t
+{
+    return entries_[index];
+}
+
+void PageTreeNode::set_entry(int index, uint64_t entry)
+{
+    entries_[index] = entry;
 }
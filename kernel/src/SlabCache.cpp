@@ -0,0 +1,240 @@
+#include <kernel/constants.h>
+#include <kernel/frame_allocator.h>
+#include <kernel/kernel.h>
+#include <kernel/limine_features.h>
+#include <kernel/SlabCache.h>
+
+namespace
+{
+
+constexpr auto round_up(size_t value, size_t alignment) -> size_t
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // anonymous namespace
+
+auto SlabCache::SlabList::push(Slab *slab) -> void
+{
+    slab->prev = nullptr;
+    slab->next = head;
+    if (head)
+        head->prev = slab;
+    head = slab;
+    ++length;
+}
+
+auto SlabCache::SlabList::remove(Slab *slab) -> void
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        head = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    --length;
+}
+
+SlabCache::SlabCache(const char *name, size_t object_size, size_t alignment, ObjectFunction constructor,
+    ObjectFunction destructor)
+    : name_ {name},
+      object_size_ {object_size},
+      constructor_ {constructor},
+      destructor_ {destructor}
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > kernelConstants::frameSize)
+        kernel_panic("invalid alignment %d of slab cache %s\n", static_cast<int>(alignment), name);
+    alignment = alignment < alignof(FreeObject) ? alignof(FreeObject) : alignment;
+    // a constructed object must not be overwritten by the link while it is free
+    link_offset_ = constructor ? round_up(object_size, alignof(FreeObject)) : 0;
+    const auto slot_size = constructor || object_size < sizeof(FreeObject)
+        ? link_offset_ + sizeof(FreeObject) : object_size;
+    object_stride_ = round_up(slot_size, alignment);
+    first_object_offset_ = round_up(sizeof(Slab), alignment);
+
+    while (slab_order_ < max_slab_order
+        && ((kernelConstants::frameSize << slab_order_) - first_object_offset_) / object_stride_ < min_objects_per_slab)
+    {
+        ++slab_order_;
+    }
+    objects_per_slab_ = ((kernelConstants::frameSize << slab_order_) - first_object_offset_) / object_stride_;
+    if (objects_per_slab_ == 0)
+        kernel_panic("objects of slab cache %s are too large (%d bytes)\n", name, static_cast<int>(object_size));
+}
+
+SlabCache::~SlabCache()
+{
+    if (objects_in_use_ != 0)
+        kernel_panic("slab cache %s destroyed with %d objects in use\n", name_, static_cast<int>(objects_in_use_));
+    reap();
+}
+
+auto SlabCache::allocate() -> void *
+{
+    SpinLockGuard guard {lock_};
+    return allocate_locked();
+}
+
+auto SlabCache::deallocate(void *object) -> void
+{
+    SpinLockGuard guard {lock_};
+    deallocate_locked(object);
+}
+
+auto SlabCache::allocate_batch(void **objects, size_t count) -> size_t
+{
+    SpinLockGuard guard {lock_};
+    for (size_t i = 0; i < count; ++i) {
+        objects[i] = allocate_locked();
+        if (!objects[i])
+            return i;
+    }
+    return count;
+}
+
+auto SlabCache::deallocate_batch(void *const *objects, size_t count) -> void
+{
+    SpinLockGuard guard {lock_};
+    for (size_t i = 0; i < count; ++i)
+        deallocate_locked(objects[i]);
+}
+
+auto SlabCache::allocate_locked() -> void *
+{
+    auto slab = partial_slabs_.head;
+    if (!slab) {
+        slab = empty_slabs_.head;
+        if (slab) {
+            empty_slabs_.remove(slab);
+        } else {
+            slab = create_slab();
+            if (!slab)
+                return nullptr;
+        }
+        partial_slabs_.push(slab);
+    }
+
+    auto link = slab->free_objects;
+    slab->free_objects = link->next;
+    if (++slab->objects_in_use == objects_per_slab_) {
+        partial_slabs_.remove(slab);
+        full_slabs_.push(slab);
+    }
+    ++objects_in_use_;
+    ++allocations_;
+    return object_of(link);
+}
+
+auto SlabCache::deallocate_locked(void *object) -> void
+{
+    auto slab = slab_of(object);
+    if (slab->cache != this)
+        kernel_panic("object %p freed to slab cache %s is not from it\n", object, name_);
+
+    auto link = link_of(object);
+    link->next = slab->free_objects;
+    slab->free_objects = link;
+    if (slab->objects_in_use-- == objects_per_slab_) {
+        full_slabs_.remove(slab);
+        partial_slabs_.push(slab);
+    }
+    if (slab->objects_in_use == 0) {
+        partial_slabs_.remove(slab);
+        empty_slabs_.push(slab);
+    }
+    --objects_in_use_;
+    ++frees_;
+}
+
+auto SlabCache::reap() -> size_t
+{
+    SpinLockGuard guard {lock_};
+    auto num_slabs = size_t {0};
+    while (auto slab = empty_slabs_.head) {
+        empty_slabs_.remove(slab);
+        free_slab(slab);
+        ++num_slabs;
+    }
+    return num_slabs;
+}
+
+auto SlabCache::stats() -> SlabCacheStats
+{
+    SpinLockGuard guard {lock_};
+    auto stats = SlabCacheStats {};
+    stats.slabs = partial_slabs_.length + full_slabs_.length + empty_slabs_.length;
+    stats.empty_slabs = empty_slabs_.length;
+    stats.objects = stats.slabs * objects_per_slab_;
+    stats.objects_in_use = objects_in_use_;
+    stats.allocations = allocations_;
+    stats.frees = frees_;
+    return stats;
+}
+
+auto SlabCache::cache_of(const void *object) -> SlabCache *
+{
+    const auto physical = reinterpret_cast<uintptr_t>(object) - limine::hhdm_address->offset;
+    const auto &info = frame_info(physical / kernelConstants::frameSize * kernelConstants::frameSize);
+    if (!info.has_flags(FrameFlags::Slab))
+        return nullptr;
+    return reinterpret_cast<Slab *>(info.owner)->cache;
+}
+
+auto SlabCache::create_slab() -> Slab *
+{
+    const auto frames = allocate_frames(slab_order_);
+    if (!frames)
+        return nullptr;
+    auto slab = new(kernel_physical_to_virtual(frames)) Slab {};
+    slab->cache = this;
+    for (size_t i = 0; i < (size_t {1} << slab_order_); ++i) {
+        auto &info = frame_info(reinterpret_cast<uintptr_t>(frames) + i * kernelConstants::frameSize);
+        info.flags = info.flags | FrameFlags::Slab;
+        info.owner = reinterpret_cast<uintptr_t>(slab);
+    }
+
+    // link the objects in reverse, so that they are handed out in address order
+    const auto first_object = reinterpret_cast<uintptr_t>(slab) + first_object_offset_;
+    for (auto i = objects_per_slab_; i-- > 0;) {
+        auto object = reinterpret_cast<void *>(first_object + i * object_stride_);
+        if (constructor_)
+            constructor_(object);
+        auto link = link_of(object);
+        link->next = slab->free_objects;
+        slab->free_objects = link;
+    }
+    return slab;
+}
+
+auto SlabCache::free_slab(Slab *slab) -> void
+{
+    if (destructor_) {
+        for (auto link = slab->free_objects; link; link = link->next)
+            destructor_(object_of(link));
+    }
+    const auto physical = reinterpret_cast<uintptr_t>(slab) - limine::hhdm_address->offset;
+    for (size_t i = 0; i < (size_t {1} << slab_order_); ++i) {
+        auto &info = frame_info(physical + i * kernelConstants::frameSize);
+        info.flags = info.flags & ~FrameFlags::Slab;
+        info.owner = 0;
+    }
+    deallocate_frames(reinterpret_cast<void *>(physical), slab_order_);
+}
+
+auto SlabCache::slab_of(void *object) const -> Slab *
+{
+    // slabs are aligned to their size, both physically and (since the HHDM offset is aligned to
+    // a much larger size) in the HHDM
+    const auto slab_size = kernelConstants::frameSize << slab_order_;
+    return reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(object) & ~(slab_size - 1));
+}
+
+auto SlabCache::link_of(void *object) const -> FreeObject *
+{
+    return reinterpret_cast<FreeObject *>(reinterpret_cast<uintptr_t>(object) + link_offset_);
+}
+
+auto SlabCache::object_of(FreeObject *link) const -> void *
+{
+    return reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(link) - link_offset_);
+}
@@ -0,0 +1,290 @@
+#include <kernel/constants.h>
+#include <kernel/kernel.h>
+#include <kernel/VirtualMemoryAllocator.h>
+
+namespace
+{
+
+constexpr auto page_size = uint64_t {kernelConstants::pageSize};
+
+/**
+ * @brief Get the smallest order of a block holding the given number of pages.
+ */
+auto order_for_pages(uint64_t pages) -> uint8_t
+{
+    auto order = uint8_t {0};
+    while ((uint64_t {1} << order) < pages)
+        ++order;
+    return order;
+}
+
+} // anonymous namespace
+
+auto VirtualMemoryAllocator::metadata_size(uint64_t size) -> uint64_t
+{
+    const auto pages = size / page_size;
+    return (pages < max_pages ? pages : max_pages) * sizeof(BlockInfo);
+}
+
+VirtualMemoryAllocator::VirtualMemoryAllocator(void *start_address, uint64_t size, BlockInfo *block_infos)
+    : block_infos_ {block_infos}
+{
+    const auto start = reinterpret_cast<uintptr_t>(start_address);
+    // only whole pages inside the range can be allocated
+    const auto head = (page_size - start % page_size) % page_size;
+    begin_ = start + head;
+    num_pages_ = size < head ? 0 : (size - head) / page_size;
+    if (num_pages_ > max_pages)
+        num_pages_ = max_pages;
+    free_pages_ = num_pages_;
+    for (auto &head_block : free_lists_)
+        head_block = no_block;
+
+    // the pages before the first (and after the last) aligned block of the largest order are
+    // freed as smaller blocks now, and the aligned blocks are claimed as they are needed
+    const auto max_block_size = page_size << max_order;
+    const auto unaligned_pages = ((max_block_size - begin_ % max_block_size) % max_block_size) / page_size;
+    if (unaligned_pages >= num_pages_) {
+        deallocate_range(0, num_pages_);
+        return;
+    }
+    unclaimed_first_ = unaligned_pages;
+    unclaimed_pages_ = (num_pages_ - unaligned_pages) >> max_order << max_order;
+    deallocate_range(0, unclaimed_first_);
+    deallocate_range(unclaimed_first_ + unclaimed_pages_, num_pages_);
+}
+
+auto VirtualMemoryAllocator::allocate(uint64_t size) -> void *
+{
+    const auto pages = (size + page_size - 1) / page_size;
+    if (pages > (uint64_t {1} << max_order))
+        return allocate_run((pages + (uint64_t {1} << max_order) - 1) >> max_order);
+    const auto order = order_for_pages(pages);
+
+    // find the smallest free block that is large enough
+    auto current_order = order;
+    while (current_order <= max_order && free_lists_[current_order] == no_block)
+        ++current_order;
+    if (current_order > max_order) {
+        if (unclaimed_pages_ == 0)
+            return nullptr;
+        current_order = max_order;
+        push(static_cast<uint32_t>(unclaimed_first_), max_order);
+        unclaimed_first_ += uint64_t {1} << max_order;
+        unclaimed_pages_ -= uint64_t {1} << max_order;
+    }
+
+    const auto block = free_lists_[current_order];
+    remove(block, current_order);
+
+    // split the block in halves until it is the requested size, freeing the upper halves
+    while (current_order > order) {
+        --current_order;
+        push(block + (uint32_t {1} << current_order), current_order);
+    }
+    block_infos_[block] = BlockInfo {1, no_block, order, BlockState::Allocated};
+    free_pages_ -= uint64_t {1} << order;
+    return reinterpret_cast<void *>(address(block));
+}
+
+auto VirtualMemoryAllocator::allocate_run(uint64_t num_blocks) -> void *
+{
+    const auto pages = num_blocks << max_order;
+    auto block = static_cast<uint32_t>(unclaimed_first_);
+    if (pages > unclaimed_pages_) {
+        // look for free blocks of the largest order that were freed next to each other, possibly
+        // followed by the unclaimed pages
+        block = free_lists_[max_order];
+        while (block != no_block && !is_free_run(block, num_blocks))
+            block = block_infos_[block].next;
+        if (block == no_block)
+            return nullptr;
+    }
+    for (uint64_t i = 0; i < num_blocks; ++i) {
+        const auto run_block = block + (i << max_order);
+        if (run_block == unclaimed_first_) {
+            // the rest of the run is at the start of the unclaimed pages
+            const auto unclaimed_run_pages = pages - (i << max_order);
+            unclaimed_first_ += unclaimed_run_pages;
+            unclaimed_pages_ -= unclaimed_run_pages;
+            break;
+        }
+        remove(static_cast<uint32_t>(run_block), max_order);
+    }
+    block_infos_[block] = BlockInfo {static_cast<uint32_t>(num_blocks), no_block, max_order, BlockState::Allocated};
+    free_pages_ -= pages;
+    return reinterpret_cast<void *>(address(block));
+}
+
+auto VirtualMemoryAllocator::is_free_run(uint64_t block, uint64_t num_blocks) const -> bool
+{
+    for (uint64_t i = 0; i < num_blocks; ++i) {
+        const auto run_block = block + (i << max_order);
+        if (run_block == unclaimed_first_)
+            return unclaimed_pages_ >= (num_blocks - i) << max_order;
+        if (run_block >= num_pages_ || block_infos_[run_block].state != BlockState::Free
+            || block_infos_[run_block].order != max_order)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+auto VirtualMemoryAllocator::deallocate(void *ptr) -> void
+{
+    auto block = allocated_block(ptr);
+    auto order = block_infos_[block].order;
+    const auto num_blocks = block_infos_[block].next;
+    block_infos_[block].state = BlockState::None;
+    if (num_blocks > 1) {
+        const auto pages = uint64_t {num_blocks} << max_order;
+        free_pages_ += pages;
+        deallocate_run(block, pages);
+        return;
+    }
+    free_pages_ += uint64_t {1} << order;
+
+    // merge with the buddy for as long as the buddy is entirely free; buddies are found from the
+    // virtual addresses, since blocks are aligned to their size in the address space
+    while (order < max_order) {
+        const auto buddy_address = address(block) ^ (page_size << order);
+        const auto buddy_offset = buddy_address - begin_;
+        if (buddy_address < begin_ || buddy_offset / page_size >= num_pages_)
+            break;
+        const auto buddy = static_cast<uint32_t>(buddy_offset / page_size);
+        const auto &buddy_info = block_infos_[buddy];
+        if (buddy_info.state != BlockState::Free || buddy_info.order != order)
+            break;
+        remove(buddy, order);
+        block = block < buddy ? block : buddy;
+        ++order;
+    }
+    if (order == max_order)
+        deallocate_run(block, uint64_t {1} << max_order);
+    else
+        push(block, order);
+}
+
+auto VirtualMemoryAllocator::deallocate_run(uint64_t block, uint64_t pages) -> void
+{
+    const auto block_pages = uint64_t {1} << max_order;
+    if (block + pages != unclaimed_first_ && block != unclaimed_first_ + unclaimed_pages_
+        && unclaimed_pages_ != 0)
+    {
+        for (uint64_t offset = 0; offset < pages; offset += block_pages)
+            push(static_cast<uint32_t>(block + offset), max_order);
+        return;
+    }
+    // the run joins the unclaimed pages, together with the free blocks of the largest order
+    // around them, so that a longer run can be carved out of them again
+    if (unclaimed_pages_ == 0 || block < unclaimed_first_)
+        unclaimed_first_ = block;
+    unclaimed_pages_ += pages;
+    const auto is_free_block = [this](uint64_t candidate) {
+        return candidate < num_pages_ && block_infos_[candidate].state == BlockState::Free
+            && block_infos_[candidate].order == max_order;
+    };
+    while (unclaimed_first_ >= block_pages && is_free_block(unclaimed_first_ - block_pages)) {
+        unclaimed_first_ -= block_pages;
+        unclaimed_pages_ += block_pages;
+        remove(static_cast<uint32_t>(unclaimed_first_), max_order);
+    }
+    while (is_free_block(unclaimed_first_ + unclaimed_pages_)) {
+        remove(static_cast<uint32_t>(unclaimed_first_ + unclaimed_pages_), max_order);
+        unclaimed_pages_ += block_pages;
+    }
+}
+
+auto VirtualMemoryAllocator::allocation_size(void *ptr) const -> uint64_t
+{
+    const auto &block_info = block_infos_[allocated_block(ptr)];
+    return uint64_t {block_info.next} * (page_size << block_info.order);
+}
+
+auto VirtualMemoryAllocator::contains(void *ptr) const -> bool
+{
+    const auto offset = reinterpret_cast<uintptr_t>(ptr) - begin_;
+    return reinterpret_cast<uintptr_t>(ptr) >= begin_ && offset / page_size < num_pages_;
+}
+
+auto VirtualMemoryAllocator::is_allocated(void *ptr) const -> bool
+{
+    if (!contains(ptr))
+        return false;
+    // the block holding the address starts at the address rounded down to the block's size
+    auto top_block = uint64_t {0};
+    for (uint8_t order = 0; order <= max_order; ++order) {
+        const auto block_address = reinterpret_cast<uintptr_t>(ptr) & ~((page_size << order) - 1);
+        if (block_address < begin_)
+            return false;
+        top_block = (block_address - begin_) / page_size;
+        const auto &block_info = block_infos_[top_block];
+        if (block_info.state != BlockState::None && block_info.order == order)
+            return block_info.state == BlockState::Allocated;
+    }
+    // past the first block of a run, every block of the run is preceded by one of the same run
+    const auto page = (reinterpret_cast<uintptr_t>(ptr) - begin_) / page_size;
+    const auto block_pages = uint64_t {1} << max_order;
+    while (top_block >= block_pages
+        && !(top_block >= unclaimed_first_ && top_block < unclaimed_first_ + unclaimed_pages_))
+    {
+        top_block -= block_pages;
+        const auto &block_info = block_infos_[top_block];
+        if (block_info.state != BlockState::None)
+            return block_info.state == BlockState::Allocated && block_info.order == max_order
+                && page < top_block + (uint64_t {block_info.next} << max_order);
+    }
+    return false;
+}
+
+auto VirtualMemoryAllocator::address(uint32_t block) const -> uintptr_t
+{
+    return begin_ + block * page_size;
+}
+
+auto VirtualMemoryAllocator::allocated_block(void *ptr) const -> uint32_t
+{
+    const auto offset = reinterpret_cast<uintptr_t>(ptr) - begin_;
+    if (!contains(ptr) || offset % page_size != 0
+        || block_infos_[offset / page_size].state != BlockState::Allocated)
+    {
+        kernel_panic("invalid free of virtual memory at %p\n", ptr);
+    }
+    return static_cast<uint32_t>(offset / page_size);
+}
+
+auto VirtualMemoryAllocator::push(uint32_t block, uint8_t order) -> void
+{
+    block_infos_[block] = BlockInfo {free_lists_[order], no_block, order, BlockState::Free};
+    if (free_lists_[order] != no_block)
+        block_infos_[free_lists_[order]].prev = block;
+    free_lists_[order] = block;
+}
+
+auto VirtualMemoryAllocator::remove(uint32_t block, uint8_t order) -> void
+{
+    auto &block_info = block_infos_[block];
+    if (block_info.prev != no_block)
+        block_infos_[block_info.prev].next = block_info.next;
+    else
+        free_lists_[order] = block_info.next;
+    if (block_info.next != no_block)
+        block_infos_[block_info.next].prev = block_info.prev;
+    block_info.state = BlockState::None;
+}
+
+auto VirtualMemoryAllocator::deallocate_range(uint64_t first, uint64_t end) -> void
+{
+    while (first < end) {
+        // the largest block that starts at `first` and doesn't extend past `end`
+        auto order = max_order;
+        while (order > 0 && ((address(first) / page_size) % (uint64_t {1} << order) != 0
+            || first + (uint64_t {1} << order) > end))
+        {
+            --order;
+        }
+        push(static_cast<uint32_t>(first), order);
+        first += uint64_t {1} << order;
+    }
+}
@@ -0,0 +1,432 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <kpp/cstdio.hpp>
+#include <kpp/cstring.hpp>
+
+#include <kernel/benchmarks.h>
+#include <kernel/BitmapFrameAllocator.h>
+#include <kernel/BuddyFrameAllocator.h>
+#include <kernel/constants.h>
+#include <kernel/frame_allocator.h>
+#include <kernel/FreeListAllocator.h>
+#include <kernel/kernel.h>
+#include <kernel/kmalloc.h>
+#include <kernel/PageTree.h>
+#include <kernel/processor.hpp>
+#include <kernel/SlabCache.h>
+#include <kernel/smp.h>
+#include <kernel/VirtualMemoryAllocator.h>
+
+namespace
+{
+
+// the frame allocator benchmarks run on a private block of 2^arena_order frames (4 MiB)
+constexpr uint8_t arena_order = 10;
+constexpr size_t arena_frames = size_t {1} << arena_order;
+// not the zone identifier of any frame pool, so that the benchmarked buddy allocator never
+// mistakes the kernel's free blocks for its own
+constexpr uint8_t benchmark_zone = 0xff;
+
+struct FrameAllocatorTimings
+{
+    uint64_t single = 0;     // allocating every frame one at a time, then freeing them
+    uint64_t mixed = 0;      // allocating and freeing blocks of 1 to 8 frames at random
+    uint64_t contiguous = 0; // allocating every 64-frame block, then freeing them
+};
+
+/**
+ * @brief Get the smallest order of a block holding the given number of bytes.
+ */
+auto order_for_bytes(size_t bytes) -> uint8_t
+{
+    auto order = uint8_t {0};
+    while ((kernelConstants::frameSize << order) < bytes)
+        ++order;
+    return order;
+}
+
+/**
+ * @brief Run the frame allocator workloads on `allocator`, which manages (at least) the arena
+ * and has no free frames. `blocks` must have room for one entry per frame of the arena.
+ */
+template <typename Allocator>
+auto time_frame_allocator(Allocator &allocator, uintptr_t arena, uintptr_t *blocks) -> FrameAllocatorTimings
+{
+    auto timings = FrameAllocatorTimings {};
+    allocator.deallocate_range(arena, arena + arena_frames * kernelConstants::frameSize);
+
+    auto start = processor::readTimestampCounter();
+    for (size_t i = 0; i < arena_frames; ++i)
+        blocks[i] = allocator.allocate(0);
+    for (size_t i = 0; i < arena_frames; ++i)
+        allocator.deallocate(blocks[i], 0);
+    timings.single = (processor::readTimestampCounter() - start) / (2 * arena_frames);
+
+    // each slot holds an allocated block (with its order in the low bits) or 0
+    constexpr size_t num_slots = arena_frames / 8;
+    constexpr size_t num_operations = 4 * arena_frames;
+    for (size_t i = 0; i < num_slots; ++i)
+        blocks[i] = 0;
+    auto random = uint64_t {0x2545'f491'4f6c'dd1d};
+    start = processor::readTimestampCounter();
+    for (size_t i = 0; i < num_operations; ++i) {
+        random = random * 6364136223846793005 + 1442695040888963407;
+        auto &slot = blocks[(random >> 33) % num_slots];
+        if (slot) {
+            allocator.deallocate(slot & ~uintptr_t {0xfff}, slot & 0xfff);
+            slot = 0;
+        } else {
+            const auto order = static_cast<uint8_t>((random >> 60) % 4);
+            const auto block = allocator.allocate(order);
+            slot = block ? block | order : 0;
+        }
+    }
+    for (size_t i = 0; i < num_slots; ++i) {
+        if (blocks[i])
+            allocator.deallocate(blocks[i] & ~uintptr_t {0xfff}, blocks[i] & 0xfff);
+    }
+    timings.mixed = (processor::readTimestampCounter() - start) / num_operations;
+
+    auto num_blocks = size_t {0};
+    start = processor::readTimestampCounter();
+    while (auto block = allocator.allocate(6))
+        blocks[num_blocks++] = block;
+    for (size_t i = 0; i < num_blocks; ++i)
+        allocator.deallocate(blocks[i], 6);
+    timings.contiguous = num_blocks == 0 ? 0 : (processor::readTimestampCounter() - start) / (2 * num_blocks);
+    return timings;
+}
+
+/**
+ * @brief Clear the state that a benchmarked allocator left in the metadata of the arena's
+ * frames, and restore the metadata of the (allocated) arena block itself.
+ */
+void reset_arena_frame_infos(uintptr_t arena, uint8_t arena_zone)
+{
+    for (size_t i = 0; i < arena_frames; ++i)
+        frame_info(arena + i * kernelConstants::frameSize).flags = FrameFlags::None;
+    frame_info(arena).order = arena_order;
+    frame_info(arena).zone = arena_zone;
+}
+
+void print_timings(const char *name, FrameAllocatorTimings const &timings)
+{
+    kpp::printf("  %s: single %d, mixed %d, contiguous %d\n", name, static_cast<int>(timings.single),
+        static_cast<int>(timings.mixed), static_cast<int>(timings.contiguous));
+}
+
+// the page mapping benchmarks map this many bytes at a time (in a page tree that isn't loaded,
+// so none of the mapped memory is accessed)
+constexpr uint64_t mapping_length = uint64_t {1} << 30;
+constexpr uint64_t mapping_pages = mapping_length / kernelConstants::pageSize;
+constexpr uint64_t mapping_base = 0x7000'0000'0000;
+
+/**
+ * @brief Get the number of 4 KiB pages per second processed by an operation on mapping_length
+ * bytes that took the given number of cycles.
+ */
+auto pages_per_second(uint64_t cycles) -> uint64_t
+{
+    return cycles == 0 ? 0 : mapping_pages * processor::timestampCounterFrequency() / cycles;
+}
+
+void print_mapping_throughput(const char *name, uint64_t map_cycles, uint64_t unmap_cycles)
+{
+    // in thousands of pages, since %d is limited to an int
+    kpp::printf("  %s: map %dK pages/s, unmap %dK pages/s\n", name,
+        static_cast<int>(pages_per_second(map_cycles) / 1000),
+        static_cast<int>(pages_per_second(unmap_cycles) / 1000));
+}
+
+struct VirtualAllocatorTimings
+{
+    uint64_t mixed = 0;      // allocating and freeing blocks of 1 to 4 pages at random
+    uint64_t fragmented = 0; // allocating and freeing 2-page blocks with many 1-page holes
+};
+
+/**
+ * @brief Run the virtual memory allocator workloads on `allocator`, which manages the arena.
+ * `blocks` must have room for one entry per page of the arena.
+ */
+template <typename Allocator>
+auto time_virtual_allocator(Allocator &allocator, uintptr_t *blocks) -> VirtualAllocatorTimings
+{
+    using Pointer = decltype(allocator.allocate(0));
+    auto timings = VirtualAllocatorTimings {};
+
+    // at most a quarter of the arena is allocated at any time, so that the free list (whose
+    // blocks have headers) never runs out
+    constexpr size_t num_slots = arena_frames / 16;
+    constexpr size_t num_operations = 4 * arena_frames;
+    for (size_t i = 0; i < num_slots; ++i)
+        blocks[i] = 0;
+    auto random = uint64_t {0x2545'f491'4f6c'dd1d};
+    auto start = processor::readTimestampCounter();
+    for (size_t i = 0; i < num_operations; ++i) {
+        random = random * 6364136223846793005 + 1442695040888963407;
+        auto &slot = blocks[(random >> 33) % num_slots];
+        if (slot) {
+            allocator.deallocate(reinterpret_cast<Pointer>(slot));
+            slot = 0;
+        } else {
+            const auto pages = (random >> 60) % 4 + 1;
+            slot = reinterpret_cast<uintptr_t>(allocator.allocate(pages * kernelConstants::pageSize));
+        }
+    }
+    for (size_t i = 0; i < num_slots; ++i) {
+        if (blocks[i])
+            allocator.deallocate(reinterpret_cast<Pointer>(blocks[i]));
+    }
+    timings.mixed = (processor::readTimestampCounter() - start) / num_operations;
+
+    // fill (almost) the whole arena with pages, then free a run of pages at one end and every
+    // other page of the rest: every free hole is a page, too small for the 2-page blocks
+    constexpr size_t num_pages = arena_frames - 4;
+    constexpr size_t num_run_pages = arena_frames / 4;
+    constexpr size_t num_large_blocks = arena_frames / 16;
+    for (size_t i = 0; i < num_pages; ++i)
+        blocks[i] = reinterpret_cast<uintptr_t>(allocator.allocate(kernelConstants::pageSize));
+    for (size_t i = 0; i < num_pages; ++i) {
+        if (i < num_run_pages || i % 2 == 0)
+            allocator.deallocate(reinterpret_cast<Pointer>(blocks[i]));
+    }
+    start = processor::readTimestampCounter();
+    for (size_t i = 0; i < num_large_blocks; ++i)
+        blocks[i] = reinterpret_cast<uintptr_t>(allocator.allocate(2 * kernelConstants::pageSize));
+    for (size_t i = 0; i < num_large_blocks; ++i)
+        allocator.deallocate(reinterpret_cast<Pointer>(blocks[i]));
+    timings.fragmented = (processor::readTimestampCounter() - start) / (2 * num_large_blocks);
+    for (size_t i = num_run_pages + 1; i < num_pages; i += 2)
+        allocator.deallocate(reinterpret_cast<Pointer>(blocks[i]));
+    return timings;
+}
+
+// the object allocator benchmarks allocate this many objects of object_size bytes at a time
+constexpr size_t num_objects = 1024;
+constexpr size_t object_size = 64;
+
+/**
+ * @brief Allocate num_objects objects with `allocate`, then free them with `deallocate` in a
+ * scattered order, and get the average number of cycles per operation.
+ */
+template <typename Allocate, typename Deallocate>
+auto time_object_allocator(Allocate allocate, Deallocate deallocate, uintptr_t *objects) -> uint64_t
+{
+    // once to warm up the allocator (e.g. create slabs), then timed
+    auto cycles = uint64_t {0};
+    for (int round = 0; round < 2; ++round) {
+        const auto start = processor::readTimestampCounter();
+        for (size_t i = 0; i < num_objects; ++i)
+            objects[i] = reinterpret_cast<uintptr_t>(allocate());
+        // 389 is odd, so this visits every object once
+        for (size_t i = 0; i < num_objects; ++i)
+            deallocate(objects[i * 389 % num_objects]);
+        cycles = processor::readTimestampCounter() - start;
+    }
+    return cycles / (2 * num_objects);
+}
+
+// in the scaling benchmark, every processor allocates scaling_batch objects of object_size bytes
+// and frees them, scaling_rounds times
+constexpr size_t scaling_batch = 16;
+constexpr size_t scaling_rounds = 4096;
+
+/**
+ * @brief Run the scaling workload on the processors 0 to `cpus` - 1 at once, allocating from
+ * `shared` (or with kmalloc if it is nullptr), and get the number of cycles it took per
+ * allocation and free of one processor.
+ */
+auto time_scaling(SlabCache *shared, uint32_t cpus) -> uint64_t
+{
+    const auto start = processor::readTimestampCounter();
+    smp_run([](void *argument) {
+        auto shared = static_cast<SlabCache *>(argument);
+        void *objects[scaling_batch] = {};
+        for (size_t round = 0; round < scaling_rounds; ++round) {
+            for (auto &object : objects)
+                object = shared ? shared->allocate() : kmalloc(object_size);
+            for (auto object : objects) {
+                if (shared)
+                    shared->deallocate(object);
+                else
+                    kfree(object);
+            }
+        }
+    }, shared, cpus);
+    return (processor::readTimestampCounter() - start) / (scaling_rounds * scaling_batch);
+}
+
+void print_timings(const char *name, VirtualAllocatorTimings const &timings)
+{
+    kpp::printf("  %s: mixed %d, fragmented %d\n", name, static_cast<int>(timings.mixed),
+        static_cast<int>(timings.fragmented));
+}
+
+} // anonymous namespace
+
+void benchmark_frame_allocators()
+{
+    const auto arena = reinterpret_cast<uintptr_t>(allocate_frames(arena_order));
+    const auto arena_end = arena + arena_frames * kernelConstants::frameSize;
+    const auto storage_words = BitmapFrameAllocator::storage_words(arena, arena_end);
+    const auto storage_order = order_for_bytes(storage_words * sizeof(uint64_t));
+    const auto blocks_order = order_for_bytes(arena_frames * sizeof(uintptr_t));
+    const auto storage = allocate_frames(storage_order);
+    const auto blocks = allocate_frames(blocks_order);
+    if (!arena || !storage || !blocks)
+        kernel_panic("not enough contiguous memory for the frame allocator benchmark\n");
+
+    const auto arena_zone = frame_info(arena).zone;
+    auto block_list = reinterpret_cast<uintptr_t *>(kernel_physical_to_virtual(blocks));
+
+    auto buddy = BuddyFrameAllocator {arena_end, &frame_info(0), benchmark_zone};
+    const auto buddy_timings = time_frame_allocator(buddy, arena, block_list);
+    reset_arena_frame_infos(arena, arena_zone);
+
+    auto bitmap = BitmapFrameAllocator {arena, arena_end, &frame_info(0), benchmark_zone,
+        reinterpret_cast<uint64_t *>(kernel_physical_to_virtual(storage))};
+    const auto bitmap_timings = time_frame_allocator(bitmap, arena, block_list);
+    reset_arena_frame_infos(arena, arena_zone);
+
+    kpp::printf("frame allocators (%d frames, cycles per operation):\n", static_cast<int>(arena_frames));
+    print_timings("buddy", buddy_timings);
+    print_timings("bitmap", bitmap_timings);
+
+    deallocate_frames(blocks, blocks_order);
+    deallocate_frames(storage, storage_order);
+    deallocate_frames(reinterpret_cast<void *>(arena), arena_order);
+}
+
+void benchmark_virtual_allocators()
+{
+    // both allocators manage a block of memory reached through the HHDM, since the free list
+    // keeps its headers in the memory it manages
+    const auto arena = allocate_frames(arena_order);
+    const auto blocks_order = order_for_bytes(arena_frames * sizeof(uintptr_t));
+    const auto metadata_order = order_for_bytes(VirtualMemoryAllocator::metadata_size(
+        arena_frames * kernelConstants::pageSize));
+    const auto blocks = allocate_frames(blocks_order);
+    const auto metadata = allocate_frames(metadata_order);
+    if (!arena || !blocks || !metadata)
+        kernel_panic("not enough contiguous memory for the virtual memory allocator benchmark\n");
+    const auto arena_base = kernel_physical_to_virtual(arena);
+    const auto arena_size = arena_frames * kernelConstants::pageSize;
+    auto block_list = reinterpret_cast<uintptr_t *>(kernel_physical_to_virtual(blocks));
+
+    auto free_list = FreeListAllocator<std::byte> {};
+    free_list.add_memory(reinterpret_cast<std::byte *>(arena_base), arena_size);
+    const auto free_list_timings = time_virtual_allocator(free_list, block_list);
+
+    kpp::memset(kernel_physical_to_virtual(metadata), 0, kernelConstants::frameSize << metadata_order);
+    auto buddy = VirtualMemoryAllocator {arena_base, arena_size,
+        reinterpret_cast<VirtualMemoryAllocator::BlockInfo *>(kernel_physical_to_virtual(metadata))};
+    const auto buddy_timings = time_virtual_allocator(buddy, block_list);
+
+    kpp::printf("virtual memory allocators (%d pages, cycles per operation):\n", static_cast<int>(arena_frames));
+    print_timings("free list", free_list_timings);
+    print_timings("buddy", buddy_timings);
+
+    deallocate_frames(metadata, metadata_order);
+    deallocate_frames(blocks, blocks_order);
+    deallocate_frames(arena, arena_order);
+}
+
+void benchmark_slab_cache()
+{
+    const auto arena = allocate_frames(arena_order);
+    const auto objects_order = order_for_bytes(num_objects * sizeof(uintptr_t));
+    const auto objects = allocate_frames(objects_order);
+    if (!arena || !objects)
+        kernel_panic("not enough contiguous memory for the slab cache benchmark\n");
+    auto object_list = reinterpret_cast<uintptr_t *>(kernel_physical_to_virtual(objects));
+
+    auto free_list = FreeListAllocator<std::byte> {};
+    free_list.add_memory(reinterpret_cast<std::byte *>(kernel_physical_to_virtual(arena)),
+        arena_frames * kernelConstants::frameSize);
+    const auto free_list_cycles = time_object_allocator(
+        [&] { return free_list.allocate(object_size); },
+        [&](uintptr_t object) { free_list.deallocate(reinterpret_cast<std::byte *>(object)); },
+        object_list);
+
+    auto cache = SlabCache {"benchmark objects", object_size};
+    const auto slab_cycles = time_object_allocator(
+        [&] { return cache.allocate(); },
+        [&](uintptr_t object) { cache.deallocate(reinterpret_cast<void *>(object)); },
+        object_list);
+    cache.reap();
+
+    kpp::printf("object allocators (%d objects of %d bytes, cycles per operation):\n",
+        static_cast<int>(num_objects), static_cast<int>(object_size));
+    kpp::printf("  free list: %d\n", static_cast<int>(free_list_cycles));
+    kpp::printf("  slab cache: %d\n", static_cast<int>(slab_cycles));
+
+    deallocate_frames(objects, objects_order);
+    deallocate_frames(arena, arena_order);
+}
+
+void benchmark_kmalloc_scaling()
+{
+    auto shared = SlabCache {"benchmark shared objects", object_size};
+    const auto online = smp_cpu_count();
+    kpp::printf("kmalloc scaling (%d allocations and frees of %d bytes per processor, cycles per "
+        "pair):\n", static_cast<int>(scaling_rounds * scaling_batch), static_cast<int>(object_size));
+    for (uint32_t cpus = 1; cpus <= online; cpus *= 2) {
+        // warm up both (create slabs, fill the processor caches), then time them
+        time_scaling(&shared, cpus);
+        const auto shared_cycles = time_scaling(&shared, cpus);
+        time_scaling(nullptr, cpus);
+        const auto kmalloc_cycles = time_scaling(nullptr, cpus);
+        kpp::printf("  %d processors: shared slab cache %d, kmalloc %d\n", static_cast<int>(cpus),
+            static_cast<int>(shared_cycles), static_cast<int>(kmalloc_cycles));
+    }
+    shared.reap();
+}
+
+void benchmark_page_mapping()
+{
+    const auto root = allocate_zeroed_frame();
+    auto tree = PageTree {reinterpret_cast<void *>(kernel_physical_to_virtual(root))};
+
+    // one walk of the tree per page
+    auto start = processor::readTimestampCounter();
+    for (uint64_t page = 0; page < mapping_length; page += kernelConstants::pageSize)
+        tree.map_page_to_frame(mapping_base + page, page, PageFlags::Write);
+    const auto single_map = processor::readTimestampCounter() - start;
+    start = processor::readTimestampCounter();
+    tree.unmap_range(mapping_base, mapping_length, nullptr);
+    const auto single_unmap = processor::readTimestampCounter() - start;
+
+    // the frames are misaligned by one page, so that only 4 KiB pages can be used
+    start = processor::readTimestampCounter();
+    tree.map_range(mapping_base, kernelConstants::pageSize, mapping_length, PageFlags::Write);
+    const auto range_map = processor::readTimestampCounter() - start;
+    start = processor::readTimestampCounter();
+    tree.unmap_range(mapping_base, mapping_length, nullptr);
+    const auto range_unmap = processor::readTimestampCounter() - start;
+
+    start = processor::readTimestampCounter();
+    tree.map_range(mapping_base, 0, mapping_length, PageFlags::Write);
+    const auto large_map = processor::readTimestampCounter() - start;
+    start = processor::readTimestampCounter();
+    tree.unmap_range(mapping_base, mapping_length, nullptr);
+    const auto large_unmap = processor::readTimestampCounter() - start;
+
+    kpp::printf("page mapping (1 GiB, 4 KiB pages per second):\n");
+    print_mapping_throughput("page by page", single_map, single_unmap);
+    print_mapping_throughput("range", range_map, range_unmap);
+    print_mapping_throughput("range, large pages", large_map, large_unmap);
+
+    // the unmaps freed every table below the root
+    deallocate_frame(root);
+}
+
+void run_all_benchmarks()
+{
+    kpp::printf("running benchmarks...\n");
+    benchmark_frame_allocators();
+    benchmark_virtual_allocators();
+    benchmark_slab_cache();
+    benchmark_kmalloc_scaling();
+    benchmark_page_mapping();
+}
@@ -1,32 +1,195 @@
 /**
  * @file frame_allocator.cpp
- * @brief A frame allocator implemented using a free stack.
+ * @brief A frame allocator implemented using a binary buddy allocator.
  * 
- * The allocator maintains a stack containing the addresses of available frames.
- * Allocating a new frame pops from the stack.
- * Deallocating a frame pushes the address of the frame to the stack.
- * Initially, the stack contains the addresses of all available after booting.
+ * Free memory is kept in power-of-two sized blocks of frames (orders 0 to 18, i.e. 4 KiB to 1 GiB).
+ * Allocating a block splits the smallest sufficiently large free block in halves until it
+ * is the requested size. Deallocating a block merges it with its buddy for as long as the buddy
+ * is also free, so that large contiguous runs of frames are rebuilt as memory is returned.
+ * Initially, the allocator contains all frames available after booting.
+ *
+ * Memory is split into zones (below 16 MiB, below 4 GiB, and the rest) on each NUMA node, and
+ * every zone of every node has its own buddy allocator ("frame pool") and lock. Allocations
+ * try the zones of the current processor's node first, from the highest zone the caller
+ * accepts down to the lowest, so that scarce low memory is only used when nothing else is left,
+ * and only then fall back to the other nodes.
+ *
+ * Memory that isn't usable yet or must never be handed out (firmware, ACPI tables, the
+ * framebuffer, MMIO, the bootloader, the kernel image and the allocator's own metadata) is
+ * recorded in a registry of reserved ranges. Reclaimable ranges are released to the allocator in
+ * bulk once they are no longer needed (e.g. ACPI tables after they have been parsed).
+ *
+ * When no free block is large enough for a multi-frame allocation, the allocator compacts
+ * memory: it looks for an aligned block that only contains free and movable frames (frames
+ * mapped at a single virtual address), copies the movable frames elsewhere, and remaps them
+ * through a handler registered by the paging code, freeing the whole block.
+ *
+ * The free frames of a pool can be tracked with a bitmap instead (BitmapFrameAllocator, selected
+ * by building with FRAME_ALLOCATOR=bitmap), trading coalescing on free for a scan on allocation.
+ *
+ * Single frames are served from a per-processor cache (a "magazine") in front of the buddy
+ * allocator. Allocating and freeing a frame only touches the current processor's magazine;
+ * the shared buddy allocator (and its lock) is only touched to refill an empty magazine or
+ * drain a full one, a batch of frames at a time. A processor that finds the pools empty
+ * drains the other processors' magazines before giving up.
+ *
+ * Every managed frame has an entry in a metadata array indexed by physical frame number,
+ * holding its reference count and allocator state. Allocated blocks start with a reference
+ * count of 1, and are freed when the count drops back to 0.
+ *
+ * A pool of frames that have already been filled with zeros is kept for callers that need
+ * zeroed memory (e.g. new page tables). The pool is refilled when the kernel is idle, so that
+ * the cost of zeroing a frame is usually paid outside of page faults and mapping operations.
+ *
+ * The allocator keeps counters (allocations, frees, frames in use and their peak, and a
+ * histogram of allocation latencies) that are exposed through frame_allocator_stats. Counters
+ * that would be shared by every processor on the single-frame path are kept per processor.
  */
 
+#include <atomic>
 #include <cstddef>
 #include <kpp/cstdio.hpp>
 
 #include <kpp/algorithm.hpp>
+#include <kpp/cstring.hpp>
 #include <kpp/optional.hpp>
-#include <kpp/NonOwningStack.hpp>
+#include <kernel/BitmapFrameAllocator.h>
+#include <kernel/BuddyFrameAllocator.h>
 #include <kernel/constants.h>
 #include <kernel/frame_allocator.h>
 #include <kernel/kernel.h>
 #include <kernel/limine_features.h>
 #include <kernel/macros.h>
+#include <kernel/numa.h>
+#include <kernel/processor.hpp>
+#include <kernel/SpinLock.h>
 
-static auto free_stack = kpp::Optional<kpp::NonOwningStack> {};
+#ifdef FRAME_ALLOCATOR_BITMAP
+using FramePoolAllocator = BitmapFrameAllocator;
+#else
+using FramePoolAllocator = BuddyFrameAllocator;
+#endif
 
-struct FrameRange {
+/**
+ * @brief The free frames of one memory zone on one NUMA node.
+ */
+struct FramePool {
+    kpp::Optional<FramePoolAllocator> allocator {};
+    SpinLock lock {};
+    MemoryZone zone {};
+};
+
+static auto frame_pools = kpp::Array<FramePool, max_numa_nodes * num_memory_zones> {};
+static auto frame_infos = static_cast<FrameInfo *>(nullptr);
+static auto num_frame_infos = size_t {0};
+static auto managed_memory_end = uintptr_t {0};
+
+static auto frame_migration_handler = FrameMigrationHandler {nullptr};
+static auto compaction_counters = CompactionStats {};
+
+static_assert(FramePoolAllocator::max_order == max_frame_order);
+
+/**
+ * @brief Allocator-wide counters behind frame_allocator_stats. Single-frame allocations and
+ * frees are counted in the per-processor magazines instead.
+ */
+struct FrameAllocatorCounters {
+    uint64_t init_cycles = 0;
+    size_t managed_frames = 0; // only updated with the reserved range registry's lock held
+    std::atomic<uint64_t> block_allocations {0};
+    std::atomic<uint64_t> block_frees {0};
+    std::atomic<uint64_t> failed_allocations {0};
+    std::atomic<int64_t> used_frames {0};
+    std::atomic<int64_t> peak_used_frames {0};
+};
+
+static auto allocator_counters = FrameAllocatorCounters {};
+
+/**
+ * @brief Get the index of the frame pool for the given node and zone. The index is also the
+ * zone identifier stored in the metadata of the blocks owned by the pool.
+ */
+static constexpr auto pool_index(uint8_t node, MemoryZone zone) -> uint8_t
+{
+    return node * num_memory_zones + static_cast<uint8_t>(zone);
+}
+
+/**
+ * @brief Get the first physical address of the given zone.
+ */
+static constexpr auto zone_begin(MemoryZone zone) -> uintptr_t
+{
+    switch (zone) {
+    case MemoryZone::DMA32: return uintptr_t {16} << 20;
+    case MemoryZone::Normal: return uintptr_t {4} << 30;
+    default: return 0;
+    }
+}
+
+/**
+ * @brief Get the one-past-the-end physical address of the given zone.
+ */
+static constexpr auto zone_end(MemoryZone zone) -> uintptr_t
+{
+    switch (zone) {
+    case MemoryZone::DMA: return uintptr_t {16} << 20;
+    case MemoryZone::DMA32: return uintptr_t {4} << 30;
+    default: return UINTPTR_MAX;
+    }
+}
+
+/**
+ * @brief A processor-local stack of free frames. The lock is only contended when another
+ * processor runs out of memory and takes the frames back to the pools.
+ */
+struct FrameMagazine {
+    static constexpr size_t capacity = 64;
+    // number of frames moved between the magazine and the buddy allocator at once
+    static constexpr size_t batch_size = capacity / 2;
+
+    kpp::Array<uintptr_t, capacity> frames {};
+    size_t count = 0;
+    FrameCacheStats stats {};
+    SpinLock lock {};
+};
+
+static auto frame_magazines = kpp::Array<FrameMagazine, processor::maxCPUs> {};
+
+/**
+ * @brief A stack of allocated frames whose contents are known to be zero.
+ */
+struct ZeroedFramePool {
+    static constexpr size_t capacity = 256;
+
+    kpp::Array<uintptr_t, capacity> frames {};
+    size_t count = 0;
+    SpinLock lock {};
+};
+
+static auto zeroed_frame_pool = ZeroedFramePool {};
+
+struct PhysicalRange {
     uintptr_t begin;
     uintptr_t end;
 };
 
+/**
+ * @brief The ranges of physical memory that must not be handed out by the allocator.
+ */
+struct ReservedRangeRegistry {
+    static constexpr size_t capacity = 64;
+
+    kpp::Array<ReservedRange, capacity> ranges {};
+    size_t count = 0;
+    SpinLock lock {};
+
+    // copy of the usable ranges of the memory map, which lives in bootloader-reclaimable memory
+    kpp::Array<PhysicalRange, capacity> usable_ranges {};
+    size_t usable_count = 0;
+};
+
+static auto reserved_ranges = ReservedRangeRegistry {};
+
 /**
  * @brief Check if an entry in the Limine memory map is allocatable (available for use)
  */
@@ -50,6 +213,83 @@ static size_t get_num_allocatable_frames()
     return allocatable_frames;
 }
 
+/**
+ * @brief Check if the memory of an entry in the Limine memory map can be handed out by the
+ * allocator once it is released (see release_reserved_frames).
+ */
+static bool is_reclaimable(struct limine_memmap_entry *entry)
+{
+    return entry->type == LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE
+        || entry->type == LIMINE_MEMMAP_ACPI_RECLAIMABLE;
+}
+
+/**
+ * @brief Get the one-past-the-end physical address of the memory that the allocator
+ * will ever manage (usable memory, and reclaimable memory that is freed later).
+ */
+static uintptr_t get_managed_memory_end()
+{
+    uintptr_t managed_end = 0;
+    for (size_t i = 0; i < limine::memory_map->entry_count; ++i)
+    {
+        struct limine_memmap_entry *entry = limine::memory_map->entries[i];
+        if (is_allocatable(entry) || is_reclaimable(entry))
+            managed_end = kpp::max(managed_end, static_cast<uintptr_t>(entry->base + entry->length));
+    }
+    return managed_end;
+}
+
+/**
+ * @brief Get the kind of reservation for memory of a (non-usable) Limine memory map entry type.
+ */
+static auto reservation_type_of(uint64_t memmap_type) -> ReservationType
+{
+    switch (memmap_type) {
+    case LIMINE_MEMMAP_ACPI_RECLAIMABLE: return ReservationType::AcpiReclaimable;
+    case LIMINE_MEMMAP_ACPI_NVS: return ReservationType::AcpiNvs;
+    case LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE: return ReservationType::Bootloader;
+    case LIMINE_MEMMAP_KERNEL_AND_MODULES: return ReservationType::Kernel;
+    case LIMINE_MEMMAP_FRAMEBUFFER: return ReservationType::Framebuffer;
+    default: return ReservationType::Firmware;
+    }
+}
+
+/**
+ * @brief Add a range to the reserved range registry, merging it with the last range if they
+ * are adjacent and of the same type. The registry's lock must be held.
+ */
+static void add_reserved_range(uintptr_t begin, uintptr_t end, ReservationType type)
+{
+    if (reserved_ranges.count > 0) {
+        auto &last = reserved_ranges.ranges[reserved_ranges.count - 1];
+        if (last.type == type && last.end == begin) {
+            last.end = end;
+            return;
+        }
+    }
+    if (reserved_ranges.count == ReservedRangeRegistry::capacity)
+        kernel_panic("too many reserved physical memory ranges\n");
+    reserved_ranges.ranges[reserved_ranges.count++] = ReservedRange {begin, end, type};
+}
+
+/**
+ * @brief Reserve every range of the memory map that isn't usable.
+ */
+static void reserve_memory_map_ranges()
+{
+    auto guard = SpinLockGuard {reserved_ranges.lock};
+    for (size_t i = 0; i < limine::memory_map->entry_count; ++i)
+    {
+        struct limine_memmap_entry *entry = limine::memory_map->entries[i];
+        if (!is_allocatable(entry)) {
+            add_reserved_range(entry->base, entry->base + entry->length, reservation_type_of(entry->type));
+        } else if (reserved_ranges.usable_count < ReservedRangeRegistry::capacity) {
+            reserved_ranges.usable_ranges[reserved_ranges.usable_count++] =
+                PhysicalRange {entry->base, entry->base + entry->length};
+        }
+    }
+}
+
 /**
  * @brief Return the ceiling of a division.
  */
@@ -61,8 +301,8 @@ static constexpr auto ceil_div(auto dividend, auto divisor)
 /**
  * @brief Reserves contiguous frames from the system.
  * 
- * Since the free stack is not initailized yet when this function is called, we can't use
- * the free stack to allocate memory; instead, we reserve
+ * Since the buddy allocator is not initailized yet when this function is called, we can't use
+ * it to allocate memory; instead, we reserve
  * the frames by manually examining the memory map provided by Limine.
  * 
  * This function should NOT be used to allocate memory for anything else
@@ -86,95 +326,755 @@ static uintptr_t manually_reserve_contiguous_frames(size_t num_frames)
 }
 
 /**
- * @brief Initialize the free stack with all the allocatable frames, excluding the given ranges.
- * 
- * @param exclude_ranges A list of ranges to exclude from the free stack.
+ * @brief Free the frames in the given range, splitting it into the pools of the NUMA nodes and
+ * zones it spans.
  */
-template <size_t num_exclude_ranges>
-static void fill_free_stack(kpp::Array<FrameRange, num_exclude_ranges> const &exclude_ranges)
+static void free_range_to_pools(uintptr_t begin, uintptr_t end)
 {
-    auto const in_exclude_range = [&exclude_ranges](uintptr_t frame) {
-        for (auto const &exclude_range : exclude_ranges) {
-            if (frame >= exclude_range.begin && frame < exclude_range.end)
-                return true;
-        }
-        return false;
-    };
+    while (begin < end) {
+        const auto node_range = numa_memory_range_containing(begin);
+        const auto zone = frame_zone(begin);
+        const auto piece_end = kpp::min(end, kpp::min(node_range.end, zone_end(zone)));
+        auto &pool = frame_pools[pool_index(node_range.node, zone)];
+        auto guard = SpinLockGuard {pool.lock};
+        pool.allocator->deallocate_range(begin, piece_end);
+        allocator_counters.managed_frames += (piece_end - begin) / kernelConstants::frameSize;
+        begin = piece_end;
+    }
+}
+
+/**
+ * @brief Free the frames in the range [begin, end), skipping any frames that fall inside one of
+ * the reserved ranges (starting from the reserved range at index `first_reserved_range`).
+ * The registry's lock must be held.
+ *
+ * The work done is proportional to the number of reserved ranges and the number of
+ * buddy blocks needed to cover the range, not the number of frames in it.
+ */
+static void free_range_excluding_reserved(uintptr_t begin, uintptr_t end, size_t first_reserved_range = 0)
+{
+    for (size_t i = first_reserved_range; i < reserved_ranges.count; ++i)
+    {
+        auto const &reserved_range = reserved_ranges.ranges[i];
+        if (reserved_range.end <= begin || reserved_range.begin >= end)
+            continue;
+        // free the parts of the range on either side of the reserved range
+        if (begin < reserved_range.begin)
+            free_range_excluding_reserved(begin, reserved_range.begin, i + 1);
+        if (reserved_range.end < end)
+            free_range_excluding_reserved(reserved_range.end, end, i + 1);
+        return;
+    }
+    free_range_to_pools(begin, end);
+}
 
-    // add the allocatable frames from each segment to the free stack
+/**
+ * @brief Initialize the free lists with all the allocatable frames that aren't reserved.
+ */
+static void fill_free_lists()
+{
+    auto guard = SpinLockGuard {reserved_ranges.lock};
+    // add the allocatable frames from each segment to the free lists
     for (size_t i = 0; i < limine::memory_map->entry_count; ++i)
     {
         struct limine_memmap_entry *entry = limine::memory_map->entries[i];
         if (!is_allocatable(entry))
             continue;
+        free_range_excluding_reserved(entry->base, entry->base + entry->length);
+    }
+}
 
-        // push the allocatable frames from this segment to the free stack
-        uint64_t end_of_entry = entry->base + entry->length;
-        for (uintptr_t frame = entry->base; frame < end_of_entry; frame += kernelConstants::frameSize)
-        {
-            // do not include frames that were allocated for the free stack
-            if (in_exclude_range(frame))
-                continue;
-            free_stack->push(reinterpret_cast<void *>(frame));
-        }
+/**
+ * @brief Get the number of words of storage that the allocators of the frame pools need in
+ * addition to the frame metadata.
+ */
+static auto pool_allocator_storage_words() -> size_t
+{
+#ifdef FRAME_ALLOCATOR_BITMAP
+    auto words = size_t {0};
+    for (uint8_t zone = 0; zone < num_memory_zones; ++zone) {
+        const auto memory_zone = static_cast<MemoryZone>(zone);
+        words += BitmapFrameAllocator::storage_words(zone_begin(memory_zone),
+            kpp::min(zone_end(memory_zone), managed_memory_end));
     }
+    return words * numa_node_count();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Construct the allocator of a frame pool, taking the storage it needs from `storage`.
+ */
+static void init_pool_allocator(FramePool &pool, uint8_t index, uint64_t *&storage)
+{
+#ifdef FRAME_ALLOCATOR_BITMAP
+    const auto begin = zone_begin(pool.zone);
+    const auto end = kpp::min(zone_end(pool.zone), managed_memory_end);
+    pool.allocator.emplace(begin, end, frame_infos, index, storage);
+    storage += BitmapFrameAllocator::storage_words(begin, end);
+#else
+    pool.allocator.emplace(managed_memory_end, frame_infos, index);
+#endif
 }
 
 void frame_allocator_init()
 {
     DEBUG("Initializing frame allocator...\n");
-    // count how many frames of memory we can allocate to the user in total
-    // (and hence the max size of the free stack)
+    const auto init_start_cycles = processor::readTimestampCounter();
+    allocator_counters.init_cycles = init_start_cycles;
+    [[ maybe_unused ]]
     size_t num_allocatable_frames = get_num_allocatable_frames();
     DEBUG("Found %d allocatable frames\n", num_allocatable_frames);
 
-    // the free stack needs enough frames for itself to be able to store (pointers)
-    // to all allocatable frames
-    // one free stack frame can hold (kernelConstants::frameSize_in_bytes / 8) frame pointers per frame
-    // (assuming 64-bit = 8-byte pointers)
-    size_t frame_pointers_per_frame = ceil_div(kernelConstants::frameSize, 8);
-    size_t num_free_stack_frames = ceil_div(num_allocatable_frames, frame_pointers_per_frame);
+    // every frame the allocator could ever manage needs a metadata entry
+    const uintptr_t managed_end = get_managed_memory_end();
+    num_frame_infos = managed_end / kernelConstants::frameSize;
+    managed_memory_end = managed_end;
+    const auto num_storage_words = pool_allocator_storage_words();
+    size_t num_metadata_frames = ceil_div(num_frame_infos * sizeof(FrameInfo) + num_storage_words * sizeof(uint64_t),
+        kernelConstants::frameSize);
+
+    // get contiguous frames for the metadata array
+    uintptr_t metadata_frames_begin = manually_reserve_contiguous_frames(num_metadata_frames);
+    DEBUG("Reserved %d contiguous frames for the frame metadata\n", num_metadata_frames);
+
+    if (!metadata_frames_begin)
+        kernel_panic("not enough contiguous space for the frame metadata");
+
+    // one-past-the-end of the contiguous metadata frames
+    uintptr_t metadata_frames_end = metadata_frames_begin + num_metadata_frames * kernelConstants::frameSize;
+
+    // a zeroed entry describes an unreferenced frame that isn't in any free list
+    frame_infos = reinterpret_cast<FrameInfo *>(kernel_physical_to_virtual(metadata_frames_begin));
+    kpp::memset(frame_infos, 0, num_frame_infos * sizeof(FrameInfo));
+
+    // the pool allocators' own storage (if any) follows the metadata array
+    auto storage = reinterpret_cast<uint64_t *>(frame_infos + num_frame_infos);
+    for (uint8_t node = 0; node < numa_node_count(); ++node) {
+        for (uint8_t zone = 0; zone < num_memory_zones; ++zone) {
+            const auto index = pool_index(node, static_cast<MemoryZone>(zone));
+            frame_pools[index].zone = static_cast<MemoryZone>(zone);
+            init_pool_allocator(frame_pools[index], index, storage);
+        }
+    }
+
+    // fill the free lists with the allocatable frames, except the ones holding the metadata
+    reserve_memory_map_ranges();
+    {
+        auto guard = SpinLockGuard {reserved_ranges.lock};
+        add_reserved_range(metadata_frames_begin, metadata_frames_end, ReservationType::FrameMetadata);
+    }
+    fill_free_lists();
+    DEBUG("Finished initializing the frame allocator with %d free frames in %d cycles\n",
+          available_frames(), processor::readTimestampCounter() - init_start_cycles);
+}
 
-    // get contiguous frames for the free stack
-    uintptr_t free_stack_frames_begin = manually_reserve_contiguous_frames(num_free_stack_frames);
-    DEBUG("Reserved %d contiguous frames for the free stack\n", num_free_stack_frames);
+/**
+ * @brief Get the metadata of the frame at the given physical address.
+ */
+static auto get_frame_info(uintptr_t frame) -> FrameInfo &
+{
+    const auto pfn = frame / kernelConstants::frameSize;
+    if (pfn >= num_frame_infos)
+        kernel_panic("frame %x is not managed by the frame allocator\n", frame);
+    return frame_infos[pfn];
+}
+
+/**
+ * @brief Add `change` to the number of frames in allocated blocks, and update its peak.
+ */
+static auto count_used_frames(int64_t change) -> void
+{
+    const auto used = allocator_counters.used_frames.fetch_add(change, std::memory_order_relaxed) + change;
+    auto peak = allocator_counters.peak_used_frames.load(std::memory_order_relaxed);
+    while (used > peak && !allocator_counters.peak_used_frames.compare_exchange_weak(peak, used, std::memory_order_relaxed));
+}
+
+/**
+ * @brief Record the latency of an allocation that started at `start_cycles` in the histogram
+ * of the magazine of the current processor. Interrupts must be disabled.
+ */
+static auto record_allocation_latency(FrameCacheStats &stats, uint64_t start_cycles) -> void
+{
+    const auto cycles = processor::readTimestampCounter() - start_cycles;
+    // bucket i counts latencies below allocation_latency_bucket_bound(i) = 32 << i
+    const auto scaled = cycles / allocation_latency_bucket_bound(0);
+    const auto bucket = scaled == 0 ? 0 : 64 - __builtin_clzll(scaled);
+    stats.allocation_latency[kpp::min<size_t>(bucket, allocation_latency_buckets - 1)] += 1;
+}
+
+/**
+ * @brief Mark the block at the given address as allocated, with a single reference.
+ */
+static auto claim_block(uintptr_t block, uint8_t order) -> void
+{
+    auto &info = get_frame_info(block);
+    info.ref_count.store(1, std::memory_order_relaxed);
+    info.order = order;
+    info.owner = 0;
+    count_used_frames(int64_t {1} << order);
+}
+
+/**
+ * @brief Mark the block at the given address as unreferenced, panicking if it wasn't allocated.
+ */
+static auto release_block(uintptr_t block, uint8_t order) -> void
+{
+    auto &info = get_frame_info(block);
+    if (info.ref_count.exchange(0, std::memory_order_acq_rel) == 0)
+        kernel_panic("double free of frame block %x (order %d)\n", block, order);
+}
+
+/**
+ * @brief Call `visit` with each frame pool that may serve an allocation limited to
+ * `highest_zone`, in order of preference, until it returns true.
+ *
+ * The zones of the current node are visited first, from `highest_zone` down, then those of
+ * the other nodes.
+ *
+ * @return whether `visit` returned true for some pool
+ */
+template <typename Visitor>
+static auto visit_pools(MemoryZone highest_zone, Visitor visit) -> bool
+{
+    const auto num_nodes = numa_node_count();
+    const auto local_node = numa_current_node();
+    for (uint8_t i = 0; i < num_nodes; ++i) {
+        const auto node = static_cast<uint8_t>((local_node + i) % num_nodes);
+        for (auto zone = static_cast<int>(highest_zone); zone >= 0; --zone) {
+            if (visit(frame_pools[pool_index(node, static_cast<MemoryZone>(zone))]))
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Allocate a block from the most preferred pool that has one.
+ */
+static auto allocate_from_pools(uint8_t order, MemoryZone highest_zone) -> uintptr_t
+{
+    auto block = uintptr_t {0};
+    visit_pools(highest_zone, [&](FramePool &pool) {
+        auto guard = SpinLockGuard {pool.lock};
+        block = pool.allocator->allocate(order);
+        return block != 0;
+    });
+    return block;
+}
+
+/**
+ * @brief Get the pool that owns the given block.
+ */
+static auto pool_of_block(uintptr_t block) -> FramePool &
+{
+    return frame_pools[get_frame_info(block).zone];
+}
+
+/**
+ * @brief Move up to a batch of frames from the frame pools into the magazine.
+ */
+static void refill_magazine(FrameMagazine &magazine)
+{
+    visit_pools(MemoryZone::Normal, [&](FramePool &pool) {
+        auto guard = SpinLockGuard {pool.lock};
+        while (magazine.count < FrameMagazine::batch_size) {
+            auto frame = pool.allocator->allocate(0);
+            if (!frame)
+                break;
+            magazine.frames[magazine.count++] = frame;
+        }
+        return magazine.count == FrameMagazine::batch_size;
+    });
+    magazine.stats.refills += 1;
+}
+
+/**
+ * @brief Return `num_frames` frames from the top of the magazine to the pools that own them.
+ */
+static void drain_magazine(FrameMagazine &magazine, size_t num_frames)
+{
+    for (; num_frames > 0 && magazine.count > 0; --num_frames) {
+        const auto frame = magazine.frames[--magazine.count];
+        auto &pool = pool_of_block(frame);
+        auto guard = SpinLockGuard {pool.lock};
+        pool.allocator->deallocate(frame, 0);
+    }
+    magazine.stats.drains += 1;
+}
 
-    if (!free_stack_frames_begin)
-        kernel_panic("not enough contiguous space for the free stack frame allocator");
+/**
+ * @brief Take a frame out of the zeroed frame pool. Returns 0 if the pool is empty.
+ */
+static auto pop_zeroed_frame() -> uintptr_t
+{
+    auto guard = SpinLockGuard {zeroed_frame_pool.lock};
+    if (zeroed_frame_pool.count == 0)
+        return 0;
+    // frames in the pool aren't counted as used until they are handed out
+    count_used_frames(1);
+    return zeroed_frame_pool.frames[--zeroed_frame_pool.count];
+}
 
-    // one-past-the-end of the contiguous stack frames
-    uintptr_t free_stack_frames_end = free_stack_frames_begin + num_free_stack_frames * kernelConstants::frameSize;
+/**
+ * @brief Give every frame in the zeroed frame pool back to the buddy allocator.
+ */
+static void drain_zeroed_frame_pool()
+{
+    while (auto frame = pop_zeroed_frame())
+        deallocate_frame(reinterpret_cast<void *>(frame));
+}
 
-    // construct the free stack with the allocated memory
-    free_stack.emplace(reinterpret_cast<void *>(free_stack_frames_begin), 
-                       num_allocatable_frames);
+/**
+ * @brief Take a frame from the current processor's magazine, refilling the magazine from the
+ * pools if it is empty. Returns 0 if the pools are empty as well.
+ *
+ * @param is_retry whether the allocation was already counted by a previous attempt
+ */
+static auto allocate_from_magazine(uint64_t start_cycles, bool is_retry) -> uintptr_t
+{
+    auto interrupt_guard = processor::InterruptGuard {};
+    auto &magazine = frame_magazines[processor::currentCPUIndex()];
+    auto guard = SpinLockGuard {magazine.lock};
+    if (!is_retry)
+        magazine.stats.allocations += 1;
+    if (magazine.count == 0)
+        refill_magazine(magazine);
+    if (magazine.count == 0)
+        return 0;
+    const auto frame = magazine.frames[--magazine.count];
+    claim_block(frame, 0);
+    record_allocation_latency(magazine.stats, start_cycles);
+    return frame;
+}
 
-    // fill the free stack with the allocatable frames
-    auto const exclude_ranges = kpp::Array<FrameRange, 1> {
-        FrameRange {free_stack_frames_begin, free_stack_frames_end}
-    };
+/**
+ * @brief Give the frames cached by the other processors back to the pools.
+ */
+static void drain_remote_magazines()
+{
+    auto interrupt_guard = processor::InterruptGuard {};
+    const auto current_cpu = processor::currentCPUIndex();
+    for (uint32_t cpu = 0; cpu < processor::maxCPUs; ++cpu) {
+        auto &magazine = frame_magazines[cpu];
+        if (cpu == current_cpu || magazine.count == 0)
+            continue;
+        auto guard = SpinLockGuard {magazine.lock};
+        drain_magazine(magazine, magazine.count);
+    }
+}
 
-    fill_free_stack(exclude_ranges);
-    DEBUG("Finished initializing the frame allocator with %d free frames\n", free_stack->size());
+auto try_allocate_frame() -> void *
+{
+    const auto start_cycles = processor::readTimestampCounter();
+    if (auto frame = allocate_from_magazine(start_cycles, false))
+        return reinterpret_cast<void *>(frame);
+    // the last free frames may be cached by other processors, or in the zeroed pool
+    drain_remote_magazines();
+    if (auto frame = allocate_from_magazine(start_cycles, true))
+        return reinterpret_cast<void *>(frame);
+    if (auto frame = pop_zeroed_frame())
+        return reinterpret_cast<void *>(frame);
+    return nullptr;
 }
 
 void *allocate_frame()
 {
-    if (free_stack->empty())
+    auto frame = try_allocate_frame();
+    if (!frame)
         kernel_panic("ran out of physical memory to allocate!");
-    auto frame_address = free_stack->top();
-    free_stack->pop();
-    return frame_address;
+    return frame;
+}
+
+auto allocate_frames(uint8_t order, MemoryZone highest_zone) -> void *
+{
+    const auto start_cycles = processor::readTimestampCounter();
+    auto frame_address = allocate_from_pools(order, highest_zone);
+    if (!frame_address && (order > 0 || highest_zone != MemoryZone::Normal)) {
+        // frames sitting in the processors' magazines or in the zeroed pool can't coalesce
+        // (and may be the last ones in the requested zones): give them back and retry
+        drain_frame_cache();
+        drain_remote_magazines();
+        drain_zeroed_frame_pool();
+        frame_address = allocate_from_pools(order, highest_zone);
+    }
+    if (!frame_address && order > 0 && compact_frames(order, highest_zone))
+        frame_address = allocate_from_pools(order, highest_zone);
+    if (!frame_address) {
+        allocator_counters.failed_allocations.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    claim_block(frame_address, order);
+    allocator_counters.block_allocations.fetch_add(1, std::memory_order_relaxed);
+    auto interrupt_guard = processor::InterruptGuard {};
+    record_allocation_latency(frame_magazines[processor::currentCPUIndex()].stats, start_cycles);
+    return reinterpret_cast<void *>(frame_address);
+}
+
+/**
+ * @brief Get the number of free frames in the pools, not counting the ones cached by the
+ * processors or in the zeroed frame pool.
+ */
+static auto pool_free_frames() -> size_t
+{
+    auto pool_frames = size_t {0};
+    for (auto const &pool : frame_pools) {
+        if (pool.allocator)
+            pool_frames += pool.allocator->free_frames();
+    }
+    return pool_frames;
 }
 
 uint64_t available_frames()
 {
-    return free_stack->size();
+    auto cached_frames = size_t {0};
+    for (auto const &magazine : frame_magazines)
+        cached_frames += magazine.count;
+    return pool_free_frames() + cached_frames + available_zeroed_frames();
+}
+
+auto available_zone_frames(uint8_t node, MemoryZone zone) -> std::size_t
+{
+    if (node >= numa_node_count())
+        return 0;
+    return frame_pools[pool_index(node, zone)].allocator->free_frames();
+}
+
+auto frame_zone(uintptr_t frame) -> MemoryZone
+{
+    if (frame < zone_end(MemoryZone::DMA))
+        return MemoryZone::DMA;
+    if (frame < zone_end(MemoryZone::DMA32))
+        return MemoryZone::DMA32;
+    return MemoryZone::Normal;
+}
+
+auto try_allocate_zeroed_frame() -> void *
+{
+    if (auto frame = pop_zeroed_frame())
+        return reinterpret_cast<void *>(frame);
+    // the pool ran dry: pay for the zeroing now
+    auto frame = try_allocate_frame();
+    if (!frame)
+        return nullptr;
+    kpp::memset(kernel_physical_to_virtual(frame), 0, kernelConstants::frameSize);
+    return frame;
+}
+
+auto allocate_zeroed_frame() -> void *
+{
+    auto frame = try_allocate_zeroed_frame();
+    if (!frame)
+        kernel_panic("ran out of physical memory to allocate!");
+    return frame;
+}
+
+auto refill_zeroed_frames(size_t max_frames) -> size_t
+{
+    auto zeroed_frames = size_t {0};
+    for (; zeroed_frames < max_frames; ++zeroed_frames) {
+        if (available_zeroed_frames() >= ZeroedFramePool::capacity)
+            break;
+        // don't eat into memory that is needed for real allocations; frames cached by other
+        // processors don't count, since they can't be taken from here
+        if (pool_free_frames() <= ZeroedFramePool::capacity)
+            break;
+        // zero the frame without holding the pool's lock, with interrupts enabled; it is taken
+        // straight from the pools, which another processor may have emptied since the check
+        const auto block = allocate_from_pools(0, MemoryZone::Normal);
+        if (!block)
+            break;
+        claim_block(block, 0);
+        auto frame = reinterpret_cast<void *>(block);
+        kpp::memset(kernel_physical_to_virtual(frame), 0, kernelConstants::frameSize);
+
+        {
+            auto guard = SpinLockGuard {zeroed_frame_pool.lock};
+            if (zeroed_frame_pool.count < ZeroedFramePool::capacity) {
+                zeroed_frame_pool.frames[zeroed_frame_pool.count++] = reinterpret_cast<uintptr_t>(frame);
+                count_used_frames(-1);
+                continue;
+            }
+        }
+        // another processor filled the pool in the meantime
+        deallocate_frame(frame);
+        break;
+    }
+    return zeroed_frames;
+}
+
+auto available_zeroed_frames() -> std::size_t
+{
+    return zeroed_frame_pool.count;
+}
+
+auto available_blocks(uint8_t order) -> std::size_t
+{
+    auto blocks = size_t {0};
+    for (auto const &pool : frame_pools) {
+        if (pool.allocator)
+            blocks += pool.allocator->free_blocks(order);
+    }
+    return blocks;
+}
+
+/**
+ * @brief Return an unreferenced block to the allocator: single frames go to the current
+ * processor's magazine, larger blocks straight to the pool that owns them.
+ */
+static void free_block(uintptr_t block, uint8_t order)
+{
+    get_frame_info(block).flags = FrameFlags::None;
+    count_used_frames(-(int64_t {1} << order));
+    if (order > 0) {
+        allocator_counters.block_frees.fetch_add(1, std::memory_order_relaxed);
+        auto &pool = pool_of_block(block);
+        auto guard = SpinLockGuard {pool.lock};
+        pool.allocator->deallocate(block, order);
+        return;
+    }
+    auto interrupt_guard = processor::InterruptGuard {};
+    auto &magazine = frame_magazines[processor::currentCPUIndex()];
+    auto guard = SpinLockGuard {magazine.lock};
+    magazine.stats.frees += 1;
+    if (magazine.count == FrameMagazine::capacity)
+        drain_magazine(magazine, FrameMagazine::batch_size);
+    magazine.frames[magazine.count++] = block;
 }
 
 void deallocate_frame(void *frame)
 {
-    free_stack->push(frame);
+    release_block(reinterpret_cast<uintptr_t>(frame), 0);
+    free_block(reinterpret_cast<uintptr_t>(frame), 0);
+}
+
+auto deallocate_frames(void *block, uint8_t order) -> void
+{
+    release_block(reinterpret_cast<uintptr_t>(block), order);
+    free_block(reinterpret_cast<uintptr_t>(block), order);
+}
+
+auto drain_frame_cache() -> void
+{
+    auto interrupt_guard = processor::InterruptGuard {};
+    auto &magazine = frame_magazines[processor::currentCPUIndex()];
+    auto guard = SpinLockGuard {magazine.lock};
+    drain_magazine(magazine, magazine.count);
+}
+
+auto frame_cache_stats(uint32_t cpu_index) -> FrameCacheStats
+{
+    auto stats = frame_magazines[cpu_index].stats;
+    stats.cached_frames = frame_magazines[cpu_index].count;
+    return stats;
+}
+
+/**
+ * @brief Size in bytes of a block of the given order.
+ */
+static constexpr auto block_size(uint8_t order) -> uintptr_t
+{
+    return kernelConstants::frameSize << order;
+}
+
+/**
+ * @brief Check if the pool has a free block of at least the given order.
+ */
+static auto has_free_block(FramePool const &pool, uint8_t order) -> bool
+{
+    for (auto current_order = order; current_order <= FramePoolAllocator::max_order; ++current_order) {
+        if (pool.allocator->free_blocks(current_order) > 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Check if the frame can be migrated: it is only mapped at the virtual address recorded
+ * in its metadata, and belongs to the given pool.
+ */
+static auto is_movable(FrameInfo const &info, uint8_t pool_index) -> bool
+{
+    return info.has_flags(FrameFlags::Movable) && info.order == 0 && info.zone == pool_index
+        && info.ref_count.load(std::memory_order_relaxed) == 1;
+}
+
+/**
+ * @brief Check if every frame in the block is either free in the pool or movable.
+ * The pool must not have a free block of the block's order or larger.
+ */
+static auto is_compactable(FramePool &pool, uint8_t pool_index, uintptr_t block, uint8_t order) -> bool
+{
+    const auto block_end = block + block_size(order);
+    for (auto frame = block; frame < block_end;) {
+        if (pool.allocator->owns_free_block(frame)) {
+            frame += block_size(pool.allocator->free_block_order(frame));
+        } else if (is_movable(get_frame_info(frame), pool_index)) {
+            frame += kernelConstants::frameSize;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Free an entire block that passed is_compactable by migrating its movable frames out
+ * of it. Must be called with the pool's lock held.
+ *
+ * @return whether the block was freed; if not, the pool is left with the same free frames
+ */
+static auto compact_block(FramePool &pool, uint8_t pool_index, uintptr_t block, uint8_t order) -> bool
+{
+    const auto block_end = block + block_size(order);
+
+    // take the free parts of the block out of the free lists, so that they can't be picked as
+    // destinations for the frames being migrated
+    for (auto frame = block; frame < block_end;) {
+        if (pool.allocator->owns_free_block(frame))
+            frame += block_size(pool.allocator->take_free_block(frame));
+        else
+            frame += kernelConstants::frameSize;
+    }
+
+    auto migrated_all = true;
+    for (auto frame = block; frame < block_end && migrated_all; frame += kernelConstants::frameSize) {
+        auto &info = get_frame_info(frame);
+        if (!is_movable(info, pool_index))
+            continue;
+        const auto new_frame = pool.allocator->allocate(0);
+        if (!new_frame) {
+            migrated_all = false;
+            break;
+        }
+        claim_block(new_frame, 0);
+        if (!frame_migration_handler || !frame_migration_handler(info.owner, frame, new_frame)) {
+            release_block(new_frame, 0);
+            count_used_frames(-1);
+            pool.allocator->deallocate(new_frame, 0);
+            compaction_counters.failed_migrations += 1;
+            migrated_all = false;
+            break;
+        }
+        auto &new_info = get_frame_info(new_frame);
+        new_info.flags = FrameFlags::Movable;
+        new_info.owner = info.owner;
+        info.ref_count.store(0, std::memory_order_relaxed);
+        info.flags = FrameFlags::None;
+        count_used_frames(-1);
+        compaction_counters.migrated_frames += 1;
+    }
+
+    if (migrated_all) {
+        pool.allocator->deallocate(block, order);
+        return true;
+    }
+
+    // give back the free parts and the frames that were already migrated; the frames that
+    // weren't migrated stay where they are
+    for (auto frame = block; frame < block_end;) {
+        auto &info = get_frame_info(frame);
+        if (is_movable(info, pool_index)) {
+            frame += kernelConstants::frameSize;
+            continue;
+        }
+        const auto frame_order = info.order;
+        pool.allocator->deallocate(frame, frame_order);
+        frame += block_size(frame_order);
+    }
+    return false;
+}
+
+auto compact_frames(uint8_t order, MemoryZone highest_zone) -> bool
+{
+    if (order > FramePoolAllocator::max_order)
+        return false;
+    compaction_counters.runs += 1;
+
+    // frames cached outside of the pools can't be part of a free block
+    drain_frame_cache();
+    drain_remote_magazines();
+    drain_zeroed_frame_pool();
+
+    const auto compacted = visit_pools(highest_zone, [&](FramePool &pool) {
+        const auto index = static_cast<uint8_t>(&pool - &frame_pools[0]);
+        auto guard = SpinLockGuard {pool.lock};
+        if (has_free_block(pool, order))
+            return true;
+        const auto first_block = (zone_begin(pool.zone) + block_size(order) - 1) / block_size(order) * block_size(order);
+        const auto end = kpp::min(zone_end(pool.zone), managed_memory_end);
+        for (auto block = first_block; block + block_size(order) <= end; block += block_size(order)) {
+            if (is_compactable(pool, index, block, order) && compact_block(pool, index, block, order))
+                return true;
+        }
+        return false;
+    });
+    if (compacted)
+        compaction_counters.successes += 1;
+    return compacted;
+}
+
+auto set_frame_migration_handler(FrameMigrationHandler handler) -> void
+{
+    frame_migration_handler = handler;
+}
+
+auto set_frame_movable(uintptr_t frame, uintptr_t virtual_page) -> void
+{
+    auto &info = get_frame_info(frame);
+    info.flags = info.flags | FrameFlags::Movable;
+    info.owner = virtual_page;
+}
+
+auto fragmentation_index(uint8_t order) -> int
+{
+    // see Mel Gorman's external fragmentation index, as used by Linux
+    auto free_blocks = size_t {0};
+    auto free_frames = size_t {0};
+    auto has_suitable_block = false;
+    for (uint8_t current_order = 0; current_order <= FramePoolAllocator::max_order; ++current_order) {
+        const auto blocks = available_blocks(current_order);
+        free_blocks += blocks;
+        free_frames += blocks << current_order;
+        has_suitable_block |= current_order >= order && blocks > 0;
+    }
+    if (has_suitable_block)
+        return -1000;
+    if (free_blocks == 0)
+        return 0;
+    const auto requested_frames = size_t {1} << order;
+    return 1000 - static_cast<int>((1000 + free_frames * 1000 / requested_frames) / free_blocks);
+}
+
+auto compaction_stats() -> CompactionStats
+{
+    return compaction_counters;
+}
+
+auto frame_allocator_stats() -> FrameAllocatorStats
+{
+    auto stats = FrameAllocatorStats {};
+    stats.uptime_cycles = processor::readTimestampCounter() - allocator_counters.init_cycles;
+    stats.managed_frames = allocator_counters.managed_frames;
+    stats.free_frames = available_frames();
+    stats.used_frames = kpp::max<int64_t>(allocator_counters.used_frames.load(std::memory_order_relaxed), 0);
+    stats.peak_used_frames = allocator_counters.peak_used_frames.load(std::memory_order_relaxed);
+    stats.allocations = allocator_counters.block_allocations.load(std::memory_order_relaxed);
+    stats.frees = allocator_counters.block_frees.load(std::memory_order_relaxed);
+    stats.failed_allocations = allocator_counters.failed_allocations.load(std::memory_order_relaxed);
+    for (auto const &magazine : frame_magazines) {
+        stats.allocations += magazine.stats.allocations;
+        stats.frees += magazine.stats.frees;
+        // the magazine is only refilled when an allocation finds it empty
+        stats.cache_hits += magazine.stats.allocations - magazine.stats.refills;
+        stats.cache_misses += magazine.stats.refills;
+        for (size_t bucket = 0; bucket < allocation_latency_buckets; ++bucket)
+            stats.allocation_latency[bucket] += magazine.stats.allocation_latency[bucket];
+    }
+    for (uint8_t order = 0; order <= max_frame_order; ++order)
+        stats.free_blocks[order] = available_blocks(order);
+    return stats;
 }
 
 void *kernel_physical_to_virtual(void *physical_address)
@@ -190,26 +1090,78 @@ uintptr_t kernel_physical_to_virtual(uintptr_t physical_address)
 
 void free_limine_bootloader_memory()
 {
-    uint64_t reclaimed_frames = 0;
-    // add the allocatable frames from each segment to the free stack
-    for (size_t i = 0; i < limine::memory_map->entry_count; ++i)
+    [[ maybe_unused ]]
+    const auto reclaimed_frames = release_reserved_frames(ReservationType::Bootloader);
+    DEBUG("Reclaimed %d frames of Limine bootloader memory, %d available frames\n",
+          reclaimed_frames, available_frames());
+}
+
+auto reserve_frames(uintptr_t begin, uintptr_t end, ReservationType type) -> void
+{
+    begin = begin / kernelConstants::frameSize * kernelConstants::frameSize;
+    end = ceil_div(end, kernelConstants::frameSize) * kernelConstants::frameSize;
+    auto guard = SpinLockGuard {reserved_ranges.lock};
+    // frames of usable memory may already be in use or in the free lists
+    for (size_t i = 0; i < reserved_ranges.usable_count; ++i)
     {
-        struct limine_memmap_entry *entry = limine::memory_map->entries[i];
-        // only reclaim bootloader-reclaimable entries
-        if (entry->type != LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE)
-            continue;
+        const auto &usable_range = reserved_ranges.usable_ranges[i];
+        if (begin < usable_range.end && usable_range.begin < end)
+            kernel_panic("can't reserve usable memory %x-%x\n", begin, end);
+    }
+    // e.g. every processor reserves the registers of its local APIC
+    for (size_t i = 0; i < reserved_ranges.count; ++i)
+    {
+        const auto &reserved_range = reserved_ranges.ranges[i];
+        if (reserved_range.type == type && reserved_range.begin <= begin && end <= reserved_range.end)
+            return;
+    }
+    add_reserved_range(begin, end, type);
+}
 
-        // push the allocatable frames from this segment to the free stack
-        uint64_t end_of_entry = entry->base + entry->length;
-        for (uintptr_t frame = entry->base; frame < end_of_entry; frame += kernelConstants::frameSize)
-        {
-            reclaimed_frames += 1;
-            deallocate_frame(reinterpret_cast<void *>(frame));
+auto release_reserved_frames(ReservationType type) -> std::size_t
+{
+    if (type != ReservationType::AcpiReclaimable && type != ReservationType::Bootloader)
+        kernel_panic("reserved memory of type %d can't be released\n", static_cast<int>(type));
+
+    auto released_frames = size_t {0};
+    auto guard = SpinLockGuard {reserved_ranges.lock};
+    for (size_t i = 0; i < reserved_ranges.count;)
+    {
+        const auto range = reserved_ranges.ranges[i];
+        if (range.type != type) {
+            ++i;
+            continue;
         }
+        // remove the range from the registry, then free it (except for any overlap with ranges
+        // that are still reserved)
+        for (size_t j = i + 1; j < reserved_ranges.count; ++j)
+            reserved_ranges.ranges[j - 1] = reserved_ranges.ranges[j];
+        --reserved_ranges.count;
+        free_range_excluding_reserved(range.begin, range.end);
+        released_frames += (range.end - range.begin) / kernelConstants::frameSize;
     }
+    return released_frames;
+}
 
-    DEBUG("Reclaimed %d frames of Limine bootloader memory, %d available frames\n",
-          reclaimed_frames, available_frames());
+auto is_frame_reserved(uintptr_t frame) -> bool
+{
+    auto guard = SpinLockGuard {reserved_ranges.lock};
+    for (size_t i = 0; i < reserved_ranges.count; ++i) {
+        if (reserved_ranges.ranges[i].begin <= frame && frame < reserved_ranges.ranges[i].end)
+            return true;
+    }
+    return false;
+}
+
+auto reserved_range_count() -> std::size_t
+{
+    return reserved_ranges.count;
+}
+
+auto reserved_range(std::size_t index) -> ReservedRange
+{
+    auto guard = SpinLockGuard {reserved_ranges.lock};
+    return reserved_ranges.ranges[index];
 }
 
 const char *limine_memmap_type(int type)
@@ -238,11 +1190,24 @@ void print_memory_map()
     }
 }
 
-auto update_frame_ref_count(uintptr_t frame, int change) -> void
+auto frame_info(uintptr_t frame) -> FrameInfo &
 {
-    // for now, just assume each frame can only be referenced once, so decrementing it
-    // is equivalent to free-ing it
-    if (change == -1) {
-        deallocate_frame(reinterpret_cast<void *>(frame));
-    }
+    return get_frame_info(frame);
+}
+
+auto frame_ref_count(uintptr_t frame) -> uint32_t
+{
+    return get_frame_info(frame).ref_count.load(std::memory_order_relaxed);
+}
+
+auto update_frame_ref_count(uintptr_t frame, int change) -> uint32_t
+{
+    auto &info = get_frame_info(frame);
+    const auto old_count = info.ref_count.fetch_add(change, std::memory_order_acq_rel);
+    const auto new_count = old_count + change;
+    if (old_count == 0 || static_cast<int32_t>(new_count) < 0)
+        kernel_panic("reference count of frame %x updated from %d by %d\n", frame, old_count, change);
+    if (new_count == 0)
+        free_block(frame, info.order);
+    return new_count;
 }
@@ -10,6 +10,7 @@
 #include <kernel/paging.h>
 #include <kernel/processor.hpp>
 #include <kernel/SegmentSelector.h>
+#include <kernel/smp.h>
 #include <kernel/TableDescriptor.h>
 #include <kernel/Terminal.hpp>
 #include <kpp/Array.hpp>
@@ -143,43 +144,21 @@ void isr_general_protection(IDTStructure::InterruptFrame *frame, uint64_t error_
 __attribute__((interrupt))
 void isr_page_fault(IDTStructure::InterruptFrame *frame, uint64_t error_code)
 {
-     /*const char *p_flag_msg = error_code & 1*/
-     /*    ? "The fault was caused by a page-level protection violation"*/
-     /*    : "The fault was caused by a non-present page";*/
-     /**/
-     /*const char *wr_flag_msg = error_code & 2*/
-     /*    ? "The access causing the fault was a write"*/
-     /*    : "The access causing the fault was a read";*/
-     /**/
-     /*const char *us_flag_msg = error_code & 4*/
-     /*    ? "A user-mode access caused the fault"*/
-     /*    : "A supervisor-mode access caused the fault";*/
-     /**/
-     /*const char *rsvd_flag_msg = error_code & 8*/
-     /*    ? "The fault was not caused by a reserved bit violation"*/
-     /*    : "The fault was caused by a reserved bit set to 1 in some paging-structure entry";*/
-     /**/
-     /*const char *id_flag_msg = error_code & 16*/
-     /*    ? "The fault was caused by an instruction fetch"*/
-     /*    : "The fault was not caused by an instruction fetch";*/
-     /**/
-     /*const char *pk_flag_msg = error_code & 32*/
-     /*    ? "There was a protection-key violation"*/
-     /*    : "The fault was not caused by protection keys";*/
-     /**/
-     /*const char *sgx_flag_msg = error_code & (1ULL << 15)*/
-     /*    ? "The fault resulted from violation of SGX-specific access-control requirements"*/
-     /*    : "The fault is not related to SGX";*/
-     /**/
-     /*kernel_panic(*/
-     /*    "page fault\n\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n",*/
-     /*    p_flag_msg, wr_flag_msg, us_flag_msg, rsvd_flag_msg, id_flag_msg, pk_flag_msg, sgx_flag_msg*/
-     /*);*/
-
     auto faulting_address = uintptr_t {};
     asm volatile("mov %%cr2, %0" : "=r"(faulting_address));
-    paging_allocate_and_map(faulting_address, kernelConstants::pageSize, PageFlags::Write);
-    processor::localAPIC.sendEndOfInterrupt();
+    // exceptions aren't delivered by the local APIC, so there is no end of interrupt to send
+    if (paging_handle_page_fault(faulting_address, error_code))
+        return;
+
+    kernel_panic("page fault at %x (instruction %x, error code %x)\n%s %s %s%s%s%s\n",
+        faulting_address, frame->ip, error_code,
+        error_code & PageFaultError::User ? "user-mode" : "supervisor-mode",
+        error_code & PageFaultError::InstructionFetch ? "instruction fetch"
+            : error_code & PageFaultError::Write ? "write" : "read",
+        error_code & PageFaultError::Present ? "violated the page's protection" : "of a non-present page",
+        error_code & PageFaultError::ReservedBit ? ", reserved bit set in a paging-structure entry" : "",
+        error_code & PageFaultError::ProtectionKey ? ", protection key violation" : "",
+        error_code & (uint64_t {1} << 15) ? ", SGX access-control violation" : "");
 }
 
 __attribute__((interrupt))
@@ -226,6 +205,13 @@ void isr_interprocessor_interrupt(IDTStructure::InterruptFrame *frame)
 }
 #endif
 
+__attribute__((interrupt))
+void isr_tlb_shootdown(IDTStructure::InterruptFrame *frame)
+{
+    smp_handle_tlb_shootdown();
+    processor::localAPIC.sendEndOfInterrupt();
+}
+
 __attribute__((interrupt))
 void isr_keyboard(IDTStructure::InterruptFrame *frame)
 {
@@ -455,6 +441,14 @@ void idt_init()
     for (size_t i = 0; i < user_idt_descriptors.size(); ++i)
         idt.load_gate_descriptor(i + 0x30, user_idt_descriptors[i]);
 
+    idt.load_gate_descriptor(tlb_shootdown_vector, {
+        isr_tlb_shootdown,
+        SegmentSelector(PrivilegeLevel::kernel, DescriptorTable::global, GDTSegment::kernel_code),
+        0,
+        IDTStructure::GateType::interrupt,
+        PrivilegeLevel::kernel
+    });
+
 #ifdef INTERPROCESSOR_INTERRUPT_TEST
     idt.load_gate_descriptor(0xff, {
         isr_interprocessor_interrupt,
@@ -465,7 +459,11 @@ void idt_init()
     });
 #endif
 
+    idt_load();
+}
+
+void idt_load()
+{
     // load the address of the IDTStructure Descriptor into the IDTR (IDT register)
     __asm__("lidt %0" :: "m"(*idt_descriptor.address()));
-
 }
@@ -6,10 +6,13 @@
 #include <kernel/gdt.h>
 #include <kernel/idt.h>
 #include <kernel/kernel.h>
+#include <kernel/kmalloc.h>
 #include <kernel/Terminal.hpp>
 #include <kernel/types.h>
+#include <kernel/numa.h>
 #include <kernel/paging.h>
 #include <kernel/processor.hpp>
+#include <kernel/smp.h>
 #include <kernel/vmm.h>
 
 extern "C" void (*__init_array_start)(), (*__init_array_end)();
@@ -33,14 +36,23 @@ void kernel_init()
     KernelTerminal::initialize();
     gdt_init();
     idt_init();
+    processor::initializeCPULocalStorage(0);
+    numa_init();
     frame_allocator_init();
     paging_init();
     vmm_init();
+    kmalloc_init();
+    // the application processors enable their local APICs once the mapping exists
     processor::localAPIC.enableAPIC();
+    // the application processors start on Limine's stacks and page tables
+    smp_init();
+    free_limine_bootloader_memory();
     processor::initKeyboardController();
     APICManager apicManager;
     apicManager.initialize();
     apicManager.redirectIrq(1, 0x30);
+    // the ACPI tables have been parsed (SRAT by numa_init, MADT by the APIC manager)
+    release_reserved_frames(ReservationType::AcpiReclaimable);
 }
 
 [[ noreturn ]]
@@ -55,6 +67,13 @@ void kernel_panic(const char *fmt, ...)
     kernel_hang();
 }
 
+void kernel_idle()
+{
+    // zero a few frames at a time, so that pending input is handled promptly
+    constexpr auto frames_per_idle_step = size_t {8};
+    refill_zeroed_frames(frames_per_idle_step);
+}
+
 [[ noreturn ]]
 void kernel_hang()
 {
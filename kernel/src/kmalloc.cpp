@@ -0,0 +1,337 @@
+#include <atomic>
+#include <new>
+
+#include <kpp/array.hpp>
+#include <kpp/optional.hpp>
+#include <kernel/constants.h>
+#include <kernel/frame_allocator.h>
+#include <kernel/kernel.h>
+#include <kernel/kmalloc.h>
+#include <kernel/limine_features.h>
+#include <kernel/macros.h>
+#include <kernel/processor.hpp>
+#include <kernel/SlabCache.h>
+
+namespace
+{
+
+static_assert(kmalloc_min_size << (kmalloc_num_size_classes - 1) == kmalloc_max_small_size);
+
+constexpr const char *size_class_names[kmalloc_num_size_classes] = {
+    "kmalloc-8", "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048", "kmalloc-4096",
+};
+
+// operator new must return memory aligned for any fundamental type
+constexpr size_t small_alignment = 16;
+
+auto caches = kpp::Array<kpp::Optional<SlabCache>, kmalloc_num_size_classes> {};
+
+/**
+ * @brief A stack of free objects of one size class, held by one processor.
+ */
+struct ObjectMagazine
+{
+    static constexpr size_t capacity = 32;
+    size_t count = 0;
+    void *objects[capacity] = {};
+};
+
+/**
+ * @brief The objects cached by one processor, on cache lines of their own.
+ */
+struct alignas(64) CPUCache
+{
+    kpp::Array<ObjectMagazine, kmalloc_num_size_classes> magazines {};
+    uint64_t refills = 0;
+    uint64_t drains = 0;
+};
+
+auto cpu_caches = kpp::Array<CPUCache, processor::maxCPUs> {};
+
+std::atomic<size_t> large_blocks {0};
+std::atomic<size_t> large_frames {0};
+
+/**
+ * @brief Get the index of the smallest size class holding the given size (at most
+ * kmalloc_max_small_size).
+ */
+auto size_class(size_t size) -> size_t
+{
+    if (size <= kmalloc_min_size)
+        return 0;
+    // log2 of the size rounded up to a power of two, minus log2(kmalloc_min_size)
+    return static_cast<size_t>(64 - __builtin_clzll(size - 1)) - 3;
+}
+
+/**
+ * @brief Get the number of objects of a size class a processor may cache: up to 8 KiB of them,
+ * but at least 4 and at most ObjectMagazine::capacity. Half of them are moved at a time.
+ */
+constexpr auto magazine_depth(size_t index) -> size_t
+{
+    const auto depth = 8192 / (kmalloc_min_size << index);
+    return depth > ObjectMagazine::capacity ? ObjectMagazine::capacity : depth < 4 ? 4 : depth;
+}
+
+/**
+ * @brief Get the smallest order of a block of frames holding the given size.
+ */
+auto order_for_size(size_t size) -> uint8_t
+{
+    auto order = uint8_t {0};
+    while ((size_t {kernelConstants::frameSize} << order) < size)
+        ++order;
+    return order;
+}
+
+auto allocate_small(size_t size) -> void *
+{
+    const auto index = size_class(size);
+    auto &cache = caches[index];
+    if (!cache)
+        kernel_panic("kmalloc called before kmalloc_init\n");
+    {
+        processor::InterruptGuard guard {};
+        auto &cpu_cache = cpu_caches[processor::currentCPUIndex()];
+        auto &magazine = cpu_cache.magazines[index];
+        if (magazine.count == 0) {
+            magazine.count = cache->allocate_batch(magazine.objects, magazine_depth(index) / 2);
+            cpu_cache.refills += 1;
+        }
+        if (magazine.count > 0)
+            return magazine.objects[--magazine.count];
+    }
+    // the size-class cache ran out of memory for a new slab
+    return kmalloc_reap() > 0 ? cache->allocate() : nullptr;
+}
+
+auto free_small(SlabCache &cache, size_t index, void *object) -> void
+{
+    processor::InterruptGuard guard {};
+    auto &cpu_cache = cpu_caches[processor::currentCPUIndex()];
+    auto &magazine = cpu_cache.magazines[index];
+    const auto depth = magazine_depth(index);
+    if (magazine.count >= depth) {
+        // the oldest objects go back, and the most recently freed (likely cached) ones stay
+        const auto batch = depth / 2;
+        cache.deallocate_batch(magazine.objects, batch);
+        for (size_t i = batch; i < magazine.count; ++i)
+            magazine.objects[i - batch] = magazine.objects[i];
+        magazine.count -= batch;
+        cpu_cache.drains += 1;
+    }
+    magazine.objects[magazine.count++] = object;
+}
+
+auto allocate_large(size_t size) -> void *
+{
+    if (size > (size_t {kernelConstants::frameSize} << max_frame_order))
+        return nullptr;
+    const auto order = order_for_size(size);
+    auto block = allocate_frames(order);
+    if (!block && kmalloc_reap() > 0)
+        block = allocate_frames(order);
+    if (!block)
+        return nullptr;
+    large_blocks.fetch_add(1, std::memory_order_relaxed);
+    large_frames.fetch_add(size_t {1} << order, std::memory_order_relaxed);
+    return kernel_physical_to_virtual(block);
+}
+
+/**
+ * @brief Get the physical address of the block of frames of a large allocation.
+ */
+auto large_block_of(const void *ptr) -> uintptr_t
+{
+    const auto block = reinterpret_cast<uintptr_t>(ptr) - limine::hhdm_address->offset;
+    if (block % kernelConstants::frameSize != 0)
+        kernel_panic("invalid kfree of %p\n", ptr);
+    return block;
+}
+
+} // anonymous namespace
+
+auto kmalloc_init() -> void
+{
+    for (size_t i = 0; i < kmalloc_num_size_classes; ++i) {
+        const auto size = kmalloc_min_size << i;
+        caches[i].emplace(size_class_names[i], size, size < small_alignment ? size : small_alignment);
+    }
+    DEBUG("Initialized kmalloc.\n");
+}
+
+auto kmalloc(size_t size) -> void *
+{
+    if (size <= kmalloc_max_small_size)
+        return allocate_small(size);
+    return allocate_large(size);
+}
+
+auto kmalloc_aligned(size_t size, size_t alignment) -> void *
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return nullptr;
+    // objects of the size classes are only aligned to small_alignment (or their size, if smaller),
+    // but blocks of frames are aligned to their size
+    if (alignment <= small_alignment)
+        return kmalloc(size < alignment ? alignment : size);
+    return allocate_large(size < alignment ? alignment : size);
+}
+
+auto kfree(void *ptr) -> void
+{
+    if (!ptr)
+        return;
+    if (auto cache = SlabCache::cache_of(ptr)) {
+        const auto index = size_class(cache->object_size());
+        if (!caches[index] || &*caches[index] != cache)
+            kernel_panic("invalid kfree of %p, which is from slab cache %s\n", ptr, cache->name());
+        free_small(*cache, index, ptr);
+        return;
+    }
+    const auto block = large_block_of(ptr);
+    const auto order = frame_info(block).order;
+    large_blocks.fetch_sub(1, std::memory_order_relaxed);
+    large_frames.fetch_sub(size_t {1} << order, std::memory_order_relaxed);
+    deallocate_frames(reinterpret_cast<void *>(block), order);
+}
+
+auto kmalloc_usable_size(const void *ptr) -> size_t
+{
+    if (auto cache = SlabCache::cache_of(ptr))
+        return cache->object_size();
+    return size_t {kernelConstants::frameSize} << frame_info(large_block_of(ptr)).order;
+}
+
+auto kmalloc_drain_cpu_cache() -> void
+{
+    processor::InterruptGuard guard {};
+    auto &cpu_cache = cpu_caches[processor::currentCPUIndex()];
+    for (size_t i = 0; i < kmalloc_num_size_classes; ++i) {
+        auto &magazine = cpu_cache.magazines[i];
+        if (magazine.count == 0)
+            continue;
+        caches[i]->deallocate_batch(magazine.objects, magazine.count);
+        magazine.count = 0;
+        cpu_cache.drains += 1;
+    }
+}
+
+auto kmalloc_reap() -> size_t
+{
+    kmalloc_drain_cpu_cache();
+    auto frames = size_t {0};
+    for (auto &cache : caches) {
+        if (cache)
+            frames += cache->reap() << cache->slab_order();
+    }
+    return frames;
+}
+
+auto kmalloc_stats() -> KmallocStats
+{
+    auto stats = KmallocStats {};
+    for (auto const &cpu_cache : cpu_caches) {
+        stats.refills += cpu_cache.refills;
+        stats.drains += cpu_cache.drains;
+    }
+    for (size_t i = 0; i < kmalloc_num_size_classes; ++i) {
+        auto &cache = caches[i];
+        if (!cache)
+            continue;
+        // the counts of other processors' caches may be changing: this is only a snapshot
+        auto cached = size_t {0};
+        for (auto const &cpu_cache : cpu_caches)
+            cached += cpu_cache.magazines[i].count;
+        const auto cache_stats = cache->stats();
+        const auto in_use = cache_stats.objects_in_use > cached
+            ? cache_stats.objects_in_use - cached : 0;
+        stats.small_objects += in_use;
+        stats.small_bytes += in_use * cache->object_size();
+        stats.cached_objects += cached;
+        stats.slab_frames += cache_stats.slabs << cache->slab_order();
+    }
+    stats.large_blocks = large_blocks.load(std::memory_order_relaxed);
+    stats.large_frames = large_frames.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// the kernel is built without exceptions, so running out of memory in new is fatal
+
+void *operator new(size_t size)
+{
+    auto ptr = kmalloc(size);
+    if (!ptr)
+        kernel_panic("out of memory allocating %d bytes\n", static_cast<int>(size));
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    auto ptr = kmalloc_aligned(size, static_cast<size_t>(alignment));
+    if (!ptr)
+        kernel_panic("out of memory allocating %d bytes aligned to %d\n", static_cast<int>(size),
+            static_cast<int>(alignment));
+    return ptr;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return kmalloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return kmalloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    kfree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    kfree(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    kfree(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    kfree(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    kfree(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    kfree(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    kfree(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+    kfree(ptr);
+}
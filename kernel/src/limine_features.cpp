@@ -37,4 +37,11 @@ volatile limine_rsdp_request rsdp_request = {
 };
 
 struct limine_rsdp_response *rsdp_address = rsdp_request.response;
+
+volatile limine_smp_request smp_request = {
+    .id = LIMINE_SMP_REQUEST,
+    .revision = 0
+};
+
+struct limine_smp_response *smp_info = smp_request.response;
 };
@@ -2,17 +2,110 @@
 #include <kpp/cstring.hpp>
 
 #include <kernel/APICManager.hpp>
+#include <kernel/benchmarks.h>
 #include <kernel/frame_allocator.h>
 #include <kernel/kernel.h>
 #include <kernel/KeyboardBuffer.hpp>
+#include <kernel/kmalloc.h>
 #include <kernel/limine.h>
 #include <kernel/macros.h>
+#include <kernel/paging.h>
+#include <kernel/processor.hpp>
 #include <kernel/tests.h>
 #include <kernel/Terminal.hpp>
 #include <kernel/types.h> // LinkerAddress
 
 extern LinkerAddress kernel_stack_start;
 
+/**
+ * @brief Get the number of events per second, given a count over a number of TSC cycles.
+ */
+static int per_second(uint64_t count, uint64_t cycles)
+{
+    const auto milliseconds = cycles / (processor::timestampCounterFrequency() / 1000);
+    return milliseconds == 0 ? 0 : static_cast<int>(count * 1000 / milliseconds);
+}
+
+/**
+ * @brief Print the frame allocator's statistics. Rates are given both over the whole uptime
+ * and since the previous call.
+ */
+static void print_meminfo()
+{
+    static auto previous = FrameAllocatorStats {};
+    const auto stats = frame_allocator_stats();
+    const auto elapsed = stats.uptime_cycles - previous.uptime_cycles;
+
+    kpp::printf("frames: %d used (peak %d), %d free, %d managed, %d zeroed\n",
+        static_cast<int>(stats.used_frames), static_cast<int>(stats.peak_used_frames),
+        static_cast<int>(stats.free_frames), static_cast<int>(stats.managed_frames),
+        static_cast<int>(available_zeroed_frames()));
+    kpp::printf("allocations: %d (%d/s, %d/s since last meminfo), %d failed\n",
+        static_cast<int>(stats.allocations), per_second(stats.allocations, stats.uptime_cycles),
+        per_second(stats.allocations - previous.allocations, elapsed),
+        static_cast<int>(stats.failed_allocations));
+    kpp::printf("frees: %d (%d/s, %d/s since last meminfo)\n",
+        static_cast<int>(stats.frees), per_second(stats.frees, stats.uptime_cycles),
+        per_second(stats.frees - previous.frees, elapsed));
+
+    kpp::printf("free blocks (order: count, fragmentation index):\n");
+    for (uint8_t order = 0; order <= max_frame_order; ++order) {
+        if (stats.free_blocks[order] > 0)
+            kpp::printf("  %d: %d\n", order, static_cast<int>(stats.free_blocks[order]));
+        else
+            kpp::printf("  %d: 0, %d\n", order, fragmentation_index(order));
+    }
+
+    for (uint32_t cpu = 0; cpu < processor::maxCPUs; ++cpu) {
+        const auto cache = frame_cache_stats(cpu);
+        if (cache.allocations == 0)
+            continue;
+        kpp::printf("cpu %d cache: %d allocations, %d per mille hits, %d cached frames\n", cpu,
+            static_cast<int>(cache.allocations),
+            static_cast<int>((cache.allocations - cache.refills) * 1000 / cache.allocations),
+            static_cast<int>(cache.cached_frames));
+    }
+
+    kpp::printf("allocation latency (cycles: count):\n");
+    for (size_t bucket = 0; bucket < allocation_latency_buckets; ++bucket) {
+        if (stats.allocation_latency[bucket] == 0)
+            continue;
+        if (bucket == allocation_latency_buckets - 1)
+            kpp::printf("  >= %d: %d\n", static_cast<int>(allocation_latency_bucket_bound(bucket - 1)),
+                static_cast<int>(stats.allocation_latency[bucket]));
+        else
+            kpp::printf("  < %d: %d\n", static_cast<int>(allocation_latency_bucket_bound(bucket)),
+                static_cast<int>(stats.allocation_latency[bucket]));
+    }
+
+    const auto page_faults = paging_page_fault_stats();
+    kpp::printf("page faults: %d (%d lazy pages backed, %d copy-on-write copies, %d reuses, "
+        "%d spurious, %d unresolved)\n",
+        static_cast<int>(page_faults.faults), static_cast<int>(page_faults.lazy_mappings),
+        static_cast<int>(page_faults.cow_copies), static_cast<int>(page_faults.cow_reuses),
+        static_cast<int>(page_faults.spurious), static_cast<int>(page_faults.unresolved));
+
+    const auto page_tables = paging_page_table_stats();
+    kpp::printf("page tables: %d frames (peak %d), %d empty tables reclaimed\n",
+        static_cast<int>(page_tables.table_frames), static_cast<int>(page_tables.peak_table_frames),
+        static_cast<int>(page_tables.reclaimed_tables));
+
+    const auto kmalloc = kmalloc_stats();
+    kpp::printf("kmalloc: %d objects (%d bytes) in %d slab frames, %d large blocks (%d frames)\n",
+        static_cast<int>(kmalloc.small_objects), static_cast<int>(kmalloc.small_bytes),
+        static_cast<int>(kmalloc.slab_frames), static_cast<int>(kmalloc.large_blocks),
+        static_cast<int>(kmalloc.large_frames));
+    kpp::printf("kmalloc processor caches: %d objects, %d refills, %d drains\n",
+        static_cast<int>(kmalloc.cached_objects), static_cast<int>(kmalloc.refills),
+        static_cast<int>(kmalloc.drains));
+
+    const auto compaction = compaction_stats();
+    kpp::printf("compaction: %d runs, %d successes, %d frames migrated, %d failed migrations\n",
+        static_cast<int>(compaction.runs), static_cast<int>(compaction.successes),
+        static_cast<int>(compaction.migrated_frames), static_cast<int>(compaction.failed_migrations));
+    previous = stats;
+}
+
 [[ noreturn ]]
 void kernel_main()
 {
@@ -33,12 +126,18 @@ void kernel_main()
             kpp::printf("Available commands:\n");
             kpp::printf("  help - Show this help message\n");
             kpp::printf("  echo <message> - Echo the message back\n");
+            kpp::printf("  meminfo - Show physical memory allocator statistics\n");
+            kpp::printf("  bench - Run the kernel benchmarks\n");
             kpp::printf("  exit - Exit the shell\n");
         } else if (kpp::strncmp(input, "echo ", 5) == 0) {
             kpp::printf("%s\n", input + 5);
         } else if (kpp::strncmp(input, "exit", 4) == 0) {
             kpp::printf("Exiting shell...\n");
             kernel_hang();
+        } else if (kpp::strncmp(input, "meminfo", 7) == 0) {
+            print_meminfo();
+        } else if (kpp::strncmp(input, "bench", 5) == 0) {
+            run_all_benchmarks();
         } else if (kpp::strncmp(input, "clear", 5) == 0) {
             KernelTerminal::instance->clear();
         } else {
@@ -54,7 +153,9 @@ void kernel_main()
         kpp::printf("davOS> ");
         while (true) {
             Key key = kernel::keyboardBuffer.get();
-            if (key == Key::enter) {
+            if (key == Key::None) {
+                kernel_idle();
+            } else if (key == Key::enter) {
                 kpp::putchar('\n');
                 input[pos] = '\0';
                 break;
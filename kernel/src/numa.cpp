@@ -0,0 +1,159 @@
+/**
+ * @file numa.cpp
+ * @brief NUMA topology discovered from the ACPI SRAT.
+ *
+ * The SRAT identifies nodes by arbitrary 32-bit proximity domains; they are numbered densely
+ * from 0 in the order they first appear in the table.
+ */
+
+#include <kpp/array.hpp>
+#include <kernel/kernel.h>
+#include <kernel/macros.h>
+#include <kernel/numa.h>
+#include <kernel/processor.hpp>
+#include <kernel/RootSDT.h>
+#include <kernel/RootSystemDescriptionPointer.h>
+#include <kernel/SRAT.h>
+
+namespace
+{
+
+constexpr size_t max_memory_ranges = 32;
+constexpr size_t max_apic_ids = 256;
+
+// SRAT structure types and their "enabled" flag
+constexpr uint8_t processor_affinity_type = 0;
+constexpr uint8_t memory_affinity_type = 1;
+constexpr uint8_t x2apic_affinity_type = 2;
+constexpr uint32_t affinity_enabled = 1 << 0;
+
+auto proximity_domains = kpp::Array<uint32_t, max_numa_nodes> {};
+auto num_nodes = uint8_t {1};
+
+auto memory_ranges = kpp::Array<NumaMemoryRange, max_memory_ranges> {};
+auto num_memory_ranges = size_t {0};
+
+auto apic_id_nodes = kpp::Array<uint8_t, max_apic_ids> {};
+auto cpu_nodes = kpp::Array<uint8_t, processor::maxCPUs> {};
+
+/**
+ * @brief Get the dense node number of a proximity domain, assigning a new one if needed.
+ */
+auto node_of_proximity_domain(uint32_t proximity_domain) -> uint8_t
+{
+    static auto assigned_nodes = uint8_t {0};
+    for (uint8_t node = 0; node < assigned_nodes; ++node) {
+        if (proximity_domains[node] == proximity_domain)
+            return node;
+    }
+    if (assigned_nodes == max_numa_nodes) {
+        DEBUG("Too many NUMA nodes, folding proximity domain %d into node 0\n", proximity_domain);
+        return 0;
+    }
+    proximity_domains[assigned_nodes] = proximity_domain;
+    num_nodes = ++assigned_nodes;
+    return assigned_nodes - 1;
+}
+
+auto add_memory_range(uintptr_t begin, uintptr_t end, uint8_t node) -> void
+{
+    if (num_memory_ranges == max_memory_ranges) {
+        DEBUG("Too many SRAT memory ranges, treating %x-%x as node 0\n", begin, end);
+        return;
+    }
+    memory_ranges[num_memory_ranges++] = NumaMemoryRange {begin, end, node};
+}
+
+auto find_srat() -> SRAT *
+{
+    auto rsdp = reinterpret_cast<RootSystemDescriptionPointer*>(limine::rsdp_address->address);
+    if (!rsdp)
+        return nullptr;
+    const auto rsdt = reinterpret_cast<RootSDT *>(kernel_physical_to_virtual(rsdp->rootSDTPhysicalAddress()));
+    const auto physical_srat = rsdt->findSDTWithSignature<SRAT>("SRAT", rsdp->acpiRevision);
+    if (!physical_srat)
+        return nullptr;
+    return reinterpret_cast<SRAT *>(kernel_physical_to_virtual(physical_srat));
+}
+
+} // anonymous namespace
+
+auto numa_init() -> void
+{
+    const auto srat = find_srat();
+    if (!srat) {
+        DEBUG("No SRAT found, assuming a single NUMA node\n");
+        numa_register_current_cpu();
+        return;
+    }
+
+    // parse the SRAT, a table of contiguous affinity structures of different types
+    auto affinity_structures = reinterpret_cast<uint8_t*>(&srat->affinityStructures);
+    auto end = reinterpret_cast<uint8_t*>(srat) + srat->header.length;
+    while (affinity_structures < end)
+    {
+        auto type = *affinity_structures;
+        auto length = *(affinity_structures + 1);
+        if (length < 2)
+            break;
+        auto body = affinity_structures + 2;
+        switch (type) {
+        case processor_affinity_type: {
+            auto affinity = reinterpret_cast<SRATProcessorAffinity*>(body);
+            if (affinity->flags & affinity_enabled)
+                apic_id_nodes[affinity->apicId] = node_of_proximity_domain(affinity->proximityDomain());
+            break;
+        }
+        case memory_affinity_type: {
+            auto affinity = reinterpret_cast<SRATMemoryAffinity*>(body);
+            if (affinity->flags & affinity_enabled && affinity->length() > 0) {
+                add_memory_range(affinity->baseAddress(), affinity->baseAddress() + affinity->length(),
+                                 node_of_proximity_domain(affinity->proximityDomain));
+            }
+            break;
+        }
+        case x2apic_affinity_type: {
+            auto affinity = reinterpret_cast<SRATX2APICAffinity*>(body);
+            if (affinity->flags & affinity_enabled && affinity->x2apicId < max_apic_ids)
+                apic_id_nodes[affinity->x2apicId] = node_of_proximity_domain(affinity->proximityDomain);
+            break;
+        }
+        default:
+            break;
+        }
+        affinity_structures += length;
+    }
+
+    numa_register_current_cpu();
+    DEBUG("Found %d NUMA nodes and %d memory ranges in the SRAT\n", num_nodes, static_cast<int>(num_memory_ranges));
+}
+
+auto numa_node_count() -> uint8_t
+{
+    return num_nodes;
+}
+
+auto numa_memory_range_containing(uintptr_t physical_address) -> NumaMemoryRange
+{
+    // memory outside every SRAT range belongs to node 0, up to the next range
+    auto range = NumaMemoryRange {physical_address, UINTPTR_MAX, 0};
+    for (size_t i = 0; i < num_memory_ranges; ++i) {
+        const auto &candidate = memory_ranges[i];
+        if (candidate.begin <= physical_address && physical_address < candidate.end)
+            return candidate;
+        if (candidate.begin > physical_address && candidate.begin < range.end)
+            range.end = candidate.begin;
+    }
+    return range;
+}
+
+auto numa_register_current_cpu() -> void
+{
+    const auto apic_id = processor::currentAPICId();
+    cpu_nodes[processor::currentCPUIndex()] = apic_id < max_apic_ids ? apic_id_nodes[apic_id] : 0;
+}
+
+auto numa_current_node() -> uint8_t
+{
+    return cpu_nodes[processor::currentCPUIndex()];
+}
@@ -8,16 +8,19 @@ allocate physical frame for PML4 table frame (page tree root)
 
 #include <kpp/algorithm.hpp>
 #include <kpp/optional.hpp>
+#include <kernel/AddressSpace.h>
 #include <kernel/constants.h>
 #include <kernel/paging.h>
 #include <kernel/frame_allocator.h>
-#include <kernel/PageTree.h>
 #include <kernel/kernel.h>
 #include <kernel/limine_features.h>
 #include <kernel/macros.h>
+#include <kernel/processor.hpp>
+#include <kernel/SpinLock.h>
 #include <kernel/types.h>
 
 #include <kpp/cstring.hpp>
+#include <atomic>
 #include <tuple>
 
 extern "C" void load_ptbr(uintptr_t page_table_physical_address);
@@ -30,7 +33,41 @@ extern LinkerAddress kernel_readonly_start,
                      kernel_rw_end;
 
 
-static kpp::Optional<PageTree> page_tree;
+static kpp::Optional<AddressSpace> kernel_space;
+
+// start of the upper half of the address space, which holds the kernel's mappings
+constexpr uintptr_t kernel_half_base = 0xffff'8000'0000'0000;
+// CR3 bit 63: keep the TLB entries tagged with the loaded PCID
+constexpr uint64_t cr3_keep_tlb_entries = uint64_t {1} << 63;
+
+static bool global_pages_enabled = false;
+static bool pcids_enabled = false;
+
+/**
+ * @brief A region of the kernel's address space whose pages are mapped on first access.
+ */
+struct LazyRegion {
+    uintptr_t first_page {};
+    uintptr_t last_page {}; // end-exclusive
+    PageFlags flags {};
+};
+
+constexpr size_t max_lazy_regions = 32;
+// regions with last_page == 0 are unused
+static auto lazy_regions = kpp::Array<LazyRegion, max_lazy_regions> {};
+static auto lazy_page_handler = LazyPageHandler {nullptr};
+// protects the lazy regions, and serializes the resolution of page faults so that two processors
+// faulting on the same page don't both back (or copy) it
+static SpinLock page_fault_lock;
+
+static struct {
+    std::atomic<uint64_t> faults {0};
+    std::atomic<uint64_t> lazy_mappings {0};
+    std::atomic<uint64_t> spurious {0};
+    std::atomic<uint64_t> cow_copies {0};
+    std::atomic<uint64_t> cow_reuses {0};
+    std::atomic<uint64_t> unresolved {0};
+} page_fault_counters;
 
 struct Mapping {
     MemoryRegion from_virtual {};
@@ -83,14 +120,66 @@ static auto unavailable_virtual_memory_ranges = kpp::Array<MemoryRegion, initial
     initial_mappings[3].from_virtual
 }};
 
+/**
+ * @brief Move a page to a new frame for compaction (see FrameMigrationHandler).
+ */
+static auto migrate_page(uintptr_t page, uintptr_t old_frame, uintptr_t new_frame) -> bool
+{
+    const auto translation = kernel_space->get_translation(page);
+    if (translation.physical_address != old_frame)
+        return false;
+    kpp::memcpy(kernel_physical_to_virtual(reinterpret_cast<void *>(new_frame)),
+                kernel_physical_to_virtual(reinterpret_cast<void *>(old_frame)),
+                kernelConstants::pageSize);
+    // the old translation is invalidated by the page tree
+    kernel_space->map_range(page, new_frame, kernelConstants::pageSize, translation.flags);
+    return true;
+}
+
 void add_initial_mappings()
 {
     for (const auto &[from_virtual, to_physical, flags] : initial_mappings) {
         paging_add_mapping(from_virtual.base, to_physical, from_virtual.size, flags);
     }
+
+    // the HHDM map above only covers the first 4 GiB: also map every memory map entry above it
+    // (usable memory, ACPI tables, framebuffers...), so that any physical memory the kernel
+    // knows about can be reached through kernel_physical_to_virtual
+    constexpr auto hhdm_initial_size = uintptr_t {0x100000000};
+    for (size_t i = 0; i < limine::memory_map->entry_count; ++i) {
+        const auto entry = limine::memory_map->entries[i];
+        const auto entry_end = entry->base + entry->length;
+        if (entry_end <= hhdm_initial_size)
+            continue;
+        const auto begin = kpp::max(static_cast<uintptr_t>(entry->base), hhdm_initial_size);
+        paging_add_mapping(kernel_physical_to_virtual(begin), begin, entry_end - begin, PageFlags::Write);
+    }
     DEBUG("Added initial mappings.\n");
 }
 
+/**
+ * @brief Map the framebuffers (through the HHDM and, below 4 GiB, the identity map) as
+ * write-combining, so that pixel writes are burst to video memory instead of being written one
+ * at a time. Both mappings have the same memory type, since aliases with conflicting memory
+ * types are undefined behaviour.
+ */
+static void remap_framebuffers()
+{
+    if (!limine::framebuffers_info || !processor::hasPAT())
+        return;
+    constexpr auto identity_map_end = uintptr_t {0x100000000};
+    for (size_t i = 0; i < limine::framebuffers_info->framebuffer_count; ++i) {
+        const auto framebuffer = limine::framebuffers_info->framebuffers[i];
+        const auto virtual_base = reinterpret_cast<uintptr_t>(framebuffer->address);
+        const auto physical_base = virtual_base - limine::hhdm_address->offset;
+        const auto size = framebuffer->pitch * framebuffer->height;
+        paging_add_mapping(virtual_base, physical_base, size, PageFlags::Write | PageFlags::WriteCombining);
+        if (physical_base + size <= identity_map_end)
+            paging_add_mapping(physical_base, physical_base, size, PageFlags::Write | PageFlags::WriteCombining);
+        DEBUG("Mapped framebuffer %d at %x as write-combining.\n", static_cast<int>(i), physical_base);
+    }
+}
+
 void paging_init()
 {
     /**
@@ -103,8 +192,9 @@ void paging_init()
      *      - the memory map can be accessed through the limine_memmap feature
      *  - a mapping for the kernel, which can be obtained from the limine_kernel_address feature
      *
-     * We create our own page table and fill it with the above mappings, then free the physical
-     * frames associated with Limine's page table (so that we can manage virtual memory ourselves).
+     * We create our own page table and fill it with the above mappings. The physical frames
+     * associated with Limine's page table are freed once the application processors have left it
+     * too (so that we can manage virtual memory ourselves).
      *
      * For the official documentation of the limine boot protocol, see
      * https://github.com/limine-bootloader/limine/blob/v5.x-branch/PROTOCOL.md#entry-memory-layout
@@ -113,27 +203,54 @@ void paging_init()
 
     DEBUG("Initializing virtual memory manager...\n");
 
-    // allocate memory for the root of the page tree
-    auto pml4_table_frame = allocate_frame();
-    DEBUG("Allocated PML4 table frame at (physical) %p\n", pml4_table_frame);
+    // allocate the root of the page tree, and the upper-half tables that every address space
+    // shares with the kernel's
+    kernel_space.emplace();
+    DEBUG("Constructed kernel address space with PML4 at (physical) %p\n", kernel_space->root());
 
-    // since paging is already enabled, we need to access the physical frame
-    // by its virtual address
-    auto virtual_pml4_table_frame = kernel_physical_to_virtual(pml4_table_frame);
+    // kernel mappings are the same in every address space, so they can be kept in the TLB across
+    // address space switches
+    if (processor::hasGlobalPages()) {
+        processor::enableGlobalPages();
+        global_pages_enabled = true;
+    }
+
+    // the kernel's memory types are selected by the page flags of the mappings added below
+    if (processor::hasPAT())
+        processor::initializePageAttributeTable();
 
-    // construct the page tree, with space for the root node allocated
-    //  at the specified virtual address
-    page_tree.emplace(virtual_pml4_table_frame);
-    DEBUG("Constructed page tree at (virtual) %p\n", virtual_pml4_table_frame);
-    
-    
     add_initial_mappings();
+    remap_framebuffers();
 
     // load page table base register (PTBR) to point to the physical address of the page table
-    load_ptbr(reinterpret_cast<uintptr_t>(pml4_table_frame));
-    DEBUG("Loaded PTBR to point to %p\n", pml4_table_frame);
+    kernel_space->activate();
+    // the bootloader's global entries (if any) outlive the CR3 load
+    processor::flushGlobalTLB();
+    DEBUG("Loaded PTBR to point to %p\n", kernel_space->root());
+
+    // the PCID in CR3 is now the kernel's (0), as required to enable them; kernel pages must be
+    // global then, or their entries would linger under the PCIDs of the other address spaces
+    if (global_pages_enabled && processor::hasPCID()) {
+        processor::enablePCID();
+        pcids_enabled = true;
+    }
+    DEBUG("Global pages %s, PCIDs %s.\n", global_pages_enabled ? "enabled" : "disabled",
+        pcids_enabled ? "enabled" : "disabled");
 
-    free_limine_bootloader_memory();
+    set_frame_migration_handler(migrate_page);
+}
+
+auto paging_init_application_processor() -> void
+{
+    // same order as on the bootstrap processor: PCIDs can only be enabled with PCID 0 in CR3
+    if (global_pages_enabled)
+        processor::enableGlobalPages();
+    if (processor::hasPAT())
+        processor::initializePageAttributeTable();
+    kernel_space->activate();
+    processor::flushGlobalTLB();
+    if (pcids_enabled)
+        processor::enablePCID();
 }
 
 /**
@@ -178,14 +295,12 @@ void paging_add_mapping(uintptr_t virtual_base,
 {
     // addresss of the first and last page containing the virtual memory region
     const auto [first_page, last_page] = get_page_range(virtual_base, length);
-    // address of the first and last frames containing the virtual memory region 
+    // address of the first frame containing the virtual memory region
     uint64_t first_frame = page_floor(physical_base);
-    for (uint64_t page = first_page, frame = first_frame;
-         page < last_page;
-         page += kernelConstants::pageSize, frame += kernelConstants::frameSize) 
-    {
-        page_tree->map_page_to_frame(page, frame, flags);
-    }
+    if (global_pages_enabled && first_page >= kernel_half_base)
+        flags = flags | PageFlags::Global;
+    // large pages are used wherever the region's alignment allows
+    kernel_space->map_range(first_page, first_frame, last_page - first_page, flags);
 
 #ifdef DEBUG_BUILD
     uint64_t num_pages = (last_page - first_page) / kernelConstants::pageSize;
@@ -195,12 +310,246 @@ void paging_add_mapping(uintptr_t virtual_base,
 #endif
 }
 
-auto paging_allocate_and_map(uintptr_t virtual_base, size_t length, PageFlags flags) -> void
+auto paging_add_lazy_region(uintptr_t virtual_base, size_t length, PageFlags flags) -> bool
 {
     const auto [first_page, last_page] = get_page_range(virtual_base, length);
+    if (first_page == last_page)
+        return false;
+    SpinLockGuard guard {page_fault_lock};
+    LazyRegion *unused_region = nullptr;
+    for (auto &region : lazy_regions) {
+        if (region.last_page == 0) {
+            if (!unused_region)
+                unused_region = &region;
+        } else if (first_page < region.last_page && region.first_page < last_page) {
+            return false;
+        }
+    }
+    if (!unused_region)
+        return false;
+    *unused_region = LazyRegion {first_page, last_page, flags};
+    DEBUG("Added lazy region %x to %x (end-exclusive).\n", first_page, last_page);
+    return true;
+}
+
+auto paging_remove_lazy_region(uintptr_t virtual_base) -> void
+{
+    SpinLockGuard guard {page_fault_lock};
+    for (auto &region : lazy_regions) {
+        if (region.last_page != 0 && region.first_page == page_floor(virtual_base)) {
+            region = LazyRegion {};
+            return;
+        }
+    }
+}
+
+auto paging_set_lazy_page_handler(LazyPageHandler handler) -> void
+{
+    lazy_page_handler = handler;
+}
+
+/**
+ * @brief Map a missing page of the kernel's address space to a new zeroed frame. The caller holds
+ * the page fault lock.
+ */
+static void back_lazy_page(uintptr_t page, PageFlags flags)
+{
+    const auto frame = reinterpret_cast<uintptr_t>(allocate_zeroed_frame());
+    if (global_pages_enabled && page >= kernel_half_base)
+        flags = flags | PageFlags::Global;
+    kernel_space->map_range(page, frame, kernelConstants::pageSize, flags);
+    // the frame is only reachable through this page, so compaction may move it
+    set_frame_movable(frame, page);
+    page_fault_counters.lazy_mappings.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto paging_back_lazy_page(uintptr_t page, PageFlags flags) -> void
+{
+    SpinLockGuard guard {page_fault_lock};
+    // another processor may have backed the page first
+    if (kernel_space->get_translation(page).page_size != 0)
+        return;
+    back_lazy_page(page, flags);
+}
+
+/**
+ * @brief Check if a page mapped with the given flags allows the access described by a page fault
+ * error code.
+ */
+static auto permits_access(PageFlags flags, uint64_t error_code) -> bool
+{
+    const auto has = [flags](PageFlags flag) { return (flags & flag) == flag; };
+    return has(PageFlags::Present)
+        && (!(error_code & PageFaultError::Write) || has(PageFlags::Write))
+        && (!(error_code & PageFaultError::User) || has(PageFlags::User))
+        && (!(error_code & PageFaultError::InstructionFetch) || !has(PageFlags::ExecuteDisable));
+}
+
+/**
+ * @brief Give the writer of a copy-on-write page its own writable frame: a copy of the shared
+ * frame, or the frame itself if no other mapping references it anymore.
+ */
+static void resolve_copy_on_write(AddressSpace &space, uintptr_t page, PageTranslation const &translation)
+{
+    const auto frame = translation.physical_address;
+    const auto flags = (translation.flags | PageFlags::Write) & ~PageFlags::CopyOnWrite;
+    if (frame_ref_count(frame) == 1) {
+        space.protect_range(page, kernelConstants::pageSize, flags);
+        page_fault_counters.cow_reuses.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const auto new_frame = reinterpret_cast<uintptr_t>(allocate_frame());
+    kpp::memcpy(kernel_physical_to_virtual(reinterpret_cast<void *>(new_frame)),
+                kernel_physical_to_virtual(reinterpret_cast<void *>(frame)),
+                kernelConstants::pageSize);
+    space.map_range(page, new_frame, kernelConstants::pageSize, flags);
+    update_frame_ref_count(frame, -1);
+    page_fault_counters.cow_copies.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto paging_handle_page_fault(uintptr_t address, uint64_t error_code) -> bool
+{
+    page_fault_counters.faults.fetch_add(1, std::memory_order_relaxed);
+    const auto page = page_floor(address);
+    if (error_code & (PageFaultError::ReservedBit | PageFaultError::ProtectionKey)) {
+        page_fault_counters.unresolved.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const auto is_write = error_code & PageFaultError::Write;
+    const auto is_present = error_code & PageFaultError::Present;
+    {
+        SpinLockGuard guard {page_fault_lock};
+        auto space = AddressSpace::active();
+        const auto translation = space->get_translation(page);
+
+        if (is_present && is_write && translation.page_size == kernelConstants::pageSize
+            && (translation.flags & PageFlags::CopyOnWrite) == PageFlags::CopyOnWrite
+            && permits_access(translation.flags | PageFlags::Write, error_code))
+        {
+            resolve_copy_on_write(*space, page, translation);
+            return true;
+        }
+        if (permits_access(translation.flags, error_code)) {
+            // another processor resolved the fault after this one missed the page in the TLB
+            page_fault_counters.spurious.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        // lazy regions belong to the kernel's address space, whose upper half is shared by every
+        // address space; only missing pages can be backed
+        const auto is_kernel_page = page >= kernel_half_base || space == &*kernel_space;
+        if (!is_present && is_kernel_page) {
+            for (const auto &region : lazy_regions) {
+                if (page < region.first_page || page >= region.last_page)
+                    continue;
+                back_lazy_page(page, region.flags);
+                return true;
+            }
+        }
+    }
+    // the handler is called without the page fault lock, since it may itself fault on pages of
+    // the lazy regions (e.g. its own metadata)
+    if (!is_present && page >= kernel_half_base && lazy_page_handler && lazy_page_handler(page))
+        return true;
+    page_fault_counters.unresolved.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+auto paging_page_fault_stats() -> PageFaultStats
+{
+    auto stats = PageFaultStats {};
+    stats.faults = page_fault_counters.faults.load(std::memory_order_relaxed);
+    stats.lazy_mappings = page_fault_counters.lazy_mappings.load(std::memory_order_relaxed);
+    stats.spurious = page_fault_counters.spurious.load(std::memory_order_relaxed);
+    stats.cow_copies = page_fault_counters.cow_copies.load(std::memory_order_relaxed);
+    stats.cow_reuses = page_fault_counters.cow_reuses.load(std::memory_order_relaxed);
+    stats.unresolved = page_fault_counters.unresolved.load(std::memory_order_relaxed);
+    return stats;
+}
+
+auto paging_page_table_stats() -> PageTableStats
+{
+    return PageTree::stats();
+}
+
+auto paging_load_page_table(uintptr_t root, uint16_t pcid, bool flush) -> void
+{
+    auto cr3 = static_cast<uint64_t>(root);
+    if (pcids_enabled) {
+        cr3 |= pcid & 0xfff;
+        if (!flush)
+            cr3 |= cr3_keep_tlb_entries;
+    }
+    load_ptbr(cr3);
+}
+
+auto paging_kernel_address_space() -> AddressSpace &
+{
+    return *kernel_space;
+}
+
+auto paging_pcids_enabled() -> bool
+{
+    return pcids_enabled;
+}
+
+auto paging_unmap_range(uintptr_t virtual_base, size_t length, UnmappedPageVisitor on_unmapped) -> size_t
+{
+    const auto [first_page, last_page] = get_page_range(virtual_base, length);
+    const auto num_pages = kernel_space->unmap_range(first_page, last_page - first_page, on_unmapped);
+    DEBUG("Unmapped %d page(s) from %x to %x (end-exclusive).\n", static_cast<int>(num_pages), first_page, last_page);
+    return num_pages;
+}
+
+auto paging_protect_range(uintptr_t virtual_base, size_t length, PageFlags flags) -> size_t
+{
+    const auto [first_page, last_page] = get_page_range(virtual_base, length);
+    return kernel_space->protect_range(first_page, last_page - first_page, flags);
+}
+
+auto paging_allocate_and_map(uintptr_t virtual_base, size_t length, PageFlags flags, bool zeroed) -> bool
+{
+    const auto [first_page, last_page] = get_page_range(virtual_base, length);
+    // frames that happen to be physically contiguous are mapped together, with one walk of the
+    // page tree; runs stay below the size of a large page, so that every frame stays movable
+    constexpr auto max_run_length = uintptr_t {256} * kernelConstants::pageSize;
+    auto run_page = first_page;
+    auto run_frame = uintptr_t {0};
+    auto run_length = uintptr_t {0};
+    const auto map_run = [&] {
+        if (run_length == 0)
+            return;
+        paging_add_mapping(run_page, run_frame, run_length, flags);
+        // the frames are only reachable through these pages, so compaction may move them
+        for (uintptr_t offset = 0; offset < run_length; offset += kernelConstants::pageSize)
+            set_frame_movable(run_frame + offset, run_page + offset);
+    };
+
     for (auto page = first_page; page != last_page; page += kernelConstants::pageSize) {
-        paging_add_mapping(page, reinterpret_cast<uintptr_t>(allocate_frame()), kernelConstants::pageSize, flags);
+        const auto frame = reinterpret_cast<uintptr_t>(zeroed ? try_allocate_zeroed_frame() : try_allocate_frame());
+        if (!frame) {
+            map_run();
+            if (page != first_page)
+                paging_unmap_range(first_page, page - first_page, paging_release_unmapped_frames);
+            return false;
+        }
+        if (run_length > 0 && run_length < max_run_length && frame == run_frame + run_length) {
+            run_length += kernelConstants::pageSize;
+            continue;
+        }
+        map_run();
+        run_page = page;
+        run_frame = frame;
+        run_length = kernelConstants::pageSize;
     }
+    map_run();
+    return true;
+}
+
+auto paging_release_unmapped_frames(uintptr_t frame, size_t page_size) -> void
+{
+    for (size_t offset = 0; offset < page_size; offset += kernelConstants::frameSize)
+        update_frame_ref_count(frame + offset, -1);
 }
 
 auto paging_get_initial_free_regions() -> kpp::Array<MemoryRegion, 16> {
@@ -231,5 +580,17 @@ auto paging_get_initial_free_regions() -> kpp::Array<MemoryRegion, 16> {
 }
 
 auto paging_get_translation(uintptr_t virtual_address) -> PageTranslation {
-    return page_tree->get_translation(virtual_address);
+    return kernel_space->get_translation(virtual_address);
+}
+
+auto paging_get_frame(uintptr_t virtual_address) -> uintptr_t {
+    // the HHDM map and the kernel image are linear and never unmapped (framebuffers in the HHDM
+    // are remapped, but to the same frames)
+    for (size_t i = 1; i < initial_mappings.size(); ++i) {
+        const auto &[from_virtual, to_physical, flags] = initial_mappings[i];
+        const auto offset = virtual_address - from_virtual.base;
+        if (virtual_address >= from_virtual.base && offset < from_virtual.size)
+            return (to_physical + offset) & ~uintptr_t {0xfff};
+    }
+    return paging_get_translation(virtual_address).physical_address;
 }
@@ -1,8 +1,54 @@
 #include <cpuid.h>
+#include <cstddef>
 #include <cstdint>
 #include <kernel/kernel.h>
 #include <kernel/processor.hpp>
+#include <kpp/array.hpp>
 
+namespace {
+
+/**
+ * @brief The data pointed to by each processor's GS base.
+ */
+struct CPULocalStorage {
+    CPULocalStorage* self;
+    uint32_t index;
+};
+
+kpp::Array<CPULocalStorage, processor::maxCPUs> cpuLocalStorage {};
+
+constexpr uint32_t ia32GSBase = 0xC0000101;
+
+uint64_t measuredTimestampCounterFrequency = 0;
+
+constexpr uint32_t ia32PAT = 0x277;
+
+// memory type encodings of the page attribute table
+constexpr uint64_t uncached = 0x00;
+constexpr uint64_t writeCombining = 0x01;
+constexpr uint64_t writeThrough = 0x04;
+constexpr uint64_t writeBack = 0x06;
+constexpr uint64_t uncachedMinus = 0x07;
+
+constexpr uint64_t kernelPageAttributeTable = writeBack | writeCombining << 8 | uncachedMinus << 16
+    | uncached << 24 | writeBack << 32 | writeThrough << 40 | uncachedMinus << 48 | uncached << 56;
+
+constexpr uint64_t cr4GlobalPages = 1 << 7;
+constexpr uint64_t cr4PCID = 1 << 17;
+
+uint64_t readCR4()
+{
+    uint64_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+void writeCR4(uint64_t cr4)
+{
+    asm volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+} // namespace
 
 /**
  * @brief Check if this processor supports model-specific registers.
@@ -51,6 +97,62 @@ bool processor::hasPAT()
     return edx & static_cast<uint32_t>(CpuIdFeature::EDX_PAT);
 }
 
+void processor::initializePageAttributeTable()
+{
+    if (!hasPAT())
+        kernel_panic("processor does not support PAT\n");
+    // no cache line or TLB entry may be left with a memory type from the previous table
+    InterruptGuard guard {};
+    asm volatile("wbinvd" : : : "memory");
+    writeMSR(ia32PAT, static_cast<uint32_t>(kernelPageAttributeTable), kernelPageAttributeTable >> 32);
+    flushGlobalTLB();
+    asm volatile("wbinvd" : : : "memory");
+}
+
+uint64_t processor::pageAttributeTable()
+{
+    uint32_t low, high;
+    readMSR(ia32PAT, &low, &high);
+    return static_cast<uint64_t>(high) << 32 | low;
+}
+
+bool processor::has1GiBPages()
+{
+    // CPUID.80000001H:EDX.Page1GB[bit 26]
+    uint32_t unused, edx = 0;
+    if (!__get_cpuid(0x80000001, &unused, &unused, &unused, &edx))
+        return false;
+    return edx & (1 << 26);
+}
+
+bool processor::hasGlobalPages()
+{
+    uint32_t eax, unused, edx;
+    __get_cpuid(1, &eax, &unused, &unused, &edx);
+    return edx & static_cast<uint32_t>(CpuIdFeature::EDX_PGE);
+}
+
+bool processor::hasPCID()
+{
+    uint32_t eax, unused, ecx;
+    __get_cpuid(1, &eax, &unused, &ecx, &unused);
+    return ecx & static_cast<uint32_t>(CpuIdFeature::ECX_PCID);
+}
+
+void processor::enableGlobalPages()
+{
+    if (!hasGlobalPages())
+        kernel_panic("processor does not support global pages\n");
+    writeCR4(readCR4() | cr4GlobalPages);
+}
+
+void processor::enablePCID()
+{
+    if (!hasPCID())
+        kernel_panic("processor does not support PCIDs\n");
+    writeCR4(readCR4() | cr4PCID);
+}
+
 /**
  * @brief Get the memory-mapped physical base address of the local APIC.
  * The address is aligned to a 4 KiB boundary.
@@ -92,6 +194,66 @@ void processor::hardwareEnableLocalAPICAndSetBaseAddress(uintptr_t physicalBaseA
     writeMSR(0x1B, low, high);
 }
 
+/**
+ * @brief Read the processor's time-stamp counter (the number of cycles since reset).
+ */
+uint64_t processor::readTimestampCounter()
+{
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+uint64_t processor::timestampCounterFrequency()
+{
+    if (measuredTimestampCounterFrequency)
+        return measuredTimestampCounterFrequency;
+
+    constexpr uint32_t pitFrequency = 1193182;
+    constexpr uint16_t calibrationTicks = pitFrequency / 100; // 10 ms
+    constexpr uint16_t pitControlPort = 0x61;
+    constexpr uint16_t pitCommandPort = 0x43;
+    constexpr uint16_t pitChannel2Port = 0x42;
+
+    // enable the gate of PIT channel 2 with the speaker off, then count down once in mode 0
+    // (interrupt on terminal count), which sets bit 5 of the control port when it reaches 0
+    outb(pitControlPort, (inb(pitControlPort) & ~0x02) | 0x01);
+    outb(pitCommandPort, 0xB0);
+    outb(pitChannel2Port, calibrationTicks & 0xff);
+    outb(pitChannel2Port, calibrationTicks >> 8);
+    const auto start = readTimestampCounter();
+    while (!(inb(pitControlPort) & 0x20));
+    const auto cycles = readTimestampCounter() - start;
+
+    measuredTimestampCounterFrequency = cycles * pitFrequency / calibrationTicks;
+    return measuredTimestampCounterFrequency;
+}
+
+uint32_t processor::currentAPICId()
+{
+    uint32_t unused, ebx;
+    __get_cpuid(1, &unused, &ebx, &unused, &unused);
+    return ebx >> 24;
+}
+
+void processor::initializeCPULocalStorage(uint32_t cpuIndex)
+{
+    if (cpuIndex >= maxCPUs)
+        kernel_panic("processor index %d exceeds the supported number of processors\n", cpuIndex);
+    auto& storage = cpuLocalStorage[cpuIndex];
+    storage.self = &storage;
+    storage.index = cpuIndex;
+    const auto address = reinterpret_cast<uintptr_t>(&storage);
+    writeMSR(ia32GSBase, static_cast<uint32_t>(address), static_cast<uint32_t>(address >> 32));
+}
+
+uint32_t processor::currentCPUIndex()
+{
+    uint32_t index;
+    asm volatile("movl %%gs:%c1, %0" : "=r"(index) : "i"(offsetof(CPULocalStorage, index)));
+    return index;
+}
+
 /**
  * @brief Send a byte value to the specified I/O port.
  */
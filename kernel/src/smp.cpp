@@ -0,0 +1,216 @@
+#include <atomic>
+
+#include <kpp/array.hpp>
+#include <kernel/AddressSpace.h>
+#include <kernel/constants.h>
+#include <kernel/frame_allocator.h>
+#include <kernel/gdt.h>
+#include <kernel/idt.h>
+#include <kernel/kernel.h>
+#include <kernel/limine_features.h>
+#include <kernel/macros.h>
+#include <kernel/numa.h>
+#include <kernel/paging.h>
+#include <kernel/processor.hpp>
+#include <kernel/smp.h>
+#include <kernel/SpinLock.h>
+
+namespace
+{
+
+// 16 KiB stacks for the application processors
+constexpr uint8_t stack_order = 2;
+
+kpp::Array<uintptr_t, processor::maxCPUs> stack_tops {};
+// local APIC IDs of the processors, by index
+kpp::Array<uint32_t, processor::maxCPUs> apic_ids {};
+
+// processors that are running the kernel, including the bootstrap processor
+std::atomic<uint32_t> online_cpus {1};
+// bit i is set once processor i is online
+std::atomic<uint32_t> online_cpu_mask {1};
+// application processors that left the memory Limine started them with (online or halted)
+std::atomic<uint32_t> started_cpus {0};
+
+// the work of the current smp_run call, published by incrementing work_generation
+SmpWork work_function = nullptr;
+void *work_argument = nullptr;
+uint32_t work_cpus = 0;
+std::atomic<uint64_t> work_generation {0};
+// application processors that haven't yet seen (or finished) the current work
+std::atomic<uint32_t> pending_cpus {0};
+
+// serializes TLB shootdowns, whose range is published before the processors are asked to
+// invalidate it by setting their bit in shootdown_pending_cpus
+SpinLock shootdown_lock;
+uintptr_t shootdown_first = 0;
+uintptr_t shootdown_last = 0;
+std::atomic<uint32_t> shootdown_pending_cpus {0};
+
+/**
+ * @brief Wait for work given to smp_run and run it, forever.
+ */
+[[noreturn]] void run_work(uint64_t cpu_index)
+{
+    auto generation = work_generation.load(std::memory_order_acquire);
+    online_cpu_mask.fetch_or(uint32_t {1} << cpu_index);
+    // shootdowns that started before this processor was online didn't ask it to invalidate
+    // anything, and the page tables may have changed since paging_init_application_processor
+    processor::flushGlobalTLB();
+    online_cpus.fetch_add(1, std::memory_order_release);
+    started_cpus.fetch_add(1, std::memory_order_release);
+    asm volatile("sti" : : : "memory");
+    for (;;) {
+        while (work_generation.load(std::memory_order_acquire) == generation) {
+            smp_handle_tlb_shootdown();
+            processor::pause();
+        }
+        ++generation;
+        // every online processor acknowledges the work, so that the next smp_run call doesn't
+        // change it while it is still being read here
+        if (cpu_index < work_cpus)
+            work_function(work_argument);
+        pending_cpus.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Entry point of an application processor, called by Limine with interrupts disabled.
+ */
+void start_application_processor(limine_smp_info *info)
+{
+    // this runs on the stack and the page table Limine gave this processor, both in bootloader
+    // memory: the kernel's page table is loaded first, then the processor's own stack
+    const auto cpu_index = static_cast<uint32_t>(info->extra_argument);
+    gdt_init();
+    idt_load();
+    processor::initializeCPULocalStorage(cpu_index);
+    numa_register_current_cpu();
+    paging_init_application_processor();
+    processor::localAPIC.enableApplicationProcessorAPIC();
+    asm volatile(
+        "mov %0, %%rsp\n\t"
+        "xor %%ebp, %%ebp\n\t"
+        "call *%1"
+        : : "r"(stack_tops[cpu_index]), "r"(run_work), "D"(uint64_t {cpu_index}) : "memory");
+    __builtin_unreachable();
+}
+
+/**
+ * @brief Entry point of the application processors beyond processor::maxCPUs, which are halted.
+ */
+void halt_application_processor(limine_smp_info *)
+{
+    gdt_init();
+    idt_load();
+    paging_load_page_table(paging_kernel_address_space().root(), 0, true);
+    started_cpus.fetch_add(1, std::memory_order_release);
+    // halted with interrupts disabled, the processor doesn't touch its stack anymore
+    kernel_hang();
+}
+
+} // anonymous namespace
+
+auto smp_init() -> void
+{
+    const auto response = limine::smp_info;
+    if (!response) {
+        DEBUG("No SMP response from Limine, running on the bootstrap processor only.\n");
+        return;
+    }
+
+    auto num_application_processors = uint32_t {0};
+    auto next_index = uint32_t {1};
+    apic_ids[0] = response->bsp_lapic_id;
+    for (uint64_t i = 0; i < response->cpu_count; ++i) {
+        auto info = response->cpus[i];
+        if (info->lapic_id == response->bsp_lapic_id)
+            continue;
+        ++num_application_processors;
+        if (next_index >= processor::maxCPUs) {
+            __atomic_store_n(&info->goto_address, &halt_application_processor, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        const auto stack = allocate_frames(stack_order);
+        if (!stack)
+            kernel_panic("no memory for the stack of processor %d\n", next_index);
+        stack_tops[next_index] = kernel_physical_to_virtual(reinterpret_cast<uintptr_t>(stack))
+            + (kernelConstants::frameSize << stack_order);
+        apic_ids[next_index] = info->lapic_id;
+        info->extra_argument = next_index++;
+        __atomic_store_n(&info->goto_address, &start_application_processor, __ATOMIC_SEQ_CST);
+    }
+
+    while (started_cpus.load(std::memory_order_acquire) != num_application_processors)
+        processor::pause();
+    DEBUG("Started %d application processors (%d halted).\n", online_cpus.load() - 1,
+        num_application_processors + 1 - online_cpus.load());
+}
+
+auto smp_cpu_count() -> uint32_t
+{
+    return online_cpus.load(std::memory_order_acquire);
+}
+
+auto smp_run(SmpWork work, void *argument, uint32_t cpus) -> void
+{
+    const auto online = smp_cpu_count();
+    if (cpus == 0 || cpus > online)
+        kernel_panic("cannot run work on %d processors, %d are online\n", cpus, online);
+    if (processor::currentCPUIndex() != 0)
+        kernel_panic("smp_run called on processor %d\n", processor::currentCPUIndex());
+
+    work_function = work;
+    work_argument = argument;
+    work_cpus = cpus;
+    pending_cpus.store(online - 1, std::memory_order_relaxed);
+    work_generation.fetch_add(1, std::memory_order_release);
+    work(argument);
+    while (pending_cpus.load(std::memory_order_acquire) != 0) {
+        smp_handle_tlb_shootdown();
+        processor::pause();
+    }
+}
+
+auto smp_invalidate_tlb(uintptr_t first, uintptr_t last) -> void
+{
+    if (smp_cpu_count() == 1)
+        return;
+    // the lock spins with interrupts disabled, answering the shootdowns of other processors
+    SpinLockGuard guard {shootdown_lock};
+    const auto cpu_bit = uint32_t {1} << processor::currentCPUIndex();
+    const auto targets = online_cpu_mask.load() & ~cpu_bit;
+    if (targets == 0)
+        return;
+    shootdown_first = first;
+    shootdown_last = last;
+    shootdown_pending_cpus.store(targets, std::memory_order_release);
+    if (processor::localAPIC.baseAddress) {
+        for (uint32_t cpu = 0; cpu < processor::maxCPUs; ++cpu) {
+            if (targets & (uint32_t {1} << cpu))
+                processor::localAPIC.sendInterprocessorInterrupt(apic_ids[cpu], tlb_shootdown_vector);
+        }
+    }
+    while (shootdown_pending_cpus.load(std::memory_order_acquire) != 0)
+        processor::pause();
+}
+
+auto smp_handle_tlb_shootdown() -> void
+{
+    // checked first, since this is called while spinning
+    if (shootdown_pending_cpus.load(std::memory_order_relaxed) == 0)
+        return;
+    const auto cpu_bit = uint32_t {1} << processor::currentCPUIndex();
+    if (!(shootdown_pending_cpus.load(std::memory_order_acquire) & cpu_bit))
+        return;
+    // same policy as the page tree's own invalidations
+    const auto first_page = shootdown_first / kernelConstants::pageSize;
+    const auto num_pages = shootdown_last / kernelConstants::pageSize - first_page + 1;
+    if (num_pages > PageTree::tlb_flush_threshold) {
+        processor::flushGlobalTLB();
+    } else {
+        for (uint64_t page = 0; page < num_pages; ++page)
+            processor::invalidatePage((first_page + page) * kernelConstants::pageSize);
+    }
+    shootdown_pending_cpus.fetch_and(~cpu_bit, std::memory_order_release);
+}
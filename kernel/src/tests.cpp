@@ -1,16 +1,26 @@
 #include <kpp/cstdio.hpp>
+#include <atomic>
 #include <cstdint>
 #include <kpp/cstring.hpp>
 
 #include <kpp/algorithm.hpp>
+#include <kpp/array.hpp>
+#include <kernel/AddressSpace.h>
 #include <kernel/APICManager.hpp>
 #include <kernel/Allocator.h>
+#include <kernel/constants.h>
 #include <kernel/frame_allocator.h>
 #include <kernel/FreeListAllocator.h>
+#include <kernel/kmalloc.h>
+#include <kernel/limine_features.h>
 #include <kernel/macros.h>
 #include <kernel/processor.hpp>
 #include <kernel/tests.h>
 #include <kernel/paging.h>
+#include <kernel/SlabCache.h>
+#include <kernel/smp.h>
+#include <kernel/VirtualMemoryAllocator.h>
+#include <kernel/vmm.h>
 
 namespace
 {
@@ -31,6 +41,40 @@ private:
 
 GlobalConstructorTest global_constructor_test;
 
+uintptr_t unmapped_frames[2] = {};
+size_t num_unmapped_frames = 0;
+
+void record_unmapped_frame(uintptr_t frame, size_t)
+{
+    if (num_unmapped_frames < 2)
+        unmapped_frames[num_unmapped_frames] = frame;
+    ++num_unmapped_frames;
+}
+
+void free_unmapped_frame(uintptr_t frame, size_t)
+{
+    deallocate_frame(reinterpret_cast<void *>(frame));
+}
+
+void release_unmapped_frame(uintptr_t frame, size_t)
+{
+    update_frame_ref_count(frame, -1);
+}
+
+/**
+ * @brief An object large enough that a slab of a single frame can't hold 8 of them.
+ */
+struct CachedObject
+{
+    CachedObject() { ++constructions; }
+    ~CachedObject() { ++destructions; }
+
+    uint64_t words[63] = {0x5ab};
+
+    static inline size_t constructions = 0;
+    static inline size_t destructions = 0;
+};
+
 }
 
 [[ gnu::noinline ]]
@@ -84,15 +128,965 @@ void test_paging()
     }
 }
 
+void test_huge_pages()
+{
+    kpp::printf("running huge page test...\n");
+
+    // the HHDM is mapped with large pages
+    const auto hhdm_translation = paging_get_translation(kernel_physical_to_virtual(uintptr_t {0x40000000}));
+    // mapping a single page inside a large page (as test_paging does) splits it, and leaves the
+    // rest of the large page mapped as before
+    const auto neighbour_translation = paging_get_translation(0x80003000);
+
+    if (hhdm_translation.physical_address == 0x40000000 && hhdm_translation.page_size > kernelConstants::pageSize
+        && neighbour_translation.physical_address == 0x80003000)
+    {
+        kpp::printf("huge page test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("huge page test: FAILED\n");
+        kpp::printf("HHDM translation: %x (page size %x), neighbour translation: %x\n",
+            hhdm_translation.physical_address, hhdm_translation.page_size,
+            neighbour_translation.physical_address);
+    }
+}
+
+void test_global_pages()
+{
+    kpp::printf("running global pages test...\n");
+
+    // kernel (upper half) mappings are global, the identity map isn't
+    const auto hhdm_flags = paging_get_translation(kernel_physical_to_virtual(uintptr_t {0x1000})).flags;
+    const auto identity_flags = paging_get_translation(0x1000).flags;
+    const auto hhdm_global = (hhdm_flags & PageFlags::Global) == PageFlags::Global;
+    const auto identity_global = (identity_flags & PageFlags::Global) == PageFlags::Global;
+
+    // loading the kernel's page tree again (keeping its TLB entries) must leave it usable
+    const auto hhdm_word = reinterpret_cast<volatile uint64_t *>(kernel_physical_to_virtual(uintptr_t {0x1000}));
+    const auto value_before = *hhdm_word;
+    uintptr_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    paging_load_page_table(cr3 & ~uintptr_t {0xfff}, cr3 & 0xfff, false);
+    const auto value_after = *hhdm_word;
+
+    if (hhdm_global == processor::hasGlobalPages() && !identity_global && value_before == value_after)
+    {
+        kpp::printf("global pages test: PASSED (PCIDs %s)\n", paging_pcids_enabled() ? "enabled" : "disabled");
+    }
+    else
+    {
+        kpp::printf("global pages test: FAILED\n");
+        kpp::printf("HHDM flags: %x, identity map flags: %x\n", hhdm_flags, identity_flags);
+    }
+}
+
+void test_address_spaces()
+{
+    kpp::printf("running address spaces test...\n");
+    const auto frames_before = available_frames();
+    auto &kernel_space = paging_kernel_address_space();
+
+    constexpr auto user_page = uintptr_t {0x1000'0000'0000};
+    constexpr auto kernel_page = uintptr_t {0xffff'e000'0000'0000};
+    const auto frame = reinterpret_cast<uintptr_t>(allocate_frame());
+    *reinterpret_cast<volatile uint64_t *>(kernel_physical_to_virtual(frame)) = 0xfeedface;
+
+    auto is_passed = true;
+    {
+        auto space = AddressSpace {kernel_space};
+        space.map_range(user_page, frame, kernelConstants::pageSize, PageFlags::Write);
+        // the identity map is only in the kernel's address space
+        is_passed &= space.get_translation(0x1000).page_size == 0;
+
+        // kernel mappings made after the address space was created are shared with it
+        paging_add_mapping(kernel_page, frame, kernelConstants::pageSize, PageFlags::Write);
+        is_passed &= space.get_translation(kernel_page).physical_address == frame;
+        // unmapping them must not free the shared tables
+        paging_unmap_range(kernel_page, kernelConstants::pageSize);
+        is_passed &= space.get_translation(kernel_page).page_size == 0;
+        paging_add_mapping(kernel_page, frame, kernelConstants::pageSize, PageFlags::Write);
+        is_passed &= space.get_translation(kernel_page).physical_address == frame;
+
+        space.activate();
+        is_passed &= space.is_active() && !kernel_space.is_active();
+        is_passed &= *reinterpret_cast<volatile uint64_t *>(user_page) == 0xfeedface;
+        is_passed &= *reinterpret_cast<volatile uint64_t *>(kernel_page) == 0xfeedface;
+        kernel_space.activate();
+
+        paging_unmap_range(kernel_page, kernelConstants::pageSize);
+        space.unmap_range(user_page, kernelConstants::pageSize, nullptr);
+    }
+    deallocate_frame(reinterpret_cast<void *>(frame));
+    is_passed &= available_frames() == frames_before;
+
+    if (is_passed)
+    {
+        kpp::printf("address spaces test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("address spaces test: FAILED\n");
+        kpp::printf("%d frames before, %d after\n", static_cast<int>(frames_before),
+            static_cast<int>(available_frames()));
+    }
+}
+
+void test_write_combining()
+{
+    kpp::printf("running write-combining test...\n");
+    if (!processor::hasPAT() || !limine::framebuffers_info || limine::framebuffers_info->framebuffer_count == 0) {
+        kpp::printf("write-combining test: SKIPPED\n");
+        return;
+    }
+
+    // memory types of PAT entries 0 to 7: WB, WC, UC-, UC, WB, WT, UC-, UC
+    constexpr auto expected_table = uint64_t {0x0007'0406'0007'0106};
+    const auto framebuffer = limine::framebuffers_info->framebuffers[0];
+    const auto framebuffer_end = reinterpret_cast<uintptr_t>(framebuffer->address)
+        + framebuffer->pitch * framebuffer->height - 1;
+    const auto first_flags = paging_get_translation(reinterpret_cast<uintptr_t>(framebuffer->address)).flags;
+    const auto last_flags = paging_get_translation(framebuffer_end).flags;
+    // the memory right after the framebuffer keeps its memory type
+    const auto after_flags = paging_get_translation(framebuffer_end + kernelConstants::pageSize).flags;
+
+    if (processor::pageAttributeTable() == expected_table
+        && (first_flags & PageFlags::WriteCombining) == PageFlags::WriteCombining
+        && (last_flags & PageFlags::WriteCombining) == PageFlags::WriteCombining
+        && (after_flags & PageFlags::WriteCombining) == PageFlags::None)
+    {
+        kpp::printf("write-combining test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("write-combining test: FAILED\n");
+        kpp::printf("PAT: %x, framebuffer flags: %x to %x\n", processor::pageAttributeTable(),
+            first_flags, last_flags);
+    }
+}
+
+void test_unmap_and_protect()
+{
+    kpp::printf("running unmap and protect test...\n");
+    const auto frames_before = available_frames();
+
+    // far from every other mapping, so that the page tables created for it are freed on unmap
+    constexpr auto page = uintptr_t {0x7000'0000'0000};
+    const auto first = reinterpret_cast<uintptr_t>(allocate_frame());
+    const auto second = reinterpret_cast<uintptr_t>(allocate_frame());
+    paging_add_mapping(page, first, kernelConstants::pageSize, PageFlags::Write);
+    paging_add_mapping(page + kernelConstants::pageSize, second, kernelConstants::pageSize, PageFlags::Write);
+    *reinterpret_cast<volatile uint64_t *>(page) = 0xdeadbeef;
+
+    const auto num_protected = paging_protect_range(page, 2 * kernelConstants::pageSize, PageFlags::None);
+    const auto protected_flags = paging_get_translation(page).flags;
+    const auto value = *reinterpret_cast<volatile uint64_t *>(page);
+
+    num_unmapped_frames = 0;
+    const auto num_unmapped = paging_unmap_range(page, 2 * kernelConstants::pageSize, record_unmapped_frame);
+    const auto translation = paging_get_translation(page + kernelConstants::pageSize);
+    deallocate_frame(reinterpret_cast<void *>(first));
+    deallocate_frame(reinterpret_cast<void *>(second));
+
+    if (num_protected == 2 && (protected_flags & PageFlags::Write) == PageFlags::None && value == 0xdeadbeef
+        && num_unmapped == 2 && num_unmapped_frames == 2 && unmapped_frames[0] == first
+        && unmapped_frames[1] == second && translation.page_size == 0
+        && available_frames() == frames_before)
+    {
+        kpp::printf("unmap and protect test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("unmap and protect test: FAILED\n");
+        kpp::printf("protected %d, unmapped %d (visited %d), %d frames before, %d after\n",
+            static_cast<int>(num_protected), static_cast<int>(num_unmapped),
+            static_cast<int>(num_unmapped_frames), static_cast<int>(frames_before),
+            static_cast<int>(available_frames()));
+    }
+}
+
+void test_page_table_reclaim()
+{
+    kpp::printf("running page table reclaim test...\n");
+    const auto frames_before = available_frames();
+    const auto tables_before = paging_page_table_stats();
+
+    // two pages in different page tables of the same directory, far from every other mapping:
+    // each needs its own page table, and they share the directory and directory pointer table
+    constexpr auto page = uintptr_t {0x7000'0000'0000};
+    constexpr auto other_page = page + (uintptr_t {1} << 21);
+    const auto frame = reinterpret_cast<uintptr_t>(allocate_frame());
+    paging_add_mapping(page, frame, kernelConstants::pageSize, PageFlags::Write);
+    paging_add_mapping(other_page, frame, kernelConstants::pageSize, PageFlags::Write);
+    const auto tables_mapped = paging_page_table_stats();
+
+    // only the page table of the first page is left empty, then every table is
+    paging_unmap_range(page, kernelConstants::pageSize);
+    const auto tables_partly_unmapped = paging_page_table_stats();
+    paging_unmap_range(other_page, kernelConstants::pageSize);
+    const auto tables_unmapped = paging_page_table_stats();
+    deallocate_frame(reinterpret_cast<void *>(frame));
+
+    if (tables_mapped.table_frames == tables_before.table_frames + 4
+        && tables_mapped.peak_table_frames >= tables_mapped.table_frames
+        && tables_partly_unmapped.table_frames == tables_before.table_frames + 3
+        && tables_partly_unmapped.reclaimed_tables == tables_before.reclaimed_tables + 1
+        && tables_unmapped.table_frames == tables_before.table_frames
+        && tables_unmapped.reclaimed_tables == tables_before.reclaimed_tables + 4
+        && available_frames() == frames_before)
+    {
+        kpp::printf("page table reclaim test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("page table reclaim test: FAILED\n");
+        kpp::printf("tables: %d before, %d mapped, %d and %d unmapped (%d reclaimed)\n",
+            static_cast<int>(tables_before.table_frames), static_cast<int>(tables_mapped.table_frames),
+            static_cast<int>(tables_partly_unmapped.table_frames), static_cast<int>(tables_unmapped.table_frames),
+            static_cast<int>(tables_unmapped.reclaimed_tables - tables_before.reclaimed_tables));
+    }
+}
+
+void test_translation_cache()
+{
+    kpp::printf("running translation cache test...\n");
+    constexpr auto page = uintptr_t {0x7000'0000'0000};
+    const auto first = reinterpret_cast<uintptr_t>(allocate_frame());
+    const auto second = reinterpret_cast<uintptr_t>(allocate_frame());
+
+    // repeated lookups are served from the cache, which every change to the page must invalidate
+    paging_add_mapping(page, first, kernelConstants::pageSize, PageFlags::Write);
+    const auto walked = paging_get_translation(page);
+    const auto cached = paging_get_translation(page + 0x123);
+    paging_add_mapping(page, second, kernelConstants::pageSize, PageFlags::Write);
+    const auto remapped = paging_get_translation(page);
+    const auto remapped_frame = paging_get_frame(page + 0x123);
+    paging_protect_range(page, kernelConstants::pageSize, PageFlags::None);
+    const auto protected_flags = paging_get_translation(page).flags;
+    paging_unmap_range(page, kernelConstants::pageSize);
+    const auto unmapped_frame = paging_get_frame(page);
+
+    // HHDM and kernel image addresses are translated without a walk, to the same frames
+    const auto hhdm_frame = paging_get_frame(kernel_physical_to_virtual(first) + 0x123);
+    const auto code = reinterpret_cast<uintptr_t>(&test_translation_cache);
+    const auto data = reinterpret_cast<uintptr_t>(&num_unmapped_frames);
+    const auto is_image_linear = paging_get_frame(code) == paging_get_translation(code).physical_address
+        && paging_get_frame(data) == paging_get_translation(data).physical_address;
+    deallocate_frame(reinterpret_cast<void *>(first));
+    deallocate_frame(reinterpret_cast<void *>(second));
+
+    if (walked.physical_address == first && cached.physical_address == first
+        && cached.flags == walked.flags && remapped.physical_address == second
+        && remapped_frame == second && (protected_flags & PageFlags::Write) == PageFlags::None
+        && unmapped_frame == 0 && hhdm_frame == first && is_image_linear)
+    {
+        kpp::printf("translation cache test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("translation cache test: FAILED\n");
+        kpp::printf("frames %x and %x: walked %x, cached %x, remapped %x (%x), unmapped %x, HHDM %x\n",
+            first, second, walked.physical_address, cached.physical_address,
+            remapped.physical_address, remapped_frame, unmapped_frame, hhdm_frame);
+    }
+}
+
+void test_lazy_regions()
+{
+    kpp::printf("running lazy regions test...\n");
+    const auto frames_before = available_frames();
+    const auto faults_before = paging_page_fault_stats();
+
+    // only the pages of this 1 GiB range that are touched cost a frame
+    constexpr auto base = uintptr_t {0x2000'0000'0000};
+    constexpr auto length = size_t {1} << 30;
+    const auto is_added = paging_add_lazy_region(base, length, PageFlags::Write);
+    const auto is_overlap_rejected = !paging_add_lazy_region(base + length / 2, length, PageFlags::Write);
+
+    auto is_zeroed = true;
+    for (const auto offset : {size_t {0}, size_t {0x12345}, length - sizeof(uint64_t)}) {
+        auto word = reinterpret_cast<volatile uint64_t *>(base + offset);
+        is_zeroed &= *word == 0;
+        *word = offset;
+        is_zeroed &= *word == offset;
+    }
+    const auto faults_after = paging_page_fault_stats();
+    const auto untouched = paging_get_translation(base + length / 2);
+
+    // the backed pages outlive the region, which can be registered again once removed
+    paging_remove_lazy_region(base);
+    const auto is_kept = paging_get_translation(base).page_size != 0;
+    const auto is_readded = paging_add_lazy_region(base + length / 2, length, PageFlags::Write);
+    paging_remove_lazy_region(base + length / 2);
+    const auto num_unmapped = paging_unmap_range(base, length, free_unmapped_frame);
+
+    if (is_added && is_overlap_rejected && is_zeroed && untouched.page_size == 0 && is_kept
+        && is_readded && faults_after.lazy_mappings - faults_before.lazy_mappings == 3
+        && num_unmapped == 3 && available_frames() == frames_before)
+    {
+        kpp::printf("lazy regions test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("lazy regions test: FAILED\n");
+        kpp::printf("%d pages backed, %d unmapped, %d frames before, %d after\n",
+            static_cast<int>(faults_after.lazy_mappings - faults_before.lazy_mappings),
+            static_cast<int>(num_unmapped), static_cast<int>(frames_before),
+            static_cast<int>(available_frames()));
+    }
+}
+
+void test_copy_on_write()
+{
+    kpp::printf("running copy-on-write test...\n");
+    const auto frames_before = available_frames();
+    const auto faults_before = paging_page_fault_stats();
+    auto &kernel_space = paging_kernel_address_space();
+
+    constexpr auto page = uintptr_t {0x1000'0000'0000};
+    const auto word = reinterpret_cast<volatile uint64_t *>(page);
+    const auto frame = reinterpret_cast<uintptr_t>(allocate_frame());
+    *reinterpret_cast<volatile uint64_t *>(kernel_physical_to_virtual(frame)) = 0x1111;
+
+    auto is_passed = true;
+    {
+        auto parent = AddressSpace {kernel_space};
+        auto child = AddressSpace {kernel_space};
+        parent.map_range(page, frame, kernelConstants::pageSize, PageFlags::Write);
+        is_passed &= child.share_copy_on_write(parent, page, kernelConstants::pageSize) == 1;
+        is_passed &= frame_ref_count(frame) == 2;
+        const auto shared_flags = parent.get_translation(page).flags;
+        is_passed &= (shared_flags & (PageFlags::Write | PageFlags::CopyOnWrite)) == PageFlags::CopyOnWrite;
+
+        // the first writer gets a copy, and the other one is left as the only owner of the frame
+        child.activate();
+        is_passed &= *word == 0x1111;
+        *word = 0x2222;
+        is_passed &= *word == 0x2222 && child.get_translation(page).physical_address != frame;
+        is_passed &= frame_ref_count(frame) == 1;
+
+        parent.activate();
+        is_passed &= *word == 0x1111;
+        *word = 0x3333;
+        is_passed &= *word == 0x3333 && parent.get_translation(page).physical_address == frame;
+        kernel_space.activate();
+
+        child.unmap_range(page, kernelConstants::pageSize, release_unmapped_frame);
+        parent.unmap_range(page, kernelConstants::pageSize, release_unmapped_frame);
+    }
+    const auto faults_after = paging_page_fault_stats();
+    is_passed &= faults_after.cow_copies - faults_before.cow_copies == 1;
+    is_passed &= faults_after.cow_reuses - faults_before.cow_reuses == 1;
+    is_passed &= available_frames() == frames_before;
+
+    if (is_passed)
+    {
+        kpp::printf("copy-on-write test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("copy-on-write test: FAILED\n");
+        kpp::printf("%d copies, %d reuses, %d frames before, %d after\n",
+            static_cast<int>(faults_after.cow_copies - faults_before.cow_copies),
+            static_cast<int>(faults_after.cow_reuses - faults_before.cow_reuses),
+            static_cast<int>(frames_before), static_cast<int>(available_frames()));
+    }
+}
+
+void test_frame_allocator()
+{
+    kpp::printf("running frame allocator test...\n");
+    const auto frames_before = available_frames();
+
+    // a 2 MiB block should be aligned to its size
+    constexpr auto huge_order = uint8_t {9};
+    const auto block = reinterpret_cast<uintptr_t>(allocate_frames(huge_order));
+    const auto block_is_aligned = block && block % (kernelConstants::frameSize << huge_order) == 0;
+
+    // single frames split from the same block should coalesce back when freed
+    auto first = allocate_frame();
+    auto second = allocate_frame();
+    deallocate_frame(second);
+    deallocate_frame(first);
+    if (block)
+        deallocate_frames(reinterpret_cast<void *>(block), huge_order);
+
+    if (block_is_aligned && available_frames() == frames_before)
+    {
+        kpp::printf("frame allocator test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("frame allocator test: FAILED\n");
+        kpp::printf("block: %p, frames before: %d, frames after: %d\n",
+            block, static_cast<int>(frames_before), static_cast<int>(available_frames()));
+    }
+}
+
+void test_frame_ref_count()
+{
+    kpp::printf("running frame reference count test...\n");
+    const auto frames_before = available_frames();
+
+    // a shared frame should only be freed once its last reference is dropped
+    const auto frame = reinterpret_cast<uintptr_t>(allocate_frame());
+    const auto initial_count = frame_ref_count(frame);
+    update_frame_ref_count(frame, 1);
+    const auto still_referenced = update_frame_ref_count(frame, -1) == 1
+        && available_frames() == frames_before - 1;
+    const auto final_count = update_frame_ref_count(frame, -1);
+
+    if (initial_count == 1 && still_referenced && final_count == 0
+        && available_frames() == frames_before)
+    {
+        kpp::printf("frame reference count test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("frame reference count test: FAILED\n");
+        kpp::printf("initial count: %d, frames before: %d, frames after: %d\n",
+            static_cast<int>(initial_count), static_cast<int>(frames_before), static_cast<int>(available_frames()));
+    }
+}
+
+void test_zeroed_frames()
+{
+    kpp::printf("running zeroed frame test...\n");
+
+    // frames handed out by the zeroed pool should be zero even if they were dirty when freed
+    auto dirty_frame = allocate_frame();
+    kpp::memset(kernel_physical_to_virtual(dirty_frame), 0xff, kernelConstants::frameSize);
+    deallocate_frame(dirty_frame);
+    refill_zeroed_frames(4);
+    const auto pool_was_refilled = available_zeroed_frames() > 0;
+
+    auto frame = allocate_zeroed_frame();
+    auto words = reinterpret_cast<uint64_t *>(kernel_physical_to_virtual(frame));
+    auto nonzero_words = 0;
+    for (size_t i = 0; i < kernelConstants::frameSize / sizeof(uint64_t); ++i)
+        nonzero_words += words[i] != 0;
+    deallocate_frame(frame);
+
+    if (pool_was_refilled && nonzero_words == 0)
+    {
+        kpp::printf("zeroed frame test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("zeroed frame test: FAILED\n");
+        kpp::printf("zeroed frames: %d, non-zero words: %d\n", static_cast<int>(available_zeroed_frames()),
+            nonzero_words);
+    }
+}
+
+void test_memory_zones()
+{
+    kpp::printf("running memory zone test...\n");
+    const auto frames_before = available_frames();
+
+    // frames requested from a low zone should lie below the end of that zone
+    const auto dma32_frame = reinterpret_cast<uintptr_t>(allocate_frames(0, MemoryZone::DMA32));
+    const auto dma_frame = reinterpret_cast<uintptr_t>(allocate_frames(0, MemoryZone::DMA));
+    const auto dma32_ok = dma32_frame && frame_zone(dma32_frame) != MemoryZone::Normal;
+    // there may be no free memory at all below 16 MiB
+    const auto dma_ok = !dma_frame || frame_zone(dma_frame) == MemoryZone::DMA;
+    if (dma32_frame)
+        deallocate_frame(reinterpret_cast<void *>(dma32_frame));
+    if (dma_frame)
+        deallocate_frame(reinterpret_cast<void *>(dma_frame));
+
+    if (dma32_ok && dma_ok && available_frames() == frames_before)
+    {
+        kpp::printf("memory zone test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("memory zone test: FAILED\n");
+        kpp::printf("DMA32 frame: %p, DMA frame: %p, frames before: %d, frames after: %d\n",
+            dma32_frame, dma_frame, static_cast<int>(frames_before), static_cast<int>(available_frames()));
+    }
+}
+
+void test_compaction()
+{
+    kpp::printf("running compaction test...\n");
+
+    // fill the DMA zone, so that the only free order-9 block it can get is the one made below;
+    // the held blocks are linked through their first word
+    constexpr auto huge_order = uint8_t {9};
+    const auto next_of = [](uintptr_t block) -> uintptr_t & {
+        return *static_cast<uintptr_t *>(kernel_physical_to_virtual(reinterpret_cast<void *>(block)));
+    };
+    auto held_blocks = kpp::Array<uintptr_t, 2> {};
+    for (auto i = 0; i < 2; ++i) {
+        const auto order = i == 0 ? huge_order : uint8_t {0};
+        while (auto block = reinterpret_cast<uintptr_t>(allocate_frames(order, MemoryZone::DMA))) {
+            next_of(block) = held_blocks[i];
+            held_blocks[i] = block;
+        }
+    }
+    const auto huge_block = held_blocks[0];
+    const auto free_frame = held_blocks[1];
+    if (!huge_block || !free_frame) {
+        kpp::printf("compaction test: FAILED\n");
+        kpp::printf("no free order-%d block or frame in the DMA zone\n", huge_order);
+        return;
+    }
+    held_blocks[0] = next_of(huge_block);
+    held_blocks[1] = next_of(free_frame);
+
+    // fragment the huge block with a movable page, and free a single frame it can move to
+    deallocate_frames(reinterpret_cast<void *>(huge_block), huge_order);
+    const auto movable_frame = reinterpret_cast<uintptr_t>(allocate_frames(0, MemoryZone::DMA));
+    constexpr auto movable_vpage = uintptr_t {0x80006000};
+    constexpr auto test_value = uint32_t {0x5eed1234};
+    paging_add_mapping(movable_vpage, movable_frame, kernelConstants::pageSize, PageFlags::Write);
+    set_frame_movable(movable_frame, movable_vpage);
+    auto movable_ptr = reinterpret_cast<volatile uint32_t *>(movable_vpage);
+    *movable_ptr = test_value;
+    deallocate_frame(reinterpret_cast<void *>(free_frame));
+
+    const auto migrated_before = compaction_stats().migrated_frames;
+    const auto compacted = compact_frames(huge_order, MemoryZone::DMA);
+    const auto migrated = compaction_stats().migrated_frames - migrated_before;
+    const auto new_frame = paging_get_frame(movable_vpage);
+    const auto value = *movable_ptr;
+    // the whole huge block is free again
+    const auto reallocated_block = reinterpret_cast<uintptr_t>(allocate_frames(huge_order, MemoryZone::DMA));
+
+    if (reallocated_block)
+        deallocate_frames(reinterpret_cast<void *>(reallocated_block), huge_order);
+    paging_unmap_range(movable_vpage, kernelConstants::pageSize, paging_release_unmapped_frames);
+    for (auto i = 0; i < 2; ++i) {
+        const auto order = i == 0 ? huge_order : uint8_t {0};
+        while (const auto block = held_blocks[i]) {
+            held_blocks[i] = next_of(block);
+            deallocate_frames(reinterpret_cast<void *>(block), order);
+        }
+    }
+
+    const auto was_in_huge_block = movable_frame >= huge_block
+        && movable_frame < huge_block + (kernelConstants::frameSize << huge_order);
+    if (compacted && was_in_huge_block && migrated == 1 && new_frame == free_frame && value == test_value
+        && reallocated_block == huge_block)
+    {
+        kpp::printf("compaction test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("compaction test: FAILED\n");
+        kpp::printf("compacted: %d, migrated %d frame(s) from %p to %p (expected %p), read %x, "
+            "reallocated block %p (expected %p)\n", compacted, static_cast<int>(migrated), movable_frame,
+            new_frame, free_frame, value, reallocated_block, huge_block);
+    }
+}
+
+void test_reserved_ranges()
+{
+    kpp::printf("running reserved range test...\n");
+
+    // firmware, MMIO and kernel frames should stay reserved, ACPI tables should have been released
+    const auto kernel_reserved = is_frame_reserved(limine::kernel_address->physical_base);
+    const auto local_apic_reserved = is_frame_reserved(processor::localAPICBaseAddress());
+    auto acpi_ranges = 0;
+    for (size_t i = 0; i < reserved_range_count(); ++i)
+        acpi_ranges += reserved_range(i).type == ReservationType::AcpiReclaimable;
+
+    const auto frame = reinterpret_cast<uintptr_t>(allocate_frame());
+    const auto frame_reserved = is_frame_reserved(frame);
+    deallocate_frame(reinterpret_cast<void *>(frame));
+
+    if (kernel_reserved && local_apic_reserved && acpi_ranges == 0 && !frame_reserved)
+    {
+        kpp::printf("reserved range test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("reserved range test: FAILED\n");
+        kpp::printf("kernel reserved: %d, local APIC reserved: %d, ACPI ranges: %d, frame %p reserved: %d\n",
+            kernel_reserved, local_apic_reserved, acpi_ranges, frame, frame_reserved);
+    }
+}
+
+void test_frame_allocator_stats()
+{
+    kpp::printf("running frame allocator stats test...\n");
+    const auto before = frame_allocator_stats();
+
+    auto frame = allocate_frame();
+    auto block = allocate_frames(2);
+    const auto during = frame_allocator_stats();
+    deallocate_frames(block, 2);
+    deallocate_frame(frame);
+    const auto after = frame_allocator_stats();
+
+    auto latency_samples = uint64_t {0};
+    for (auto count : after.allocation_latency)
+        latency_samples += count;
+    const auto counted_allocations = during.allocations - before.allocations == 2
+        && after.frees - before.frees == 2;
+    const auto counted_used_frames = during.used_frames == before.used_frames + 5
+        && after.used_frames == before.used_frames && after.peak_used_frames >= during.used_frames;
+    const auto frames_add_up = after.used_frames + after.free_frames == after.managed_frames;
+
+    if (counted_allocations && counted_used_frames && frames_add_up && latency_samples >= 2)
+    {
+        kpp::printf("frame allocator stats test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("frame allocator stats test: FAILED\n");
+        kpp::printf("used frames: %d -> %d -> %d, free frames: %d, managed frames: %d, latency samples: %d\n",
+            static_cast<int>(before.used_frames), static_cast<int>(during.used_frames),
+            static_cast<int>(after.used_frames), static_cast<int>(after.free_frames),
+            static_cast<int>(after.managed_frames), static_cast<int>(latency_samples));
+    }
+}
+
+void test_virtual_memory_allocator()
+{
+    kpp::printf("running virtual memory allocator test...\n");
+    // the allocator never touches the range it manages, so any unused range will do; it starts
+    // 3 pages before a 64 KiB boundary so that the first blocks are small
+    constexpr auto base = uintptr_t {0x7000'0000'd000};
+    constexpr auto size = size_t {0x43000};
+    const auto metadata = allocate_zeroed_frame();
+    auto allocator = VirtualMemoryAllocator {reinterpret_cast<void *>(base), size,
+        reinterpret_cast<VirtualMemoryAllocator::BlockInfo *>(kernel_physical_to_virtual(metadata))};
+    const auto free_pages = allocator.free_pages();
+
+    const auto page = reinterpret_cast<uintptr_t>(allocator.allocate(1));
+    const auto block = reinterpret_cast<uintptr_t>(allocator.allocate(0x3000));
+    const auto largest = reinterpret_cast<uintptr_t>(allocator.allocate(0x20000));
+    const auto too_large = allocator.allocate(0x20000);
+    const auto block_size = allocator.allocation_size(reinterpret_cast<void *>(block));
+    const auto is_used = allocator.free_pages() == free_pages - 1 - 4 - 0x20;
+    allocator.deallocate(reinterpret_cast<void *>(block));
+    allocator.deallocate(reinterpret_cast<void *>(page));
+    allocator.deallocate(reinterpret_cast<void *>(largest));
+    deallocate_frame(metadata);
+
+    // blocks from vmalloc are aligned to their size as well
+    const auto virtual_block = reinterpret_cast<uintptr_t>(vmalloc(0x5000));
+    vfree(reinterpret_cast<void *>(virtual_block));
+
+    if (page >= base && page % 0x1000 == 0 && block % 0x4000 == 0 && block_size == 0x4000
+        && largest % 0x20000 == 0 && largest + 0x20000 <= base + size && too_large == nullptr
+        && is_used && allocator.free_pages() == free_pages && virtual_block % 0x8000 == 0)
+    {
+        kpp::printf("virtual memory allocator test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("virtual memory allocator test: FAILED\n");
+        kpp::printf("page %x, block %x (size %x), largest %x, vmalloc %x, %d of %d pages free\n",
+            page, block, block_size, largest, virtual_block, static_cast<int>(allocator.free_pages()),
+            static_cast<int>(free_pages));
+    }
+}
+
+void test_vmalloc()
+{
+    kpp::printf("running vmalloc test...\n");
+    // page tables created for the mappings may stay, shared with other mappings of the region
+    const auto free_frames = [] {
+        return available_frames() + paging_page_table_stats().table_frames;
+    };
+    constexpr auto num_pages = size_t {64};
+    constexpr auto size = num_pages * kernelConstants::pageSize;
+    constexpr auto huge_size = size_t {3} << 30;
+    // the allocator's metadata is backed as it is used, like the allocations: use the same
+    // blocks once first, so that only the pages of the allocations are counted below
+    auto warm_up = static_cast<volatile uint64_t *>(vmalloc(size));
+    for (size_t page = 0; page < num_pages; ++page)
+        warm_up[page * kernelConstants::pageSize / sizeof(uint64_t)] = 0;
+    vfree(const_cast<uint64_t *>(warm_up));
+    warm_up = static_cast<volatile uint64_t *>(vmalloc(huge_size));
+    warm_up[huge_size / sizeof(uint64_t) - 1] = 0;
+    vfree(const_cast<uint64_t *>(warm_up));
+    const auto frames_before = free_frames();
+    const auto faults_before = paging_page_fault_stats();
+
+    // lazy memory: only the touched pages are backed, on their first access
+    auto lazy = static_cast<uint64_t *>(vmalloc(size));
+    const auto lazy_untouched = paging_get_translation(reinterpret_cast<uintptr_t>(lazy)).page_size == 0;
+    auto is_zeroed = true;
+    for (const auto page : {size_t {0}, size_t {5}, num_pages - 1}) {
+        auto word = lazy + page * kernelConstants::pageSize / sizeof(uint64_t);
+        is_zeroed &= *word == 0;
+        *word = page;
+    }
+    const auto faults_lazy = paging_page_fault_stats();
+    const auto frames_lazy = free_frames();
+    vfree(lazy);
+    const auto frames_lazy_freed = free_frames();
+
+    // eager memory: every page is backed up front, and never faults
+    auto eager = static_cast<uint64_t *>(vmalloc(size, VmallocMode::Eager));
+    auto is_mapped = true;
+    for (size_t page = 0; page < num_pages; ++page)
+        is_mapped &= paging_get_translation(reinterpret_cast<uintptr_t>(eager) + page * kernelConstants::pageSize).page_size != 0;
+    for (size_t i = 0; i < size / sizeof(uint64_t); ++i) {
+        is_zeroed &= eager[i] == 0;
+        eager[i] = i;
+    }
+    const auto faults_eager = paging_page_fault_stats();
+    const auto frames_eager = free_frames();
+    vfree(eager);
+    const auto is_unmapped = paging_get_translation(reinterpret_cast<uintptr_t>(eager)).page_size == 0;
+    const auto frames_eager_freed = free_frames();
+
+    // sizes above the largest block of the virtual memory allocator get a run of such blocks
+    auto huge = vmalloc(huge_size);
+    const auto huge_last_page = reinterpret_cast<uintptr_t>(huge) + huge_size - kernelConstants::pageSize;
+    *reinterpret_cast<volatile uint64_t *>(huge_last_page) = huge_size;
+    vfree(huge);
+    const auto huge_is_unmapped = paging_get_translation(huge_last_page).page_size == 0;
+    const auto frames_huge_freed = free_frames();
+    // the run is carved out of the same address space again once it is freed
+    const auto huge_again = vmalloc(huge_size);
+    vfree(huge_again);
+
+    if (lazy_untouched && is_zeroed && is_mapped && is_unmapped
+        && reinterpret_cast<uintptr_t>(huge) % (size_t {1} << 30) == 0 && huge_again == huge
+        && huge_is_unmapped && frames_huge_freed == frames_before
+        && faults_lazy.lazy_mappings - faults_before.lazy_mappings == 3
+        && faults_eager.lazy_mappings == faults_lazy.lazy_mappings
+        && frames_before - frames_lazy == 3 && frames_lazy_freed == frames_before
+        && frames_before - frames_eager == num_pages && frames_eager_freed == frames_before)
+    {
+        kpp::printf("vmalloc test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("vmalloc test: FAILED\n");
+        kpp::printf("%d lazy pages backed, %d frames used by lazy memory (%d after vfree), %d by eager "
+            "memory (%d after vfree), huge memory at %p (then %p, %d frames used after vfree)\n",
+            static_cast<int>(faults_lazy.lazy_mappings - faults_before.lazy_mappings),
+            static_cast<int>(frames_before - frames_lazy), static_cast<int>(frames_before - frames_lazy_freed),
+            static_cast<int>(frames_before - frames_eager), static_cast<int>(frames_before - frames_eager_freed),
+            huge, huge_again, static_cast<int>(frames_before - frames_huge_freed));
+    }
+}
+
+void test_slab_cache()
+{
+    kpp::printf("running slab cache test...\n");
+    const auto frames_before = available_frames();
+    CachedObject::constructions = 0;
+    CachedObject::destructions = 0;
+
+    auto is_intact = true;
+    auto is_distinct = true;
+    auto stats_in_use = SlabCacheStats {};
+    auto stats_freed = SlabCacheStats {};
+    auto constructions_reused = size_t {0};
+    auto num_reaped = size_t {0};
+    auto per_slab = size_t {0};
+    {
+        auto cache = ObjectCache<CachedObject> {"test objects"};
+        per_slab = cache.cache().objects_per_slab();
+        // one more object than fits in a slab
+        constexpr size_t num_objects = 16;
+        CachedObject *objects[num_objects] = {};
+        for (auto &object : objects) {
+            object = cache.allocate();
+            is_intact &= object != nullptr && object->words[0] == 0x5ab
+                && reinterpret_cast<uintptr_t>(object) % alignof(CachedObject) == 0;
+        }
+        for (size_t i = 0; i < num_objects; ++i) {
+            for (size_t j = 0; j < i; ++j)
+                is_distinct &= objects[i] != objects[j];
+        }
+        stats_in_use = cache.cache().stats();
+        for (auto object : objects)
+            cache.deallocate(object);
+        stats_freed = cache.cache().stats();
+
+        // objects come back from the empty slabs without being constructed again
+        auto object = cache.allocate();
+        constructions_reused = CachedObject::constructions;
+        cache.deallocate(object);
+        num_reaped = cache.cache().reap();
+    }
+
+    if (is_intact && is_distinct && per_slab == 15 && stats_in_use.slabs == 2
+        && stats_in_use.objects_in_use == 16 && stats_in_use.objects == 2 * per_slab
+        && stats_freed.empty_slabs == 2 && stats_freed.objects_in_use == 0
+        && stats_freed.allocations == 16 && stats_freed.frees == 16
+        && constructions_reused == 2 * per_slab && CachedObject::destructions == 2 * per_slab
+        && num_reaped == 2 && available_frames() == frames_before)
+    {
+        kpp::printf("slab cache test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("slab cache test: FAILED\n");
+        kpp::printf("%d per slab, %d slabs, %d constructions, %d destructions, %d reaped\n",
+            static_cast<int>(per_slab), static_cast<int>(stats_in_use.slabs),
+            static_cast<int>(constructions_reused), static_cast<int>(CachedObject::destructions),
+            static_cast<int>(num_reaped));
+    }
+}
+
+void test_kmalloc()
+{
+    kpp::printf("running kmalloc test...\n");
+    const auto stats_before = kmalloc_stats();
+
+    // sizes around the size classes, each filled with its own byte
+    constexpr size_t sizes[] = {0, 1, 8, 9, 24, 100, 512, 513, 4096, 4097, 20000};
+    constexpr size_t usable_sizes[] = {8, 8, 8, 16, 32, 128, 512, 1024, 4096, 8192, 32768};
+    constexpr size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    void *blocks[num_sizes] = {};
+    auto is_correct = true;
+    for (size_t i = 0; i < num_sizes; ++i) {
+        blocks[i] = kmalloc(sizes[i]);
+        const auto address = reinterpret_cast<uintptr_t>(blocks[i]);
+        const auto alignment = usable_sizes[i] > kmalloc_max_small_size ? kernelConstants::frameSize
+            : usable_sizes[i] < 16 ? usable_sizes[i] : 16;
+        is_correct &= blocks[i] != nullptr && address % alignment == 0
+            && kmalloc_usable_size(blocks[i]) == usable_sizes[i];
+        if (blocks[i])
+            kpp::memset(blocks[i], static_cast<int>(i), usable_sizes[i]);
+    }
+    // writing one block must not have touched any other
+    for (size_t i = 0; i < num_sizes; ++i) {
+        const auto bytes = static_cast<unsigned char *>(blocks[i]);
+        for (size_t j = 0; bytes && j < usable_sizes[i]; ++j)
+            is_correct &= bytes[j] == i;
+    }
+    const auto stats_in_use = kmalloc_stats();
+    for (auto block : blocks)
+        kfree(block);
+    kfree(nullptr);
+
+    auto aligned = kmalloc_aligned(100, 256);
+    const auto is_aligned = aligned && reinterpret_cast<uintptr_t>(aligned) % 256 == 0;
+    kfree(aligned);
+
+    // new and delete go through kmalloc
+    CachedObject::constructions = 0;
+    CachedObject::destructions = 0;
+    auto object = new CachedObject;
+    const auto is_object_correct = object->words[0] == 0x5ab && SlabCache::cache_of(object) != nullptr
+        && kmalloc_usable_size(object) == 512 && CachedObject::constructions == 1;
+    delete object;
+    auto array = new uint64_t[1000];
+    const auto is_array_correct = SlabCache::cache_of(array) == nullptr
+        && kmalloc_usable_size(array) >= 1000 * sizeof(uint64_t);
+    delete[] array;
+
+    const auto stats_after = kmalloc_stats();
+    if (is_correct && is_aligned && is_object_correct && is_array_correct
+        && CachedObject::destructions == 1
+        && stats_in_use.small_objects == stats_before.small_objects + 9
+        && stats_in_use.large_blocks == stats_before.large_blocks + 2
+        && stats_in_use.large_frames == stats_before.large_frames + 10
+        && stats_after.small_objects == stats_before.small_objects
+        && stats_after.large_blocks == stats_before.large_blocks
+        && stats_after.large_frames == stats_before.large_frames)
+    {
+        kpp::printf("kmalloc test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("kmalloc test: FAILED\n");
+        kpp::printf("%d small objects, %d large blocks (%d frames) in use; %d small objects, %d large "
+            "blocks after freeing\n", static_cast<int>(stats_in_use.small_objects),
+            static_cast<int>(stats_in_use.large_blocks), static_cast<int>(stats_in_use.large_frames),
+            static_cast<int>(stats_after.small_objects), static_cast<int>(stats_after.large_blocks));
+    }
+}
+
+void test_kmalloc_cpu_cache()
+{
+    kpp::printf("running kmalloc processor cache test...\n");
+    kmalloc_drain_cpu_cache();
+    const auto stats_before = kmalloc_stats();
+
+    // the last object freed is the next one allocated
+    auto first = kmalloc(64);
+    kfree(first);
+    auto second = kmalloc(64);
+    kfree(second);
+
+    // freeing more objects than the cache holds gives batches back to the size-class cache
+    constexpr size_t num_objects = 100;
+    void *objects[num_objects] = {};
+    for (auto &object : objects)
+        object = kmalloc(64);
+    for (auto object : objects)
+        kfree(object);
+    const auto stats_freed = kmalloc_stats();
+    kmalloc_drain_cpu_cache();
+    const auto stats_drained = kmalloc_stats();
+
+    if (first == second && stats_freed.refills > stats_before.refills
+        && stats_freed.drains > stats_before.drains
+        && stats_freed.cached_objects > stats_before.cached_objects
+        && stats_freed.cached_objects - stats_before.cached_objects <= 32
+        && stats_freed.small_objects == stats_before.small_objects
+        && stats_drained.cached_objects == stats_before.cached_objects)
+    {
+        kpp::printf("kmalloc processor cache test: PASSED\n");
+    }
+    else
+    {
+        kpp::printf("kmalloc processor cache test: FAILED\n");
+        kpp::printf("%p then %p, %d refills, %d drains, %d cached objects (%d after draining)\n",
+            first, second, static_cast<int>(stats_freed.refills - stats_before.refills),
+            static_cast<int>(stats_freed.drains - stats_before.drains),
+            static_cast<int>(stats_freed.cached_objects), static_cast<int>(stats_drained.cached_objects));
+    }
+}
+
+void test_smp()
+{
+    kpp::printf("running SMP test (%d processors)...\n", static_cast<int>(smp_cpu_count()));
+    struct State
+    {
+        std::atomic<uint32_t> runs {0};
+        std::atomic<uint32_t> cpus {0};
+        std::atomic<bool> is_intact {true};
+    };
+    auto state = State {};
+    const auto cpus = smp_cpu_count();
+    smp_run([](void *argument) {
+        auto &state = *static_cast<State *>(argument);
+        const auto cpu = processor::currentCPUIndex();
+        state.runs.fetch_add(1);
+        state.cpus.fetch_or(uint32_t {1} << cpu);
+        // every processor allocates from its own cache at the same time
+        constexpr size_t num_objects = 256;
+        uint32_t *objects[num_objects] = {};
+        for (size_t i = 0; i < num_objects; ++i) {
+            objects[i] = static_cast<uint32_t *>(kmalloc(16 << (i % 4)));
+            *objects[i] = cpu;
+        }
+        for (auto object : objects) {
+            if (*object != cpu)
+                state.is_intact = false;
+            kfree(object);
+        }
+    }, &state, cpus);
+
+    const auto all_cpus = (uint32_t {1} << cpus) - 1;
+    if (state.runs == cpus && state.cpus == all_cpus && state.is_intact)
+        kpp::printf("SMP test: PASSED\n");
+    else
+        kpp::printf("SMP test: FAILED (%d runs, processors %x)\n", static_cast<int>(state.runs.load()),
+            static_cast<uint64_t>(state.cpus.load()));
+}
+
 template <typename Alloc>
 auto test_allocator() -> void {
     kpp::printf("running allocator test...\n");
     auto allocator = Alloc {};
-    const auto free_regions = paging_get_initial_free_regions();
-    const auto free_region = free_regions[0];
-    constexpr auto free_region_max_size = size_t {0x1000};
-    allocator.add_memory(reinterpret_cast<Alloc::value_type *>(free_region.base),
-        kpp::max(free_region.size, free_region_max_size));
+    // a frame of its own: the free regions of the address space belong to the VMM
+    const auto frame = allocate_frame();
+    allocator.add_memory(reinterpret_cast<Alloc::value_type *>(kernel_physical_to_virtual(frame)),
+        kernelConstants::frameSize);
 
     const auto p1 = allocator.allocate(0x20);
     const auto p2 = allocator.allocate(0x30);
@@ -101,6 +1095,7 @@ auto test_allocator() -> void {
     allocator.deallocate(p3);
     allocator.deallocate(p2);
     allocator.deallocate(p1);
+    deallocate_frame(frame);
     kpp::printf("allocator test: PASSED\n");
 }
 
@@ -161,6 +1156,28 @@ void run_all_tests()
     // test_interrupt_handling();
     // test_stack_smash();
     test_paging();
+    test_huge_pages();
+    test_global_pages();
+    test_write_combining();
+    test_unmap_and_protect();
+    test_translation_cache();
+    test_page_table_reclaim();
+    test_address_spaces();
+    test_lazy_regions();
+    test_copy_on_write();
+    test_frame_allocator();
+    test_frame_ref_count();
+    test_zeroed_frames();
+    test_memory_zones();
+    test_compaction();
+    test_reserved_ranges();
+    test_frame_allocator_stats();
+    test_virtual_memory_allocator();
+    test_vmalloc();
+    test_slab_cache();
+    test_kmalloc();
+    test_kmalloc_cpu_cache();
+    test_smp();
     test_allocator<FreeListAllocator<char>>();
     test_interprocessor_interrupts();
     test_keyboard();
@@ -1,43 +1,105 @@
-#include <kpp/Optional.hpp>
+#include <kpp/array.hpp>
+#include <kpp/optional.hpp>
 #include <kernel/constants.h>
 #include <kernel/frame_allocator.h>
-#include <kernel/FreeListAllocator.h>
 #include <kernel/kernel.h>
 #include <kernel/macros.h>
 #include <kernel/paging.h>
+#include <kernel/SpinLock.h>
+#include <kernel/VirtualMemoryAllocator.h>
 #include <kernel/vmm.h>
 
-using allocated_type = std::byte;
-using virtual_allocator_type = FreeListAllocator<allocated_type>;
+// start of the upper half of the address space, which is shared by every address space
+constexpr uintptr_t kernel_half_base = 0xffff'8000'0000'0000;
 
-static auto allocator = Allocator<virtual_allocator_type> {};
+// one allocator per free region of the address space
+static auto allocators = kpp::Array<kpp::Optional<VirtualMemoryAllocator>, paging_num_free_memory_regions> {};
+static SpinLock allocators_lock;
+
+/**
+ * @brief Back the pages of live allocations on first access (see LazyPageHandler). Pages that
+ * aren't allocated, e.g. after vfree, are left missing so that stray accesses still fault.
+ */
+static auto back_allocated_page(uintptr_t page) -> bool
+{
+    // held while backing the page, so that vfree can't release the block in between
+    SpinLockGuard guard {allocators_lock};
+    for (auto &allocator : allocators) {
+        if (allocator && allocator->is_allocated(reinterpret_cast<void *>(page))) {
+            paging_back_lazy_page(page, PageFlags::Write);
+            return true;
+        }
+    }
+    return false;
+}
 
 auto vmm_init() -> void {
-    for (const auto &[base, size] : paging_get_initial_free_regions()) {
-        if (size == 0) {
+    const auto regions = paging_get_initial_free_regions();
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const auto [base, size] = regions[i];
+        // lower-half regions belong to a single address space
+        if (size == 0 || base < kernel_half_base) {
             continue;
         }
-        allocator.add_memory(reinterpret_cast<allocated_type *>(base), size);
+        // the allocator's metadata takes the start of the region, and is backed as it is used
+        const auto metadata_size = (VirtualMemoryAllocator::metadata_size(size) + kernelConstants::pageSize - 1)
+            / kernelConstants::pageSize * kernelConstants::pageSize;
+        if (metadata_size + kernelConstants::pageSize > size) {
+            continue;
+        }
+        if (!paging_add_lazy_region(base, metadata_size, PageFlags::Write)) {
+            kernel_panic("failed to add lazy region at %x with size %x\n", base, metadata_size);
+        }
+        allocators[i].emplace(reinterpret_cast<void *>(base + metadata_size), size - metadata_size,
+            reinterpret_cast<VirtualMemoryAllocator::BlockInfo *>(base));
         DEBUG("Initialized VMM with region at %x with size %x\n", base, size);
     }
+    // the allocations themselves are backed as they are used
+    paging_set_lazy_page_handler(back_allocated_page);
     DEBUG("Initialized VMM.\n");
 }
 
-auto vmalloc(size_t size) -> void * {
-    return allocator.allocate(size);
+auto vmalloc(size_t size, VmallocMode mode) -> void * {
+    auto block = static_cast<void *>(nullptr);
+    {
+        SpinLockGuard guard {allocators_lock};
+        for (auto &allocator : allocators) {
+            if (allocator && (block = allocator->allocate(size))) {
+                break;
+            }
+        }
+    }
+    if (!block) {
+        kernel_panic("ran out of virtual memory!\n");
+        return nullptr;
+    }
+    // lazy memory is backed by back_allocated_page, so only eager memory is mapped here
+    if (mode == VmallocMode::Eager
+        && !paging_allocate_and_map(reinterpret_cast<uintptr_t>(block), size, PageFlags::Write, true)) {
+        kernel_panic("ran out of memory backing %x bytes of virtual memory\n", size);
+    }
+    return block;
 }
 
 auto vfree(void *ptr) -> void {
-    allocator.deallocate(reinterpret_cast<allocated_type *>(ptr));
-    // assume frames cannot be referenced multiple times for now: deallocate the frame mapped to
-    // by this virtual address
-    deallocate_frame(
-        reinterpret_cast<void *>(
-            paging_get_translation(
-                reinterpret_cast<uintptr_t>(
-                    ptr
-                )
-            ).physical_address
-        )
-    );
+    auto allocator = allocators.begin();
+    auto size = uint64_t {0};
+    {
+        SpinLockGuard guard {allocators_lock};
+        while (allocator != allocators.end() && !(*allocator && (*allocator)->contains(ptr))) {
+            ++allocator;
+        }
+        if (allocator == allocators.end()) {
+            kernel_panic("invalid free of virtual memory at %p\n", ptr);
+        }
+        size = (*allocator)->allocation_size(ptr);
+    }
+    // every page that was touched (or mapped eagerly) is backed by a frame of its own; the range
+    // is only handed out again once they are all unmapped
+    paging_unmap_range(reinterpret_cast<uintptr_t>(ptr), size, paging_release_unmapped_frames);
+    SpinLockGuard guard {allocators_lock};
+    // a racing access (a use after free) may have backed a page again before the lock was taken;
+    // the page tables are mostly gone by now, so this second pass is cheap
+    paging_unmap_range(reinterpret_cast<uintptr_t>(ptr), size, paging_release_unmapped_frames);
+    (*allocator)->deallocate(ptr);
 }
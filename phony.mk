@@ -7,13 +7,25 @@ else
 	OS := other
 endif
 
-.PHONY: qemu debug test debug-test iso run clean
+.PHONY: qemu qemu-numa qemu-smp debug test debug-test iso run clean
 
 ISOROOT = isoroot
 
 qemu: iso
 	qemu-system-x86_64 -cdrom $(ISO) -d int -no-shutdown -no-reboot
 
+# Run on a two-node NUMA machine (one processor and 1 GiB of memory per node)
+qemu-numa: iso
+	qemu-system-x86_64 -cdrom $(ISO) -d int -no-shutdown -no-reboot \
+		-smp 2 -m 2G \
+		-object memory-backend-ram,id=mem0,size=1G -object memory-backend-ram,id=mem1,size=1G \
+		-numa node,nodeid=0,cpus=0,memdev=mem0 -numa node,nodeid=1,cpus=1,memdev=mem1
+
+# Run on a multiprocessor machine, e.g. for the kmalloc scaling benchmark (make qemu-smp CPUS=16)
+CPUS ?= 4
+qemu-smp: iso
+	qemu-system-x86_64 -cdrom $(ISO) -d int -no-shutdown -no-reboot -smp $(CPUS) -m 1G
+
 # Run a qemu instance in the background and attach a GDB instance to it
 debug: iso
 	qemu-system-x86_64 -cdrom $(ISO) -d int -no-shutdown -no-reboot -S -gdb tcp::1234 &